@@ -0,0 +1,300 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "adapter.h"
+
+#include "recdvbcore.h"
+
+#define DVB_DIR "/dev/dvb"
+#define PATH_BUFFER 512
+
+/* /run/lock is shared by every user on most systems, /tmp otherwise */
+static const char *lock_dir(void)
+{
+	if (access("/run/lock", W_OK) == 0) {
+		return "/run/lock";
+	}
+	return "/tmp";
+}
+
+static int compare_info(const void *a, const void *b)
+{
+	const adapter_info *x = a;
+	const adapter_info *y = b;
+
+	if (x->dev_num != y->dev_num) {
+		return x->dev_num - y->dev_num;
+	}
+	return x->fe_num - y->fe_num;
+}
+
+static int load_cache(adapter_info *cache, int max)
+{
+	char path[PATH_BUFFER];
+	FILE *fp;
+	int fd;
+	int n = 0;
+	unsigned long rdev;
+	long ctime;
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/%s", lock_dir(), ADAPTER_CACHE_NAME);
+	fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		return 0;
+	}
+
+	/* directory is shared, trust only our own or root's file */
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (st.st_uid != geteuid() && st.st_uid != 0) || !(fp = fdopen(fd, "r"))) {
+		close(fd);
+		return 0;
+	}
+
+	while (n < max && fscanf(fp, "%d %d %d %lu %ld",
+				 &cache[n].dev_num, &cache[n].fe_num, &cache[n].isdbtype, &rdev, &ctime) == 5) {
+		if (cache[n].isdbtype < 0) {
+			continue;
+		}
+		cache[n].rdev = rdev;
+		cache[n].ctime = ctime;
+		n++;
+	}
+	fclose(fp);
+
+	return n;
+}
+
+/* write to temporary file and rename, readers never see partial file */
+static void save_cache(const adapter_info *list, int n)
+{
+	char path[PATH_BUFFER], tmp[PATH_BUFFER + 16];
+	FILE *fp;
+	int fd;
+	int i;
+
+	snprintf(path, sizeof(path), "%s/%s", lock_dir(), ADAPTER_CACHE_NAME);
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return;
+	}
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	/* failed probe is tried again next time */
+	for (i = 0; i < n; i++) {
+		if (list[i].isdbtype < 0) {
+			continue;
+		}
+		fprintf(fp, "%d %d %d %lu %ld\n", list[i].dev_num, list[i].fe_num, list[i].isdbtype,
+			(unsigned long)list[i].rdev, (long)list[i].ctime);
+	}
+	if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+		unlink(tmp);
+	}
+}
+
+static int probe(int dev_num, int fe_num)
+{
+	char device[PATH_BUFFER];
+	int fd, isdbtype;
+
+	/* read only open works while another process owns the frontend */
+	snprintf(device, sizeof(device), DVB_DIR "/adapter%d/frontend%d", dev_num, fe_num);
+	fd = open(device, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		return -1;
+	}
+	isdbtype = frontend_isdbtype(fd);
+	close(fd);
+
+	return isdbtype;
+}
+
+/* list frontends sorted by adapter and frontend number */
+int adapter_list(adapter_info *list, int max)
+{
+	static adapter_info cache[ADAPTER_MAX];
+	int ncache;
+	int n = 0;
+	int dirty = 0;
+	int cached = 0;
+	int i;
+	DIR *dvb, *adp;
+	struct dirent *de, *fe;
+
+	ncache = load_cache(cache, ADAPTER_MAX);
+
+	dvb = opendir(DVB_DIR);
+	if (!dvb) {
+		fprintf(stderr, "Error: Cannot open %s. (errno=%d)\n", DVB_DIR, errno);
+		return -1;
+	}
+
+	while ((de = readdir(dvb)) != NULL && n < max) {
+		char dir[PATH_BUFFER];
+		int dev_num;
+
+		if (sscanf(de->d_name, "adapter%d", &dev_num) != 1) {
+			continue;
+		}
+		snprintf(dir, sizeof(dir), DVB_DIR "/%s", de->d_name);
+		adp = opendir(dir);
+		if (!adp) {
+			continue;
+		}
+
+		while ((fe = readdir(adp)) != NULL && n < max) {
+			char device[PATH_BUFFER * 2];
+			struct stat st;
+			adapter_info *info = &list[n];
+
+			if (sscanf(fe->d_name, "frontend%d", &info->fe_num) != 1) {
+				continue;
+			}
+			snprintf(device, sizeof(device), "%s/%s", dir, fe->d_name);
+			if (stat(device, &st) != 0) {
+				continue;
+			}
+			info->dev_num = dev_num;
+			info->rdev = st.st_rdev;
+			info->ctime = st.st_ctime;
+
+			/* use cached delivery system unless node changed */
+			info->isdbtype = -2;
+			for (i = 0; i < ncache; i++) {
+				if (cache[i].dev_num == dev_num && cache[i].fe_num == info->fe_num &&
+				    cache[i].rdev == info->rdev && cache[i].ctime == info->ctime) {
+					info->isdbtype = cache[i].isdbtype;
+					break;
+				}
+			}
+			if (info->isdbtype == -2) {
+				info->isdbtype = probe(dev_num, info->fe_num);
+				dirty |= info->isdbtype >= 0;
+			}
+			if (info->isdbtype >= 0) {
+				cached++;
+			}
+			n++;
+		}
+		closedir(adp);
+	}
+	closedir(dvb);
+
+	qsort(list, (size_t)n, sizeof(adapter_info), compare_info);
+	if (dirty || cached != ncache) {
+		save_cache(list, n);
+	}
+
+	return n;
+}
+
+/*
+ * lock frontend for this process. returns lock fd, -1 when another
+ * process holds the lock or the lock file cannot be opened, -2 when
+ * there is no lock directory.
+ */
+int adapter_lock(int dev_num, int fe_num)
+{
+	char path[PATH_BUFFER];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/recdvb-adapter%d.%d.lock", lock_dir(), dev_num, fe_num);
+	/* not following links, /tmp is shared with other users */
+	fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0666);
+	if (fd < 0 && errno == EACCES) {
+		/* created by another user, flock works on read-only fd too */
+		fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		if (errno == ENOENT || errno == EROFS) {
+			return -2;
+		}
+		fprintf(stderr, "Error: Cannot open lock file %s. (errno=%d)\n", path, errno);
+		return -1;
+	}
+	/* umask should not keep other users from locking */
+	fchmod(fd, 0666);
+
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+		int busy = errno == EWOULDBLOCK;
+		close(fd);
+		return busy ? -1 : -2;
+	}
+
+	return fd;
+}
+
+/* pick first free frontend of the delivery system, tuner keeps lock and frontend open */
+int adapter_claim(tuner *t, int isdbtype)
+{
+	static adapter_info list[ADAPTER_MAX];
+	int i, n;
+
+	n = adapter_list(list, ADAPTER_MAX);
+	for (i = 0; i < n; i++) {
+		char device[PATH_BUFFER];
+		int lockfd, fefd;
+
+		if (list[i].isdbtype != isdbtype) {
+			continue;
+		}
+
+		lockfd = adapter_lock(list[i].dev_num, list[i].fe_num);
+		if (lockfd == -1) {
+			continue;
+		}
+
+		/* may still be used by other programs */
+		snprintf(device, sizeof(device), DVB_DIR "/adapter%d/frontend%d", list[i].dev_num, list[i].fe_num);
+		fefd = open(device, O_RDWR | O_NONBLOCK);
+		if (fefd < 0) {
+			if (lockfd >= 0) {
+				close(lockfd);
+			}
+			continue;
+		}
+
+		t->dev_num = list[i].dev_num;
+		t->fe_num = list[i].fe_num;
+		t->fefd = fefd;
+		t->lockfd = lockfd >= 0 ? lockfd : -1;
+		t->isdbtype = isdbtype;
+		fprintf(stderr, "Info: DVB frontend = %s (auto)\n", device);
+		return 0;
+	}
+
+	fprintf(stderr, "Error: No free %s tuner found.\n", isdbtype == ISDBTYPE_ISDBT ? "ISDB-T" : "ISDB-S");
+	return -1;
+}
@@ -0,0 +1,46 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_ADAPTER_H
+#define RECDVB_ADAPTER_H
+
+#include <stdint.h>
+
+#include "tuner.h"
+
+/*
+ * inventory of /dev/dvb/adapterN/frontendM and claiming of a frontend.
+ * a claim is an exclusive flock on a per frontend lock file, so that
+ * concurrent recdvb processes never pick the same device. delivery
+ * systems are cached in a file next to the locks and only re-probed
+ * when a device node is recreated.
+ */
+#define ADAPTER_MAX 64
+#define ADAPTER_CACHE_NAME "recdvb-adapters.cache"
+
+typedef struct adapter_info {
+	int dev_num;
+	int fe_num;
+	int isdbtype;              /* -1 if not ISDB or probe failed */
+	uint64_t rdev;             /* device node identity, to detect replug */
+	int64_t ctime;
+} adapter_info;
+
+int adapter_list(adapter_info *list, int max);
+int adapter_lock(int dev_num, int fe_num);
+int adapter_claim(tuner *t, int isdbtype);
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "bufpool.h"
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BUFSZ *idle[BUFPOOL_MAX_IDLE];
+static int num_idle;
+static size_t num_out;             /* chunks handed out */
+static size_t max_out;             /* 0: no limit */
+
+/* limit number of chunks in use at once */
+void bufpool_init(size_t limit)
+{
+	pthread_mutex_lock(&pool_mutex);
+	max_out = limit;
+	pthread_mutex_unlock(&pool_mutex);
+}
+
+/* returns chunk with no flags set, or NULL when out of memory or budget */
+BUFSZ *bufpool_get(void)
+{
+	BUFSZ *buf = NULL;
+
+	pthread_mutex_lock(&pool_mutex);
+	if (max_out && num_out >= max_out) {
+		pthread_mutex_unlock(&pool_mutex);
+		return NULL;
+	}
+	num_out++;
+	if (num_idle > 0) {
+		buf = idle[--num_idle];
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	if (!buf) {
+		buf = malloc(sizeof(BUFSZ));
+		if (!buf) {
+			pthread_mutex_lock(&pool_mutex);
+			num_out--;
+			pthread_mutex_unlock(&pool_mutex);
+			return NULL;
+		}
+	}
+	buf->size = 0;
+	buf->flags = 0;
+	buf->refs = 1;
+
+	return buf;
+}
+
+/* one more holder of chunk */
+void bufpool_ref(BUFSZ *buf)
+{
+	__atomic_add_fetch(&buf->refs, 1, __ATOMIC_RELAXED);
+}
+
+void bufpool_put(BUFSZ *buf)
+{
+	if (!buf) {
+		return;
+	}
+	/* still held by others */
+	if (__atomic_sub_fetch(&buf->refs, 1, __ATOMIC_ACQ_REL) > 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	num_out--;
+	if (num_idle < BUFPOOL_MAX_IDLE) {
+		idle[num_idle++] = buf;
+		buf = NULL;
+	}
+	pthread_mutex_unlock(&pool_mutex);
+
+	free(buf);
+}
+
+void bufpool_destroy(void)
+{
+	pthread_mutex_lock(&pool_mutex);
+	while (num_idle > 0) {
+		free(idle[--num_idle]);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+}
@@ -0,0 +1,39 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_BUFPOOL_H
+#define RECDVB_BUFPOOL_H
+
+#include "queue.h"
+
+/*
+ * process wide pool of BUFSZ chunks shared by all tuners. released
+ * chunks are kept for reuse instead of going back to malloc on every
+ * dvr read. with a limit set, all tuners draw from one budget.
+ *
+ * a chunk handed to more than one consumer is referenced once per
+ * extra consumer, and every consumer puts it. data of a shared chunk
+ * must not be changed.
+ */
+#define BUFPOOL_MAX_IDLE 1024      /* about 16MB kept around at most */
+
+void bufpool_init(size_t limit);
+BUFSZ *bufpool_get(void);
+void bufpool_put(BUFSZ *buf);
+void bufpool_ref(BUFSZ *buf);
+void bufpool_destroy(void);
+
+#endif
@@ -0,0 +1,183 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "chdb.h"
+
+static uint32_t hash_name(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	for (; *name; name++) {
+		unsigned char c = (unsigned char)*name;
+		if (c >= 'A' && c <= 'Z') {
+			c = (unsigned char)(c - 'A' + 'a');
+		}
+		h ^= c;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+int chdb_open(chdb *db, const char *path)
+{
+	struct stat st;
+	const chdb_header *hdr;
+	int fd;
+
+	memset(db, 0, sizeof(*db));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(chdb_header)) {
+		close(fd);
+		return -1;
+	}
+
+	db->map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (db->map == MAP_FAILED) {
+		db->map = NULL;
+		return -1;
+	}
+	db->size = (size_t)st.st_size;
+
+	/* check layout fits in file */
+	hdr = db->map;
+	if (memcmp(hdr->magic, CHDB_MAGIC, 8) || hdr->version != CHDB_VERSION ||
+	    hdr->nslots == 0 || (hdr->nslots & (hdr->nslots - 1)) ||
+	    hdr->slot_off + (uint64_t)hdr->nslots * sizeof(uint32_t) > db->size ||
+	    hdr->entry_off + (uint64_t)hdr->nentries * sizeof(chdb_entry) > db->size ||
+	    hdr->service_off + (uint64_t)hdr->nservices * sizeof(chdb_service) > db->size) {
+		fprintf(stderr, "Error: Invalid channel database '%s'.\n", path);
+		chdb_close(db);
+		return -1;
+	}
+
+	db->hdr = hdr;
+	db->slots = (const uint32_t *)((const char *)db->map + hdr->slot_off);
+	db->entries = (const chdb_entry *)((const char *)db->map + hdr->entry_off);
+	db->services = (const chdb_service *)((const char *)db->map + hdr->service_off);
+
+	return 0;
+}
+
+const chdb_entry *chdb_lookup(const chdb *db, const char *name)
+{
+	uint32_t mask, i, n;
+
+	if (!db->hdr || strlen(name) >= CHDB_NAME_MAX) {
+		return NULL;
+	}
+
+	mask = db->hdr->nslots - 1;
+	for (i = hash_name(name) & mask, n = 0; n < db->hdr->nslots; i = (i + 1) & mask, n++) {
+		uint32_t slot = db->slots[i];
+		const chdb_entry *e;
+
+		if (slot == 0 || slot > db->hdr->nentries) {
+			return NULL;
+		}
+		e = &db->entries[slot - 1];
+		if (!strncasecmp(e->name, name, CHDB_NAME_MAX)) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+void chdb_close(chdb *db)
+{
+	if (db->map) {
+		munmap(db->map, db->size);
+	}
+	memset(db, 0, sizeof(*db));
+}
+
+/* write to temporary file and rename, running processes keep old mapping */
+int chdb_write(const char *path, const chdb_entry *entries, uint32_t nentries,
+	       const chdb_service *services, uint32_t nservices)
+{
+	chdb_header hdr;
+	uint32_t *slots;
+	uint32_t i, mask;
+	char tmp[4096];
+	FILE *fp;
+	int ok;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, CHDB_MAGIC, 8);
+	hdr.version = CHDB_VERSION;
+	hdr.nslots = 16;
+	while (hdr.nslots < nentries * 2) {
+		hdr.nslots <<= 1;
+	}
+	hdr.nentries = nentries;
+	hdr.nservices = nservices;
+	hdr.slot_off = sizeof(hdr);
+	hdr.entry_off = hdr.slot_off + hdr.nslots * (uint32_t)sizeof(uint32_t);
+	hdr.service_off = hdr.entry_off + nentries * (uint32_t)sizeof(chdb_entry);
+
+	slots = calloc(hdr.nslots, sizeof(uint32_t));
+	if (!slots) {
+		return -1;
+	}
+	mask = hdr.nslots - 1;
+	for (i = 0; i < nentries; i++) {
+		uint32_t h = hash_name(entries[i].name) & mask;
+		while (slots[h] != 0) {
+			h = (h + 1) & mask;
+		}
+		slots[h] = i + 1;
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error: Cannot create '%s'. (errno=%d)\n", tmp, errno);
+		free(slots);
+		return -1;
+	}
+	ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+	     fwrite(slots, sizeof(uint32_t), hdr.nslots, fp) == hdr.nslots &&
+	     fwrite(entries, sizeof(chdb_entry), nentries, fp) == nentries &&
+	     fwrite(services, sizeof(chdb_service), nservices, fp) == nservices;
+	free(slots);
+	if (fclose(fp) != 0) {
+		ok = 0;
+	}
+	if (!ok || rename(tmp, path) != 0) {
+		fprintf(stderr, "Error: Cannot write '%s'. (errno=%d)\n", path, errno);
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
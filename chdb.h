@@ -0,0 +1,82 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_CHDB_H
+#define RECDVB_CHDB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * channel database written by --scan and mapped at startup.
+ *
+ * file layout: header, hash slots, entries, services. slots hold
+ * entry index + 1 (0 is empty) and are probed linearly from the
+ * FNV-1a hash of the lower case channel name.
+ */
+#define CHDB_MAGIC "RECDVBCH"
+#define CHDB_VERSION 1
+#define CHDB_NAME_MAX 16
+#define CHDB_SERVICE_NAME_MAX 27
+#define CHDB_DEFAULT_PATH "/var/lib/recdvb/channels.db"
+
+typedef struct chdb_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nslots;           /* power of two */
+	uint32_t nentries;
+	uint32_t nservices;
+	uint32_t slot_off;
+	uint32_t entry_off;
+	uint32_t service_off;
+	uint32_t reserved;
+} chdb_header;
+
+typedef struct chdb_entry {
+	char name[CHDB_NAME_MAX];  /* "27", "bs15_0", "nd02" */
+	int32_t isdbtype;
+	uint32_t freq_khz;
+	uint32_t tsid;
+	uint32_t network_id;
+	uint32_t lock_ms;
+	int32_t cnr_x100;          /* dB * 100, INT32_MIN if unknown */
+	uint32_t service_first;
+	uint32_t service_count;
+} chdb_entry;
+
+typedef struct chdb_service {
+	uint16_t service_id;
+	uint8_t type;
+	uint8_t name_len;
+	uint8_t name[CHDB_SERVICE_NAME_MAX + 1]; /* raw ARIB string */
+} chdb_service;
+
+typedef struct chdb {
+	void *map;
+	size_t size;
+	const chdb_header *hdr;
+	const uint32_t *slots;
+	const chdb_entry *entries;
+	const chdb_service *services;
+} chdb;
+
+int chdb_open(chdb *db, const char *path);
+const chdb_entry *chdb_lookup(const chdb *db, const char *name);
+void chdb_close(chdb *db);
+int chdb_write(const char *path, const chdb_entry *entries, uint32_t nentries,
+	       const chdb_service *services, uint32_t nservices);
+
+#endif
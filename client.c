@@ -0,0 +1,260 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <libgen.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "daemon.h"
+
+#include "mkpath.h"
+
+#define NEVENTS 4
+#define REPLY_MAX 128
+
+static int connect_daemon(const char *path)
+{
+	int fd;
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: socket path too long '%s'.\n", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create socket. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: cannot connect to '%s'. (errno=%d)\n", path, errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* read reply line byte by byte so no stream data is consumed */
+static int read_reply(int fd, char *line, size_t len)
+{
+	size_t n = 0;
+
+	while (n < len - 1) {
+		ssize_t r = read(fd, &line[n], 1);
+		if (r <= 0) {
+			return -1;
+		}
+		if (line[n] == '\n') {
+			break;
+		}
+		n++;
+	}
+	line[n] = '\0';
+
+	return 0;
+}
+
+static int open_output(struct recdvb_options *opts)
+{
+	int wfd;
+	char *path;
+
+	if (opts->use_stdout) {
+		return 1; /* stdout */
+	}
+
+	path = strdup(opts->destfile);
+	if (mkpath(dirname(path), 0777) == -1) {
+		fprintf(stderr, "Error: Cannot create directory for '%s'.\n", opts->destfile);
+		free(path);
+		return -1;
+	}
+	free(path);
+
+	wfd = open(opts->destfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (wfd < 0) {
+		fprintf(stderr, "Error: Cannot open output file '%s'. (errno=%d)\n", opts->destfile, errno);
+	}
+	return wfd;
+}
+
+static int write_all(int fd, const uint8_t *data, ssize_t len)
+{
+	while (len > 0) {
+		ssize_t w = write(fd, data, (size_t)len);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += w;
+		len -= w;
+	}
+	return 0;
+}
+
+/* record from a running daemon instead of opening the tuner */
+int client_main(struct recdvb_options *opts)
+{
+	int i;
+	int rc = 1;
+	int f_exit = 0;
+	int cfd = -1, wfd = -1;
+	int epfd = -1, sfd = -1, tfd = -1;
+	int nfds;
+	uint64_t r_byte = 0;
+	char line[REPLY_MAX];
+	static uint8_t buf[65536];
+	struct epoll_event ev, evs[NEVENTS];
+	sigset_t mask;
+
+	cfd = connect_daemon(opts->connect_path);
+	if (cfd == -1) {
+		return 1;
+	}
+
+	if (opts->tsid) {
+		snprintf(line, sizeof(line), "record %s 0x%x\n", opts->channel, opts->tsid);
+	} else {
+		snprintf(line, sizeof(line), "record %s\n", opts->channel);
+	}
+	if (write_all(cfd, (uint8_t *)line, (ssize_t)strlen(line)) != 0 ||
+	    read_reply(cfd, line, sizeof(line)) != 0) {
+		fprintf(stderr, "Error: No reply from daemon.\n");
+		goto end;
+	}
+	if (strncmp(line, "OK", 2)) {
+		fprintf(stderr, "Error: Daemon refused request: %s\n", line);
+		goto end;
+	}
+	fprintf(stderr, "Info: Daemon accepted request: %s\n", line);
+
+	wfd = open_output(opts);
+	if (wfd == -1) {
+		goto end;
+	}
+
+	epfd = epoll_create(NEVENTS);
+	if (epfd == -1) {
+		fprintf(stderr, "Error: failed to call epoll_create. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	ev.data.fd = sfd;
+	ev.events = EPOLLIN;
+	if (sfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot create signalfd. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	if (opts->recsec != -1) {
+		struct itimerspec rectime = {{0, 0}, {opts->recsec, 0}};
+		tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+		ev.data.fd = tfd;
+		ev.events = EPOLLIN;
+		if (tfd == -1 || timerfd_settime(tfd, 0, &rectime, NULL) == -1 ||
+		    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1) {
+			fprintf(stderr, "Error: cannot create timerfd. (errno=%d)\n", errno);
+			goto end;
+		}
+	}
+
+	ev.data.fd = cfd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev) == -1) {
+		fprintf(stderr, "Error: failed to call epoll_ctl. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	rc = 0;
+	while (!f_exit) {
+		nfds = epoll_wait(epfd, evs, NEVENTS, -1);
+		if (nfds < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: epoll_wait failed. (errno=%d)\n", errno);
+			rc = 1;
+			break;
+		}
+
+		for (i = 0; i < nfds; ++i) {
+			if (evs[i].data.fd == sfd) {
+				fprintf(stderr, "\nInfo: Catch signal.\n");
+				f_exit = 1;
+			} else if (evs[i].data.fd == tfd) {
+				f_exit = 1;
+			} else if (evs[i].data.fd == cfd) {
+				ssize_t size = read(cfd, buf, sizeof(buf));
+				if (size <= 0) {
+					fprintf(stderr, "Info: Daemon closed stream.\n");
+					f_exit = 1;
+				} else if (write_all(wfd, buf, size) != 0) {
+					fprintf(stderr, "Error: Write failed. (errno=%d)\n", errno);
+					rc = 1;
+					f_exit = 1;
+				} else {
+					r_byte += (uint64_t)size;
+				}
+			}
+		}
+	}
+
+	fprintf(stderr, "Info: Received %lubyte\n", (unsigned long)r_byte);
+
+end:
+	if (cfd != -1) {
+		close(cfd);
+	}
+	if (wfd > 1) {
+		close(wfd);
+	}
+	if (tfd != -1) {
+		close(tfd);
+	}
+	if (sfd != -1) {
+		close(sfd);
+	}
+	if (epfd != -1) {
+		close(epfd);
+	}
+
+	return rc;
+}
@@ -0,0 +1,225 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "control.h"
+#include "sock.h"
+
+void control_init(control *c)
+{
+	int i;
+
+	c->path = NULL;
+	c->lfd = -1;
+	c->epfd = -1;
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		c->client[i].fd = -1;
+		c->client[i].len = 0;
+	}
+}
+
+int control_open(control *c, const char *path, int epfd)
+{
+	struct epoll_event ev;
+
+	c->lfd = sock_listen_unix(path);
+	if (c->lfd == -1) {
+		return -1;
+	}
+	c->path = path;
+	c->epfd = epfd;
+
+	/* add epoll event source: control */
+	ev.data.fd = c->lfd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->lfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot add source control fd to epoll. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+int control_owns(const control *c, int fd)
+{
+	int i;
+
+	if (fd == -1) {
+		return 0;
+	}
+	if (fd == c->lfd) {
+		return 1;
+	}
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (c->client[i].fd == fd) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void drop_client(control *c, int id)
+{
+	epoll_ctl(c->epfd, EPOLL_CTL_DEL, c->client[id].fd, NULL);
+	close(c->client[id].fd);
+	c->client[id].fd = -1;
+	c->client[id].len = 0;
+}
+
+static void accept_clients(control *c)
+{
+	int fd;
+	int i;
+	struct epoll_event ev;
+
+	while ((fd = accept4(c->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+			if (c->client[i].fd == -1) {
+				break;
+			}
+		}
+		if (i == CONTROL_MAX_CLIENTS) {
+			send(fd, "ERR busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT);
+			close(fd);
+			continue;
+		}
+
+		ev.data.fd = fd;
+		ev.events = EPOLLIN;
+		if (epoll_ctl(c->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+			close(fd);
+			continue;
+		}
+		c->client[i].fd = fd;
+		c->client[i].len = 0;
+	}
+}
+
+/*
+ * handle event on control fd.
+ * returns client id and set line when a command line is complete,
+ * otherwise -1. client stays connected until control_reply().
+ */
+int control_handle(control *c, int fd, char **line)
+{
+	int i;
+	ssize_t n;
+	control_client *cl;
+	char *nl;
+
+	if (fd == c->lfd) {
+		accept_clients(c);
+		return -1;
+	}
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (c->client[i].fd == fd) {
+			break;
+		}
+	}
+	if (i == CONTROL_MAX_CLIENTS) {
+		return -1;
+	}
+	cl = &c->client[i];
+
+	n = read(fd, cl->line + cl->len, sizeof(cl->line) - 1 - cl->len);
+	if (n <= 0) {
+		if (n == -1 && errno == EAGAIN) {
+			return -1;
+		}
+		drop_client(c, i);
+		return -1;
+	}
+	cl->len += (size_t)n;
+	cl->line[cl->len] = '\0';
+
+	nl = strchr(cl->line, '\n');
+	if (!nl) {
+		if (cl->len == sizeof(cl->line) - 1) {
+			control_reply(c, i, "ERR line too long\n");
+		}
+		return -1;
+	}
+	*nl = '\0';
+	if (nl > cl->line && nl[-1] == '\r') {
+		nl[-1] = '\0';
+	}
+
+	/* ignore further input while command is executed */
+	epoll_ctl(c->epfd, EPOLL_CTL_DEL, fd, NULL);
+
+	*line = cl->line;
+	return i;
+}
+
+/* send reply and disconnect */
+void control_reply(control *c, int id, const char *fmt, ...)
+{
+	char buf[CONTROL_LINE_MAX * 4];
+	va_list ap;
+	int n;
+
+	if (id < 0 || id >= CONTROL_MAX_CLIENTS || c->client[id].fd == -1) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+
+	if (n > 0) {
+		if (n >= (int)sizeof(buf)) {
+			n = sizeof(buf) - 1;
+		}
+		send(c->client[id].fd, buf, (size_t)n, MSG_NOSIGNAL | MSG_DONTWAIT);
+	}
+	drop_client(c, id);
+}
+
+/* hand client connection over to caller, returns fd */
+int control_detach(control *c, int id)
+{
+	int fd = c->client[id].fd;
+
+	c->client[id].fd = -1;
+	c->client[id].len = 0;
+	return fd;
+}
+
+void control_close(control *c)
+{
+	int i;
+
+	for (i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+		if (c->client[i].fd != -1) {
+			close(c->client[i].fd);
+			c->client[i].fd = -1;
+		}
+	}
+	if (c->path) {
+		sock_close_unix(c->lfd, c->path);
+		c->lfd = -1;
+	}
+}
@@ -0,0 +1,47 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_CONTROL_H
+#define RECDVB_CONTROL_H
+
+#include <stddef.h>
+
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE_MAX    256
+
+/* line based command socket, one command per connection */
+typedef struct control_client {
+	int fd;
+	size_t len;
+	char line[CONTROL_LINE_MAX];
+} control_client;
+
+typedef struct control {
+	const char *path;
+	int lfd;
+	int epfd;
+	control_client client[CONTROL_MAX_CLIENTS];
+} control;
+
+void control_init(control *c);
+int control_open(control *c, const char *path, int epfd);
+int control_owns(const control *c, int fd);
+int control_handle(control *c, int fd, char **line);
+void control_reply(control *c, int id, const char *fmt, ...);
+int control_detach(control *c, int id);
+void control_close(control *c);
+
+#endif
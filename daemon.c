@@ -0,0 +1,415 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "daemon.h"
+
+#include "recdvbcore.h"
+#include "tuner.h"
+#include "adapter.h"
+#include "control.h"
+#include "fanout.h"
+#include "decoder.h"
+#include "preset.h"
+#include "queue.h"
+#include "psi.h"
+
+#define NEVENTS 64
+#define TUNE_TIMEOUT 5
+#define CHANNEL_MAX 32
+
+typedef struct session {
+	tuner tuner;
+	int watched;               /* tuner fds are in epoll */
+	int wait_count;            /* seconds waiting for lock */
+	char channel[CHANNEL_MAX];
+	fanout out;
+	psi_cache psi;             /* replayed to attaching client */
+#ifdef HAVE_LIBARIB25
+	decoder *dec;
+#endif
+} session;
+
+static session sessions[DAEMON_MAX_TUNERS];
+static int num_sessions;
+
+/* open every listed adapter and keep it warm */
+static int open_sessions(struct recdvb_options *opts, int epfd)
+{
+	char *list = strdup(opts->devices ? opts->devices : "0");
+	char *tok, *save = NULL;
+
+	/* every ISDB frontend in the system */
+	if (!strcmp(list, "auto")) {
+		static adapter_info inv[ADAPTER_MAX];
+		int i, n = adapter_list(inv, ADAPTER_MAX);
+		size_t len = 0;
+
+		free(list);
+		list = calloc(ADAPTER_MAX, 16);
+		for (i = 0; i < n && list; i++) {
+			if (inv[i].isdbtype != -1) {
+				len += (size_t)sprintf(list + len, "%s%d.%d", len ? "," : "", inv[i].dev_num, inv[i].fe_num);
+			}
+		}
+		if (!list) {
+			return -1;
+		}
+	}
+
+	for (tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		session *s;
+		int dev, fe;
+		const char *end = parse_device(tok, &dev, &fe);
+
+		if (!end || *end != '\0' || num_sessions == DAEMON_MAX_TUNERS) {
+			fprintf(stderr, "Error: Invalid device list '%s'.\n", opts->devices);
+			free(list);
+			return -1;
+		}
+
+		s = &sessions[num_sessions];
+		tuner_init(&s->tuner, dev, fe);
+		s->tuner.lnb = opts->lnb;
+		s->watched = 0;
+		s->wait_count = 0;
+		s->channel[0] = '\0';
+		fanout_init(&s->out, epfd);
+		psi_init(&s->psi);
+		if (tuner_open(&s->tuner) != 0) {
+			fprintf(stderr, "Error: Cannot open device %d, skipped.\n", dev);
+			tuner_close(&s->tuner);
+			continue;
+		}
+#ifdef HAVE_LIBARIB25
+		s->dec = NULL;
+		if (opts->b25) {
+			decoder_options dopt = {
+				opts->round,
+				opts->strip ? 1 : 0,
+				opts->emm ? 1 : 0
+			};
+			s->dec = b25_startup(&dopt);
+			if (s->dec == NULL) {
+				fprintf(stderr, "Error: Cannot start b25 decoder for device %d.\n", dev);
+			}
+		}
+#endif
+		num_sessions++;
+	}
+	free(list);
+
+	if (num_sessions == 0) {
+		fprintf(stderr, "Error: No tuner is available.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static session *find_session(const char *channel, unsigned int tsid)
+{
+	int i;
+	int type = channel_isdbtype(channel);
+
+	/* share tuner already on the channel */
+	for (i = 0; i < num_sessions; i++) {
+		session *s = &sessions[i];
+		if (s->tuner.state != TUNER_IDLE && !strcmp(s->channel, channel) && s->tuner.tsid == tsid) {
+			return s;
+		}
+	}
+
+	/* otherwise take an idle tuner of the right type */
+	for (i = 0; i < num_sessions; i++) {
+		session *s = &sessions[i];
+		if (s->tuner.state == TUNER_IDLE && s->tuner.isdbtype == type) {
+			return s;
+		}
+	}
+
+	return NULL;
+}
+
+static void stop_session(session *s)
+{
+	fanout_close(&s->out);
+	tuner_stop(&s->tuner);
+#ifdef HAVE_LIBARIB25
+	if (s->dec) {
+		b25_reset(s->dec);
+	}
+#endif
+	fprintf(stderr, "Info: Device %d released.\n", s->tuner.dev_num);
+}
+
+static void handle_request(control *ctl, int id, char *line, int epfd)
+{
+	char cmd[16] = {0};
+	char channel[CHANNEL_MAX] = {0};
+	char tsidstr[16] = {0};
+	char reply[32];
+	unsigned int tsid = 0;
+	char *endptr = NULL;
+	session *s;
+	int fd;
+	int n;
+
+	n = sscanf(line, "%15s %31s %15s", cmd, channel, tsidstr);
+	if (n < 2 || strcmp(cmd, "record")) {
+		control_reply(ctl, id, "ERR unknown command\n");
+		return;
+	}
+	if (n == 3) {
+		tsid = (unsigned int)strtoul(tsidstr, &endptr, 0);
+		if (*endptr != '\0') {
+			control_reply(ctl, id, "ERR invalid tsid\n");
+			return;
+		}
+	} else {
+		set_bs_tsid(channel, &tsid);
+	}
+
+	s = find_session(channel, tsid);
+	if (!s) {
+		control_reply(ctl, id, "ERR no tuner available\n");
+		return;
+	}
+
+	if (s->tuner.state == TUNER_IDLE) {
+		snprintf(s->channel, sizeof(s->channel), "%s", channel);
+		psi_init(&s->psi);
+		if (tuner_start(&s->tuner, s->channel, tsid, s->tuner.lnb) != 0) {
+			control_reply(ctl, id, "ERR tune failed\n");
+			tuner_stop(&s->tuner);
+			return;
+		}
+		if (!s->watched) {
+			if (tuner_watch(&s->tuner, epfd) != 0) {
+				control_reply(ctl, id, "ERR internal error\n");
+				tuner_stop(&s->tuner);
+				return;
+			}
+			s->watched = 1;
+		}
+		s->wait_count = 0;
+		fprintf(stderr, "Info: Device %d tuning to %s.\n", s->tuner.dev_num, s->channel);
+	}
+
+	/* rest of connection carries stream */
+	fd = control_detach(ctl, id);
+	n = snprintf(reply, sizeof(reply), "OK dev=%d\n", s->tuner.dev_num);
+	if (write(fd, reply, (size_t)n) != n || fanout_add(&s->out, fd) != 0) {
+		close(fd);
+		if (s->out.count == 0) {
+			stop_session(s);
+		}
+		return;
+	}
+
+	/* client can start decoding before next PAT/PMT */
+	if (psi_ready(&s->psi)) {
+		static uint8_t pkts[PSI_PACKETS_SIZE];
+
+		fanout_prime(&s->out, fd, pkts, psi_packets(&s->psi, pkts, sizeof(pkts)));
+	}
+}
+
+static void read_session(session *s)
+{
+	static uint8_t buf[MAX_READ_SIZE];
+	ssize_t size;
+	ARIB_STD_B25_BUFFER sbuf, dbuf;
+
+	size = read(s->tuner.dvrfd, buf, sizeof(buf));
+	if (size <= 0 || s->tuner.state == TUNER_TUNING) {
+		return;
+	}
+
+	psi_feed(&s->psi, buf, (size_t)size);
+
+	sbuf.data = buf;
+	sbuf.size = (int32_t)size;
+	dbuf = sbuf;
+#ifdef HAVE_LIBARIB25
+	if (s->dec && b25_decode(s->dec, &sbuf, &dbuf) < 0) {
+		dbuf = sbuf;
+	}
+#endif
+
+	if (dbuf.size > 0) {
+		fanout_write(&s->out, dbuf.data, (size_t)dbuf.size);
+	}
+	if (s->out.count == 0) {
+		stop_session(s);
+	}
+}
+
+int daemon_main(struct recdvb_options *opts)
+{
+	int i, j;
+	int rc = 1;
+	int f_exit = 0;
+	int epfd = -1;
+	int sfd = -1;
+	int tfd = -1;
+	int nfds;
+	struct epoll_event ev, evs[NEVENTS];
+	struct itimerspec interval = {{1, 0}, {1, 0}};
+	sigset_t mask;
+	static control ctl;
+
+	control_init(&ctl);
+
+	epfd = epoll_create(NEVENTS);
+	if (epfd == -1) {
+		fprintf(stderr, "Error: failed to call epoll_create. (errno=%d)\n", errno);
+		return 1;
+	}
+
+	/* signals */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	ev.data.fd = sfd;
+	ev.events = EPOLLIN;
+	if (sfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot create signalfd. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	/* one second timer for tune timeout */
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	ev.data.fd = tfd;
+	ev.events = EPOLLIN;
+	if (tfd == -1 || timerfd_settime(tfd, 0, &interval, NULL) == -1 ||
+	    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot create timerfd. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	if (open_sessions(opts, epfd) != 0) {
+		goto end;
+	}
+
+	if (control_open(&ctl, opts->daemon_path, epfd) != 0) {
+		goto end;
+	}
+	fprintf(stderr, "Info: Daemon ready on %s with %d tuner(s).\n", opts->daemon_path, num_sessions);
+
+	rc = 0;
+	while (!f_exit) {
+		nfds = epoll_wait(epfd, evs, NEVENTS, -1);
+		if (nfds < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: epoll_wait failed. (errno=%d)\n", errno);
+			rc = 1;
+			break;
+		}
+
+		for (i = 0; i < nfds; ++i) {
+			int fd = evs[i].data.fd;
+
+			if (fd == sfd) {
+				struct signalfd_siginfo info;
+				read(sfd, &info, sizeof(info));
+				fprintf(stderr, "\nInfo: Catch signal.\n");
+				f_exit = 1;
+				break;
+			}
+
+			if (fd == tfd) {
+				uint64_t exp;
+				read(tfd, &exp, sizeof(exp));
+				for (j = 0; j < num_sessions; j++) {
+					session *s = &sessions[j];
+					if (s->tuner.state == TUNER_TUNING && ++s->wait_count >= TUNE_TIMEOUT) {
+						fprintf(stderr, "Error: Tune timeout on device %d.\n", s->tuner.dev_num);
+						stop_session(s);
+					}
+				}
+				continue;
+			}
+
+			if (control_owns(&ctl, fd)) {
+				char *line;
+				int id = control_handle(&ctl, fd, &line);
+				if (id != -1) {
+					handle_request(&ctl, id, line, epfd);
+				}
+				continue;
+			}
+
+			for (j = 0; j < num_sessions; j++) {
+				session *s = &sessions[j];
+
+				if (fd == s->tuner.dvrfd) {
+					read_session(s);
+				} else if (fd == s->tuner.fefd || fd == s->tuner.pollfd) {
+					if (tuner_handle(&s->tuner, fd) == -1) {
+						stop_session(s);
+					}
+				} else if (fanout_owns(&s->out, fd)) {
+					fanout_handle(&s->out, fd, evs[i].events);
+					if (s->out.count == 0 && s->tuner.state != TUNER_IDLE) {
+						stop_session(s);
+					}
+				} else {
+					continue;
+				}
+				break;
+			}
+		}
+	}
+
+end:
+	control_close(&ctl);
+	for (i = 0; i < num_sessions; i++) {
+		fanout_close(&sessions[i].out);
+		tuner_close(&sessions[i].tuner);
+#ifdef HAVE_LIBARIB25
+		if (sessions[i].dec) {
+			b25_shutdown(sessions[i].dec);
+		}
+#endif
+	}
+	if (tfd != -1) {
+		close(tfd);
+	}
+	if (sfd != -1) {
+		close(sfd);
+	}
+	if (epfd != -1) {
+		close(epfd);
+	}
+
+	return rc;
+}
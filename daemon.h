@@ -0,0 +1,37 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_DAEMON_H
+#define RECDVB_DAEMON_H
+
+#include "recdvb.h"
+
+/*
+ * tuner daemon keeps frontends and decoders open and serves recordings
+ * to local clients over a unix stream socket:
+ *
+ *   client: "record CHANNEL [TSID]\n"
+ *   daemon: "OK dev=N\n" followed by TS until either side closes,
+ *           or "ERR reason\n"
+ *
+ * clients requesting the same channel share one tuner.
+ */
+#define DAEMON_MAX_TUNERS 16
+
+int daemon_main(struct recdvb_options *opts);
+int client_main(struct recdvb_options *opts);
+
+#endif
@@ -18,6 +18,7 @@
 #include <stdio.h>
 
 #include "decoder.h"
+#include "probe.h"
 
 #ifdef HAVE_LIBARIB25
 
@@ -90,6 +91,8 @@ int b25_decode(decoder *dec, ARIB_STD_B25_BUFFER *sbuf, ARIB_STD_B25_BUFFER *dbu
 {
 	int code;
 
+	PROBE1(b25_decode_entry, sbuf->size);
+
 	code = dec->b25->put(dec->b25, sbuf);
 	if (code < 0) {
 		fprintf(stderr, "Error: b25->put failed\n");
@@ -102,6 +105,8 @@ int b25_decode(decoder *dec, ARIB_STD_B25_BUFFER *sbuf, ARIB_STD_B25_BUFFER *dbu
 		return code;
 	}
 
+	PROBE3(b25_decode_exit, sbuf->size, dbuf->size, code);
+
 	return code;
 }
 
@@ -124,5 +129,18 @@ int b25_finish(decoder *dec, ARIB_STD_B25_BUFFER *dbuf)
 	return code;
 }
 
+/* forget stream state, keeps card and options */
+int b25_reset(decoder *dec)
+{
+	int code;
+
+	code = dec->b25->reset(dec->b25);
+	if (code < 0) {
+		fprintf(stderr, "Error: b25->reset failed\n");
+	}
+
+	return code;
+}
+
 #endif
 
@@ -48,6 +48,7 @@ int b25_decode(decoder *dec,
 		ARIB_STD_B25_BUFFER *dbuf);
 int b25_finish(decoder *dec,
 		ARIB_STD_B25_BUFFER *dbuf);
+int b25_reset(decoder *dec);
 
 #else
 
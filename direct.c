@@ -0,0 +1,189 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "direct.h"
+
+int direct_init(direct_writer *d)
+{
+	d->fd = -1;
+	d->enabled = 0;
+	d->rejected = 0;
+	d->len = 0;
+	if (posix_memalign((void **)&d->buf, DIRECT_ALIGN, DIRECT_BUFFER_SIZE) != 0) {
+		d->buf = NULL;
+		fprintf(stderr, "Error: Cannot allocate direct I/O buffer.\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static int set_direct(int fd, int on)
+{
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags == -1) {
+		return -1;
+	}
+	flags = on ? flags | O_DIRECT : flags & ~O_DIRECT;
+
+	return fcntl(fd, F_SETFL, flags);
+}
+
+/* write through page cache from now on */
+static void fall_back(direct_writer *d, int err)
+{
+	if (d->enabled) {
+		fprintf(stderr, "Info: Direct I/O is not supported (errno=%d), fall back to buffered write.\n", err);
+	}
+	set_direct(d->fd, 0);
+	d->enabled = 0;
+	d->rejected = 1;
+}
+
+/* write buffered data to fd as is. returns -1 on error. */
+static int write_all(int fd, const uint8_t *data, size_t len)
+{
+	while (len > 0) {
+		ssize_t wc = write(fd, data, len);
+
+		if (wc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += wc;
+		len -= (size_t)wc;
+	}
+
+	return 0;
+}
+
+/* write aligned head of staging buffer, keep the rest */
+static int flush_aligned(direct_writer *d)
+{
+	size_t n = d->len & ~(size_t)(DIRECT_ALIGN - 1);
+
+	if (n == 0) {
+		return 0;
+	}
+	if (write_all(d->fd, d->buf, n) != 0) {
+		if (errno != EINVAL || !d->enabled) {
+			return -1;
+		}
+		/* filesystem accepted flag but not the write */
+		fall_back(d, errno);
+		if (write_all(d->fd, d->buf, n) != 0) {
+			return -1;
+		}
+	}
+	memmove(d->buf, d->buf + n, d->len - n);
+	d->len -= n;
+
+	return 0;
+}
+
+/* switch output to fd, which must be at an aligned offset */
+int direct_attach(direct_writer *d, int fd)
+{
+	d->fd = fd;
+	d->len = 0;
+	if (d->rejected) {
+		return -1;
+	}
+	if (set_direct(fd, 1) != 0) {
+		fprintf(stderr, "Info: Direct I/O is not supported (errno=%d), fall back to buffered write.\n", errno);
+		d->enabled = 0;
+		d->rejected = 1;
+		return -1;
+	}
+	d->enabled = 1;
+
+	return 0;
+}
+
+/* buffer data, write in DIRECT_BUFFER_SIZE blocks. returns len or -1. */
+ssize_t direct_write(direct_writer *d, const uint8_t *data, size_t len)
+{
+	size_t done = 0;
+
+	if (!d->enabled) {
+		return write_all(d->fd, data, len) == 0 ? (ssize_t)len : -1;
+	}
+
+	while (done < len) {
+		size_t n = DIRECT_BUFFER_SIZE - d->len;
+
+		if (n > len - done) {
+			n = len - done;
+		}
+		memcpy(d->buf + d->len, data + done, n);
+		d->len += n;
+		done += n;
+
+		if (d->len == DIRECT_BUFFER_SIZE && flush_aligned(d) != 0) {
+			return -1;
+		}
+		if (!d->enabled) {
+			/* fell back, rest goes through page cache */
+			if (write_all(d->fd, d->buf, d->len) != 0) {
+				return -1;
+			}
+			d->len = 0;
+			return write_all(d->fd, data + done, len - done) == 0 ? (ssize_t)len : -1;
+		}
+	}
+
+	return (ssize_t)len;
+}
+
+/* write everything. unaligned tail is written without O_DIRECT. */
+int direct_finish(direct_writer *d)
+{
+	int rc = 0;
+
+	if (d->fd == -1) {
+		return 0;
+	}
+	if (d->enabled) {
+		rc = flush_aligned(d);
+		if (rc == 0 && d->len > 0) {
+			set_direct(d->fd, 0);
+			rc = write_all(d->fd, d->buf, d->len);
+		}
+	} else if (d->len > 0) {
+		rc = write_all(d->fd, d->buf, d->len);
+	}
+	d->len = 0;
+	d->fd = -1;
+
+	return rc;
+}
+
+void direct_destroy(direct_writer *d)
+{
+	free(d->buf);
+	d->buf = NULL;
+}
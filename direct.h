@@ -0,0 +1,42 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_DIRECT_H
+#define RECDVB_DIRECT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define DIRECT_ALIGN       4096              /* covers logical block of common disks */
+#define DIRECT_BUFFER_SIZE (2 * 1024 * 1024) /* multiple of DIRECT_ALIGN */
+
+/* O_DIRECT output through an aligned staging buffer */
+typedef struct direct_writer {
+	int fd;
+	int enabled;               /* 0 when filesystem rejected O_DIRECT */
+	int rejected;              /* do not try again on next file */
+	uint8_t *buf;
+	size_t len;
+} direct_writer;
+
+int direct_init(direct_writer *d);
+int direct_attach(direct_writer *d, int fd);
+ssize_t direct_write(direct_writer *d, const uint8_t *data, size_t len);
+int direct_finish(direct_writer *d);
+void direct_destroy(direct_writer *d);
+
+#endif
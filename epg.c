@@ -0,0 +1,500 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "epg.h"
+
+#include "recdvbcore.h"
+#include "adapter.h"
+#include "preset.h"
+#include "chdb.h"
+#include "trace.h"
+
+#define SECTION_MAX 4096
+#define CHANNEL_MAX 32
+
+/* SI PIDs and tables programmed into the demux */
+static const struct {
+	uint16_t pid;
+	uint8_t table_id;
+	uint8_t mask;
+} si_filters[] = {
+	{ 0x0010, 0x40, 0xfe },    /* NIT actual/other */
+	{ 0x0011, 0x42, 0xfb },    /* SDT actual/other */
+	{ 0x0012, 0x40, 0xc0 },    /* EIT */
+	{ 0x0026, 0x40, 0xc0 },    /* EIT (L-EIT) */
+	{ 0x0027, 0x40, 0xc0 },    /* EIT (M/H-EIT) */
+};
+#define NUM_FILTERS (sizeof(si_filters) / sizeof(si_filters[0]))
+
+/* one sub table, identified by pid, table id and extensions */
+typedef struct epg_table {
+	uint8_t used;
+	uint8_t table_id;
+	uint8_t version;           /* 0xff until a section is seen */
+	uint16_t pid;
+	uint16_t id_ext;           /* service id for EIT, tsid for SDT, network id for NIT */
+	uint16_t tsid;             /* EIT only */
+	uint16_t onid;             /* EIT only */
+	uint8_t seen[32];
+	uint8_t expect[32];
+} epg_table;
+
+typedef struct epg_channel {
+	char name[CHANNEL_MAX];
+	int isdbtype;
+} epg_channel;
+
+typedef struct epg_worker {
+	pthread_t thread;
+	int dev_num;
+	int fe_num;
+	int isdbtype;
+	int lockfd;
+	int fefd;
+	int dmxfd[NUM_FILTERS];
+	int lnb;
+	int done;
+	epg_table tables[EPG_MAX_TABLES];
+	int ntables;
+	int incomplete;
+	uint8_t *out;              /* records of current channel */
+	size_t out_len;
+	size_t out_size;
+} epg_worker;
+
+static pthread_mutex_t epg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static epg_channel *channel_list;
+static int num_channels;
+static int next_channel[2];
+static FILE *epg_fp;
+static uint64_t total_sections;
+static uint64_t total_bytes;
+
+static epg_channel *take_channel(int isdbtype)
+{
+	epg_channel *ch = NULL;
+
+	pthread_mutex_lock(&epg_mutex);
+	while (next_channel[isdbtype] < num_channels) {
+		epg_channel *c = &channel_list[next_channel[isdbtype]++];
+		if (c->isdbtype == isdbtype) {
+			ch = c;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&epg_mutex);
+
+	return ch;
+}
+
+static int table_complete(const epg_table *t)
+{
+	int i;
+
+	for (i = 0; i < 32; i++) {
+		if ((t->seen[i] & t->expect[i]) != t->expect[i]) {
+			return 0;
+		}
+	}
+	return t->version != 0xff;
+}
+
+static uint32_t table_hash(uint16_t pid, uint8_t table_id, uint16_t id_ext, uint16_t tsid, uint16_t onid)
+{
+	uint32_t h = ((uint32_t)pid * 31 + table_id) * 65599u;
+
+	h ^= ((uint32_t)id_ext << 16) | tsid;
+	h *= 2654435761u;
+	h ^= onid;
+	return h & (EPG_MAX_TABLES - 1);
+}
+
+/* find or create sub table, NULL when table is full */
+static epg_table *lookup_table(epg_worker *w, uint16_t pid, uint8_t table_id, uint16_t id_ext, uint16_t tsid, uint16_t onid)
+{
+	uint32_t i = table_hash(pid, table_id, id_ext, tsid, onid);
+	int n;
+
+	for (n = 0; n < EPG_MAX_TABLES; n++, i = (i + 1) & (EPG_MAX_TABLES - 1)) {
+		epg_table *t = &w->tables[i];
+
+		if (!t->used) {
+			/* keep some room so probing terminates quickly */
+			if (w->ntables >= EPG_MAX_TABLES * 3 / 4) {
+				return NULL;
+			}
+			memset(t, 0, sizeof(*t));
+			t->used = 1;
+			t->pid = pid;
+			t->table_id = table_id;
+			t->id_ext = id_ext;
+			t->tsid = tsid;
+			t->onid = onid;
+			t->version = 0xff;
+			t->expect[0] = 0x01;
+			w->ntables++;
+			w->incomplete++;
+			return t;
+		}
+		if (t->pid == pid && t->table_id == table_id && t->id_ext == id_ext &&
+		    t->tsid == tsid && t->onid == onid) {
+			return t;
+		}
+	}
+	return NULL;
+}
+
+static void append(epg_worker *w, uint16_t pid, const uint8_t *sec, int len)
+{
+	epg_record rec;
+
+	if (w->out_len + sizeof(rec) + (size_t)len > w->out_size) {
+		size_t size = w->out_size ? w->out_size * 2 : 1024 * 1024;
+		uint8_t *p;
+
+		while (size < w->out_len + sizeof(rec) + (size_t)len) {
+			size *= 2;
+		}
+		p = realloc(w->out, size);
+		if (!p) {
+			return;
+		}
+		w->out = p;
+		w->out_size = size;
+	}
+
+	rec.pid = pid;
+	rec.len = (uint16_t)len;
+	memcpy(w->out + w->out_len, &rec, sizeof(rec));
+	memcpy(w->out + w->out_len + sizeof(rec), sec, (size_t)len);
+	w->out_len += sizeof(rec) + (size_t)len;
+}
+
+/* account one section, returns 1 if a new table appeared */
+static int handle_section(epg_worker *w, uint16_t pid, const uint8_t *sec, int len)
+{
+	uint8_t table_id = sec[0];
+	uint16_t id_ext = (uint16_t)((sec[3] << 8) | sec[4]);
+	uint8_t version = (sec[5] >> 1) & 0x1f;
+	uint8_t number = sec[6];
+	uint8_t last = sec[7];
+	uint16_t tsid = 0, onid = 0;
+	int is_eit = table_id >= 0x4e && table_id <= 0x6f;
+	int ntables = w->ntables;
+	epg_table *t;
+	int was_complete;
+	int i;
+
+	/* current/next indicator */
+	if (!(sec[5] & 0x01)) {
+		return 0;
+	}
+	if (is_eit) {
+		if (len < 14) {
+			return 0;
+		}
+		tsid = (uint16_t)((sec[8] << 8) | sec[9]);
+		onid = (uint16_t)((sec[10] << 8) | sec[11]);
+	} else if (pid > 0x11) {
+		return 0;
+	}
+
+	t = lookup_table(w, pid, table_id, id_ext, tsid, onid);
+	if (!t) {
+		return 0;
+	}
+	was_complete = table_complete(t);
+
+	/* new version invalidates collected sections */
+	if (t->version != version) {
+		memset(t->seen, 0, sizeof(t->seen));
+		memset(t->expect, 0, sizeof(t->expect));
+		t->version = version;
+		if (is_eit && table_id >= 0x50) {
+			/* first section of each segment exists even when empty */
+			for (i = 0; i <= last; i += 8) {
+				t->expect[i >> 3] |= 0x01;
+			}
+		} else {
+			for (i = 0; i <= last; i++) {
+				t->expect[i >> 3] |= (uint8_t)(1 << (i & 7));
+			}
+		}
+	}
+
+	if (is_eit && table_id >= 0x50) {
+		/* sections up to segment_last_section_number are sent */
+		uint8_t seg_last = sec[12];
+		uint8_t last_table_id = sec[13];
+		uint8_t base = table_id & 0xf8;   /* basic/extended block of actual/other */
+
+		for (i = number & 0xf8; i <= seg_last && i <= last; i++) {
+			t->expect[i >> 3] |= (uint8_t)(1 << (i & 7));
+		}
+
+		/* other tables of the service are expected too */
+		for (i = base; i <= last_table_id && i < base + 8; i++) {
+			lookup_table(w, pid, (uint8_t)i, id_ext, tsid, onid);
+		}
+	}
+
+	/* write each section once */
+	if (!(t->seen[number >> 3] & (1 << (number & 7)))) {
+		t->seen[number >> 3] |= (uint8_t)(1 << (number & 7));
+		append(w, pid, sec, len);
+	}
+
+	if (!was_complete && table_complete(t)) {
+		w->incomplete--;
+	} else if (was_complete && !table_complete(t)) {
+		w->incomplete++;
+	}
+
+	return w->ntables != ntables;
+}
+
+static void flush_channel(epg_worker *w, const epg_channel *ch, int nsec, uint64_t ms, int complete)
+{
+	pthread_mutex_lock(&epg_mutex);
+	if (w->out_len > 0 && fwrite(w->out, w->out_len, 1, epg_fp) != 1) {
+		fprintf(stderr, "Error: Write EPG failed. (errno=%d)\n", errno);
+	}
+	total_sections += (uint64_t)nsec;
+	total_bytes += w->out_len;
+	pthread_mutex_unlock(&epg_mutex);
+
+	fprintf(stderr, "Info: [%d.%d %s] %d tables, %d sections, %lubyte in %.1lfsec%s\n",
+		w->dev_num, w->fe_num, ch->name, w->ntables, nsec, (unsigned long)w->out_len,
+		ms / 1000.0, complete ? "" : " (timeout)");
+	w->out_len = 0;
+}
+
+static void harvest(epg_worker *w, epg_channel *ch)
+{
+	uint8_t sec[SECTION_MAX];
+	struct pollfd pfd[NUM_FILTERS];
+	unsigned int tsid = 0;
+	uint32_t lock_ms;
+	uint64_t start, last_new;
+	int nsec = 0;
+	size_t i;
+
+	memset(w->tables, 0, sizeof(w->tables));
+	w->ntables = 0;
+	w->incomplete = 0;
+
+	for (i = 0; i < NUM_FILTERS; i++) {
+		demux_stop(w->dmxfd[i]);
+	}
+
+	set_bs_tsid(ch->name, &tsid);
+	if (frontend_tune(w->fefd, ch->isdbtype, ch->name, tsid, w->lnb) != 0 ||
+	    frontend_wait_lock(w->fefd, 3000, &lock_ms) != 0) {
+		fprintf(stderr, "Error: [%d.%d %s] Cannot lock, skipped.\n", w->dev_num, w->fe_num, ch->name);
+		return;
+	}
+
+	for (i = 0; i < NUM_FILTERS; i++) {
+		demux_set_section(w->dmxfd[i], si_filters[i].pid, si_filters[i].table_id, si_filters[i].mask);
+		pfd[i].fd = w->dmxfd[i];
+		pfd[i].events = POLLIN;
+	}
+
+	start = last_new = trace_now();
+	while (1) {
+		uint64_t now = trace_now();
+
+		if (now - start >= (uint64_t)EPG_TIMEOUT_SEC * 1000000000) {
+			break;
+		}
+		if (w->ntables > 0 && w->incomplete == 0 && now - last_new >= (uint64_t)EPG_SETTLE_MSEC * 1000000) {
+			break;
+		}
+		if (poll(pfd, NUM_FILTERS, 100) <= 0) {
+			continue;
+		}
+
+		for (i = 0; i < NUM_FILTERS; i++) {
+			ssize_t len;
+
+			if (!(pfd[i].revents & (POLLIN | POLLERR))) {
+				continue;
+			}
+			len = read(pfd[i].fd, sec, sizeof(sec));
+			if (len < 8) {
+				continue;
+			}
+			nsec++;
+			if (handle_section(w, si_filters[i].pid, sec, (int)len)) {
+				last_new = trace_now();
+			}
+		}
+	}
+
+	flush_channel(w, ch, nsec, (trace_now() - start) / 1000000, w->incomplete == 0);
+}
+
+static void *epg_func(void *p)
+{
+	epg_worker *w = (epg_worker *)p;
+	epg_channel *ch;
+
+	while ((ch = take_channel(w->isdbtype)) != NULL) {
+		harvest(w, ch);
+		w->done++;
+	}
+
+	return NULL;
+}
+
+static void close_worker(epg_worker *w)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_FILTERS; i++) {
+		if (w->dmxfd[i] >= 0) {
+			close(w->dmxfd[i]);
+		}
+	}
+	if (w->fefd >= 0) {
+		close(w->fefd);
+	}
+	if (w->lockfd >= 0) {
+		close(w->lockfd);
+	}
+	free(w->out);
+}
+
+static int open_worker(epg_worker *w, const adapter_info *info, int lnb)
+{
+	size_t i;
+
+	memset(w, 0, sizeof(*w));
+	w->fefd = -1;
+	for (i = 0; i < NUM_FILTERS; i++) {
+		w->dmxfd[i] = -1;
+	}
+	w->dev_num = info->dev_num;
+	w->fe_num = info->fe_num;
+	w->isdbtype = info->isdbtype;
+	w->lnb = lnb;
+
+	w->lockfd = adapter_lock(w->dev_num, w->fe_num);
+	if (w->lockfd == -1) {
+		fprintf(stderr, "Info: Device %d.%d is busy, skipped.\n", w->dev_num, w->fe_num);
+		return -1;
+	}
+
+	w->fefd = open_frontend(w->dev_num, w->fe_num);
+	if (w->fefd < 0) {
+		close_worker(w);
+		return -1;
+	}
+
+	/* one demux handle per SI PID */
+	for (i = 0; i < NUM_FILTERS; i++) {
+		w->dmxfd[i] = open_demux(w->dev_num, w->fe_num);
+		if (w->dmxfd[i] < 0) {
+			close_worker(w);
+			return -1;
+		}
+		demux_set_buffer(w->dmxfd[i], EPG_DMX_BUFFER);
+	}
+
+	return 0;
+}
+
+int epg_main(struct recdvb_options *opts, int nchannels, char **channels)
+{
+	static adapter_info inv[ADAPTER_MAX];
+	static epg_worker *workers;
+	const chdb *db = preset_db();
+	int nworkers = 0;
+	int i, n;
+	uint64_t start = trace_now();
+
+	/* channels from arguments, otherwise every scanned stream */
+	if (nchannels > 0) {
+		n = nchannels;
+	} else if (db) {
+		n = (int)db->hdr->nentries;
+	} else {
+		fprintf(stderr, "Error: No channel given and no channel database.\n");
+		return 1;
+	}
+	channel_list = calloc((size_t)n, sizeof(epg_channel));
+	workers = calloc(ADAPTER_MAX, sizeof(epg_worker));
+	if (!channel_list || !workers) {
+		fprintf(stderr, "Error: Cannot allocate memory.\n");
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		const char *name = nchannels > 0 ? channels[i] : db->entries[i].name;
+		snprintf(channel_list[i].name, CHANNEL_MAX, "%s", name);
+		channel_list[i].isdbtype = channel_isdbtype(name);
+	}
+	num_channels = n;
+
+	epg_fp = fopen(opts->epg_path, "wb");
+	if (!epg_fp) {
+		fprintf(stderr, "Error: Cannot open '%s'. (errno=%d)\n", opts->epg_path, errno);
+		return 1;
+	}
+
+	n = adapter_list(inv, ADAPTER_MAX);
+	for (i = 0; i < n; i++) {
+		if (inv[i].isdbtype != ISDBTYPE_ISDBT && inv[i].isdbtype != ISDBTYPE_ISDBS) {
+			continue;
+		}
+		if (open_worker(&workers[nworkers], &inv[i], opts->lnb) == 0) {
+			nworkers++;
+		}
+	}
+	if (nworkers == 0) {
+		fprintf(stderr, "Error: No tuner is available for EPG.\n");
+		fclose(epg_fp);
+		return 1;
+	}
+
+	fprintf(stderr, "Info: Harvesting EPG of %d channel(s) with %d tuner(s).\n", num_channels, nworkers);
+	for (i = 0; i < nworkers; i++) {
+		pthread_create(&workers[i].thread, NULL, epg_func, &workers[i]);
+	}
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		close_worker(&workers[i]);
+	}
+
+	if (fclose(epg_fp) != 0) {
+		fprintf(stderr, "Error: Write EPG failed. (errno=%d)\n", errno);
+	}
+	fprintf(stderr, "Info: EPG finished in %.1lfsec, %lu sections, %lubyte.\n",
+		(trace_now() - start) / 1000000000.0, (unsigned long)total_sections, (unsigned long)total_bytes);
+
+	free(workers);
+	free(channel_list);
+
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_EPG_H
+#define RECDVB_EPG_H
+
+#include <stdint.h>
+
+#include "recdvb.h"
+
+/*
+ * EPG harvest: tune each channel, filter only SI PIDs on the demux and
+ * collect sections until every table seen is complete. output is a
+ * sequence of records, each an epg_record header followed by one
+ * section, every distinct section written once.
+ */
+#define EPG_TIMEOUT_SEC 120        /* give up on a channel after this */
+#define EPG_SETTLE_MSEC 3000       /* no new table for this long before finishing */
+#define EPG_MAX_TABLES 4096
+#define EPG_DMX_BUFFER (1024 * 1024)
+
+typedef struct epg_record {
+	uint16_t pid;
+	uint16_t len;              /* section length including header and CRC */
+} epg_record;
+
+int epg_main(struct recdvb_options *opts, int nchannels, char **channels);
+
+#endif
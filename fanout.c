@@ -0,0 +1,257 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "fanout.h"
+
+void fanout_init(fanout *f, int epfd)
+{
+	int i;
+
+	f->epfd = epfd;
+	f->count = 0;
+	f->buffer_size = FANOUT_BUFFER_SIZE;
+	f->evict = 0;
+	f->evicted = 0;
+	for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+		f->client[i].fd = -1;
+		f->client[i].buf = NULL;
+	}
+}
+
+static fanout_client *find_client(const fanout *f, int fd)
+{
+	int i;
+
+	if (fd == -1) {
+		return NULL;
+	}
+	for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+		if (f->client[i].fd == fd) {
+			return (fanout_client *)&f->client[i];
+		}
+	}
+	return NULL;
+}
+
+/* fd must be non-blocking. fd is closed when client is removed. */
+int fanout_add(fanout *f, int fd)
+{
+	fanout_client *c = NULL;
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+		if (f->client[i].fd == -1) {
+			c = &f->client[i];
+			break;
+		}
+	}
+	if (!c) {
+		return -1;
+	}
+
+	c->buf = malloc(f->buffer_size);
+	if (!c->buf) {
+		return -1;
+	}
+
+	/* EPOLLOUT is enabled only while data is pending */
+	ev.data.fd = fd;
+	ev.events = EPOLLRDHUP;
+	if (epoll_ctl(f->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		free(c->buf);
+		c->buf = NULL;
+		return -1;
+	}
+
+	c->fd = fd;
+	c->head = 0;
+	c->len = 0;
+	c->sent = 0;
+	c->dropped = 0;
+	f->count++;
+
+	return 0;
+}
+
+int fanout_owns(const fanout *f, int fd)
+{
+	return find_client(f, fd) != NULL;
+}
+
+void fanout_remove(fanout *f, int fd)
+{
+	fanout_client *c = find_client(f, fd);
+
+	if (!c) {
+		return;
+	}
+	if (c->dropped > 0) {
+		fprintf(stderr, "Info: Client %d sent %lubyte, dropped %lubyte.\n", fd, c->sent, c->dropped);
+	}
+
+	epoll_ctl(f->epfd, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+	free(c->buf);
+	c->buf = NULL;
+	c->fd = -1;
+	f->count--;
+}
+
+static void set_pollout(fanout *f, fanout_client *c, int enable)
+{
+	struct epoll_event ev;
+
+	ev.data.fd = c->fd;
+	ev.events = EPOLLRDHUP | (enable ? EPOLLOUT : 0);
+	epoll_ctl(f->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* send buffered bytes. returns -1 if client is gone. */
+static int flush_client(fanout_client *c, size_t size)
+{
+	while (c->len > 0) {
+		size_t n = c->len;
+		ssize_t wc;
+
+		if (c->head + n > size) {
+			n = size - c->head;
+		}
+		wc = send(c->fd, c->buf + c->head, n, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (wc < 0) {
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+		c->head = (c->head + (size_t)wc) % size;
+		c->len -= (size_t)wc;
+		c->sent += (uint64_t)wc;
+	}
+
+	return 0;
+}
+
+static void push_client(fanout_client *c, size_t size, const uint8_t *data, size_t len)
+{
+	size_t tail = (c->head + c->len) % size;
+	size_t n = len;
+
+	if (tail + n > size) {
+		n = size - tail;
+	}
+	memcpy(c->buf + tail, data, n);
+	memcpy(c->buf, data + n, len - n);
+	c->len += len;
+}
+
+/*
+ * queue data for every client and send as much as possible.
+ * data is dropped as a whole for clients which cannot keep up,
+ * so that they keep receiving whole packets, or such clients are
+ * evicted if f->evict is set.
+ */
+void fanout_write(fanout *f, const uint8_t *data, size_t len)
+{
+	int i;
+
+	for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+		fanout_client *c = &f->client[i];
+		int was_pending;
+
+		if (c->fd == -1) {
+			continue;
+		}
+		was_pending = c->len > 0;
+
+		if (c->len + len > f->buffer_size) {
+			if (f->evict) {
+				fprintf(stderr, "Info: Client %d evicted, %lubyte behind.\n", c->fd, c->len);
+				f->evicted++;
+				fanout_remove(f, c->fd);
+				continue;
+			}
+			c->dropped += len;
+			continue;
+		}
+		push_client(c, f->buffer_size, data, len);
+
+		if (flush_client(c, f->buffer_size) != 0) {
+			fanout_remove(f, c->fd);
+			continue;
+		}
+		if ((c->len > 0) != was_pending) {
+			set_pollout(f, c, c->len > 0);
+		}
+	}
+}
+
+/* queue data for one client only, ahead of stream. call right after fanout_add(). */
+void fanout_prime(fanout *f, int fd, const uint8_t *data, size_t len)
+{
+	fanout_client *c = find_client(f, fd);
+
+	if (!c || len == 0 || c->len + len > f->buffer_size) {
+		return;
+	}
+	push_client(c, f->buffer_size, data, len);
+	set_pollout(f, c, 1);
+}
+
+/* handle epoll event of client fd. returns 1 if client was removed. */
+int fanout_handle(fanout *f, int fd, uint32_t events)
+{
+	fanout_client *c = find_client(f, fd);
+
+	if (!c) {
+		return 0;
+	}
+
+	if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+		fanout_remove(f, fd);
+		return 1;
+	}
+
+	if (events & EPOLLOUT) {
+		if (flush_client(c, f->buffer_size) != 0) {
+			fanout_remove(f, fd);
+			return 1;
+		}
+		if (c->len == 0) {
+			set_pollout(f, c, 0);
+		}
+	}
+
+	return 0;
+}
+
+void fanout_close(fanout *f)
+{
+	int i;
+
+	for (i = 0; i < FANOUT_MAX_CLIENTS; i++) {
+		if (f->client[i].fd != -1) {
+			fanout_remove(f, f->client[i].fd);
+		}
+	}
+}
@@ -0,0 +1,54 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_FANOUT_H
+#define RECDVB_FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FANOUT_MAX_CLIENTS 16
+#define FANOUT_BUFFER_SIZE (4 * 1024 * 1024) /* default */
+
+/* one stream written to many non-blocking sockets */
+typedef struct fanout_client {
+	int fd;
+	uint8_t *buf;              /* ring of bytes not yet accepted by socket */
+	size_t head;
+	size_t len;
+	uint64_t sent;
+	uint64_t dropped;
+} fanout_client;
+
+typedef struct fanout {
+	int epfd;
+	int count;
+	size_t buffer_size;        /* per client, set before adding clients */
+	int evict;                 /* remove client that cannot keep up, instead of dropping data */
+	uint64_t evicted;
+	fanout_client client[FANOUT_MAX_CLIENTS];
+} fanout;
+
+void fanout_init(fanout *f, int epfd);
+int fanout_add(fanout *f, int fd);
+int fanout_owns(const fanout *f, int fd);
+void fanout_remove(fanout *f, int fd);
+void fanout_write(fanout *f, const uint8_t *data, size_t len);
+void fanout_prime(fanout *f, int fd, const uint8_t *data, size_t len);
+int fanout_handle(fanout *f, int fd, uint32_t events);
+void fanout_close(fanout *f);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "histogram.h"
+
+static unsigned int hist_index(uint64_t v)
+{
+	unsigned int e;
+
+	if (v < HIST_SUB_COUNT) {
+		return (unsigned int)v;
+	}
+
+	/* position of highest bit, >= HIST_SUB_BITS */
+	e = 63 - (unsigned int)__builtin_clzll(v);
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB_COUNT +
+		(unsigned int)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1));
+}
+
+/* highest value which falls into bucket i */
+static uint64_t hist_value(unsigned int i)
+{
+	unsigned int g = i / HIST_SUB_COUNT;
+	uint64_t m = i % HIST_SUB_COUNT;
+	unsigned int shift;
+
+	if (g == 0) {
+		return m;
+	}
+
+	shift = g - 1;
+	return ((HIST_SUB_COUNT + m + 1) << shift) - 1;
+}
+
+void hist_reset(histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+/*
+ * single writer, any number of readers.
+ * counters are updated atomically so readers never see torn values.
+ */
+void hist_record(histogram *h, uint64_t value)
+{
+	__atomic_add_fetch(&h->buckets[hist_index(value)], 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+	if (value > h->max) {
+		__atomic_store_n(&h->max, value, __ATOMIC_RELAXED);
+	}
+}
+
+uint64_t hist_percentile(const histogram *h, double percent)
+{
+	unsigned int i;
+	uint64_t seen = 0;
+	uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+	uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+	uint64_t target;
+
+	if (count == 0) {
+		return 0;
+	}
+
+	target = (uint64_t)(count * percent / 100.0 + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+		if (seen >= target) {
+			uint64_t v = hist_value(i);
+			return v < max ? v : max;
+		}
+	}
+
+	return max;
+}
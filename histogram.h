@@ -0,0 +1,41 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_HISTOGRAM_H
+#define RECDVB_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * log-linear histogram. values below 2^HIST_SUB_BITS are exact,
+ * larger values fall into 2^HIST_SUB_BITS linear buckets per power of two,
+ * so relative error is below 1 / 2^HIST_SUB_BITS.
+ */
+#define HIST_SUB_BITS    5
+#define HIST_SUB_COUNT   (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS     ((64 - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+typedef struct histogram {
+	uint64_t count;
+	uint64_t max;
+	uint64_t buckets[HIST_BUCKETS];
+} histogram;
+
+void hist_reset(histogram *h);
+void hist_record(histogram *h, uint64_t value);
+uint64_t hist_percentile(const histogram *h, double percent);
+
+#endif
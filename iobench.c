@@ -0,0 +1,254 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * iobench - simulate concurrent recordings writing to one disk.
+ *
+ * every writer appends a paced stream, as a tuner would deliver it, with
+ * one of the output strategies of recdvb. lateness is how far a writer
+ * fell behind its schedule, which is what a tuner buffer has to absorb.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "iosched.h"
+#include "writeback.h"
+#include "trace.h"
+
+/* same as one read from dvr device */
+#define CHUNK_SIZE (188 * 348)
+
+enum bench_mode {
+	MODE_PLAIN,
+	MODE_WRITEBACK,
+	MODE_EXTENT,
+};
+
+static const char *mode_names[] = {"plain", "writeback", "extent"};
+
+typedef struct bench {
+	int id;
+	const char *dir;
+	int mode;
+	int mbps;
+	int seconds;
+	uint64_t extent;
+	int direct;
+
+	/* results */
+	uint64_t bytes;
+	uint64_t write_ns_max;
+	uint64_t late_ns_max;
+	uint64_t close_ns;
+	int error;
+} bench;
+
+static void *bench_func(void *p)
+{
+	bench *b = p;
+	char path[512];
+	uint8_t *chunk;
+	writeback wb;
+	iosched io;
+	uint64_t start, total, interval;
+	uint64_t n, count;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/iobench-%d.ts", b->dir, b->id);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Cannot open %s. (errno=%d)\n", path, errno);
+		b->error = 1;
+		return NULL;
+	}
+
+	chunk = malloc(CHUNK_SIZE);
+	memset(chunk, 0x47, CHUNK_SIZE);
+	total = (uint64_t)b->mbps * 1000000 / 8 * (uint64_t)b->seconds;
+	count = total / CHUNK_SIZE;
+	interval = 1000000000ULL * CHUNK_SIZE / ((uint64_t)b->mbps * 1000000 / 8);
+
+	if (b->mode == MODE_WRITEBACK) {
+		writeback_attach(&wb, fd, WRITEBACK_WINDOW_DEFAULT);
+	} else if (b->mode == MODE_EXTENT) {
+		if (iosched_init(&io, (size_t)b->extent) != 0) {
+			b->error = 1;
+			close(fd);
+			free(chunk);
+			return NULL;
+		}
+		iosched_attach(&io, fd, b->direct, total);
+	}
+
+	start = trace_now();
+	for (n = 0; n < count; n++) {
+		uint64_t due = start + n * interval;
+		uint64_t now = trace_now();
+		uint64_t t0;
+		ssize_t wc;
+
+		if (now < due) {
+			struct timespec ts = {(time_t)((due - now) / 1000000000), (long)((due - now) % 1000000000)};
+
+			nanosleep(&ts, NULL);
+		} else if (now - due > b->late_ns_max) {
+			b->late_ns_max = now - due;
+		}
+
+		t0 = trace_now();
+		if (b->mode == MODE_EXTENT) {
+			wc = iosched_write(&io, chunk, CHUNK_SIZE);
+		} else {
+			wc = write(fd, chunk, CHUNK_SIZE);
+		}
+		if (wc != CHUNK_SIZE) {
+			fprintf(stderr, "Error: Write failed. (errno=%d)\n", errno);
+			b->error = 1;
+			break;
+		}
+		if (b->mode == MODE_WRITEBACK) {
+			uint64_t ns;
+
+			writeback_wrote(&wb, CHUNK_SIZE, &ns);
+		}
+		if (trace_now() - t0 > b->write_ns_max) {
+			b->write_ns_max = trace_now() - t0;
+		}
+		b->bytes += CHUNK_SIZE;
+	}
+
+	/* same as reader_close */
+	{
+		uint64_t t0 = trace_now();
+		uint64_t ns;
+
+		if (b->mode == MODE_WRITEBACK) {
+			writeback_finish(&wb, 1, &ns);
+		} else if (b->mode == MODE_EXTENT) {
+			iosched_finish(&io);
+			iosched_destroy(&io);
+		}
+		fsync(fd);
+		close(fd);
+		b->close_ns = trace_now() - t0;
+	}
+
+	unlink(path);
+	free(chunk);
+
+	return NULL;
+}
+
+static void show_usage(const char *cmd)
+{
+	fprintf(stderr, "Usage: \n%s [-n WRITERS] [-r MBPS] [-t SEC] [-m plain|writeback|extent] "
+		"[-x EXTENT_MB] [-d] DIR\n", cmd);
+}
+
+int main(int argc, char **argv)
+{
+	int writers = 8, mbps = 60, seconds = 30, mode = MODE_EXTENT, direct = 0;
+	uint64_t extent = IOSCHED_EXTENT_DEFAULT;
+	uint64_t bytes = 0, write_max = 0, late_max = 0, close_max = 0, start, elapsed;
+	pthread_t *th;
+	bench *b;
+	int c, i, error = 0;
+
+	while ((c = getopt(argc, argv, "n:r:t:m:x:dh")) != -1) {
+		switch (c) {
+		case 'n':
+			writers = atoi(optarg);
+			break;
+		case 'r':
+			mbps = atoi(optarg);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'm':
+			for (mode = 0; mode <= MODE_EXTENT && strcmp(optarg, mode_names[mode]); mode++) {
+				;
+			}
+			break;
+		case 'x':
+			extent = (uint64_t)atoi(optarg) << 20;
+			break;
+		case 'd':
+			direct = 1;
+			break;
+		default:
+			show_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || writers < 1 || mbps < 1 || seconds < 1 || mode > MODE_EXTENT || extent == 0) {
+		show_usage(argv[0]);
+		return 1;
+	}
+
+	fprintf(stderr, "Info: %d writers at %dMbps for %dsec, mode %s", writers, mbps, seconds, mode_names[mode]);
+	if (mode == MODE_EXTENT) {
+		fprintf(stderr, " (%luMB%s)", extent >> 20, direct ? ", direct" : "");
+	}
+	fprintf(stderr, "\n");
+
+	th = calloc((size_t)writers, sizeof(pthread_t));
+	b = calloc((size_t)writers, sizeof(bench));
+	start = trace_now();
+	for (i = 0; i < writers; i++) {
+		b[i].id = i;
+		b[i].dir = argv[optind];
+		b[i].mode = mode;
+		b[i].mbps = mbps;
+		b[i].seconds = seconds;
+		b[i].extent = extent;
+		b[i].direct = direct;
+		pthread_create(&th[i], NULL, bench_func, &b[i]);
+	}
+	for (i = 0; i < writers; i++) {
+		pthread_join(th[i], NULL);
+		bytes += b[i].bytes;
+		error |= b[i].error;
+		if (b[i].write_ns_max > write_max) {
+			write_max = b[i].write_ns_max;
+		}
+		if (b[i].late_ns_max > late_max) {
+			late_max = b[i].late_ns_max;
+		}
+		if (b[i].close_ns > close_max) {
+			close_max = b[i].close_ns;
+		}
+	}
+	elapsed = trace_now() - start;
+
+	fprintf(stderr, "Info: Wrote %.1lfMB in %.2lfsec, %.1lfMB/s\n",
+		(double)bytes / 1e6, (double)elapsed / 1e9, (double)bytes / 1e6 / ((double)elapsed / 1e9));
+	fprintf(stderr, "Info: Write latency max %.1lfms, behind schedule max %.1lfms, close max %.1lfms\n",
+		(double)write_max / 1e6, (double)late_max / 1e6, (double)close_max / 1e6);
+
+	free(th);
+	free(b);
+
+	return error;
+}
@@ -0,0 +1,356 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "iosched.h"
+#include "trace.h"
+
+static int init_mutex(pthread_mutex_t *m, int pshared)
+{
+	pthread_mutexattr_t attr;
+	int rc;
+
+	pthread_mutexattr_init(&attr);
+	if (pshared) {
+		pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+		pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	}
+	rc = pthread_mutex_init(m, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return rc;
+}
+
+/* map coordinator of device, creating it on first use */
+static iosched_device *open_device(dev_t dev)
+{
+	char path[128];
+	iosched_device *d;
+	struct stat st;
+	int fd, creator = 1, retry;
+
+	snprintf(path, sizeof(path), "%s/recdvb-io-%u-%u", IOSCHED_SHM_DIR, major(dev), minor(dev));
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0660);
+	if (fd == -1 && errno == EEXIST) {
+		creator = 0;
+		fd = open(path, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+	}
+	if (fd == -1) {
+		return NULL;
+	}
+
+	/* lock stalls every recording on disk, only trust our user or group */
+	if (fstat(fd, &st) != 0 || (st.st_mode & 0007) ||
+	    (st.st_uid != geteuid() && st.st_gid != getegid())) {
+		fprintf(stderr, "Info: %s is not owned by this user or group, ignored.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	if (creator) {
+		/* other recorders of the group share it regardless of umask */
+		fchmod(fd, 0660);
+		if (ftruncate(fd, sizeof(iosched_device)) != 0) {
+			close(fd);
+			unlink(path);
+			return NULL;
+		}
+	} else {
+		/* creator may not have sized it yet */
+		for (retry = 0; retry < 100; retry++) {
+			if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(iosched_device)) {
+				break;
+			}
+			usleep(1000);
+		}
+		if (retry == 100) {
+			close(fd);
+			return NULL;
+		}
+	}
+
+	d = mmap(NULL, sizeof(iosched_device), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (d == MAP_FAILED) {
+		return NULL;
+	}
+
+	if (creator) {
+		init_mutex(&d->mutex, 1);
+		__atomic_store_n(&d->magic, IOSCHED_MAGIC, __ATOMIC_RELEASE);
+	} else {
+		for (retry = 0; retry < 100 && __atomic_load_n(&d->magic, __ATOMIC_ACQUIRE) != IOSCHED_MAGIC; retry++) {
+			usleep(1000);
+		}
+		if (retry == 100) {
+			munmap(d, sizeof(iosched_device));
+			return NULL;
+		}
+	}
+
+	return d;
+}
+
+/*
+ * returns 0 when holding device, -1 when holder did not release it in
+ * time. once timed out, only try it until it is free again.
+ */
+static int lock_device(iosched_device *d, int wait)
+{
+	struct timespec ts;
+	int rc;
+
+	if (!wait) {
+		rc = pthread_mutex_trylock(&d->mutex);
+		if (rc == EOWNERDEAD) {
+			pthread_mutex_consistent(&d->mutex);
+			rc = 0;
+		}
+		return rc == 0 ? 0 : -1;
+	}
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += IOSCHED_LOCK_MSEC / 1000;
+	ts.tv_nsec += (IOSCHED_LOCK_MSEC % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	rc = pthread_mutex_timedlock(&d->mutex, &ts);
+	if (rc == EOWNERDEAD) {
+		/* previous holder died, state is only counters */
+		pthread_mutex_consistent(&d->mutex);
+		rc = 0;
+	}
+
+	return rc == 0 ? 0 : -1;
+}
+
+int iosched_init(iosched *s, size_t extent)
+{
+	memset(s, 0, sizeof(*s));
+	s->fd = -1;
+	s->extent = extent & ~(size_t)(IOSCHED_ALIGN - 1);
+	if (s->extent == 0) {
+		s->extent = IOSCHED_ALIGN;
+	}
+	if (posix_memalign((void **)&s->buf, IOSCHED_ALIGN, s->extent) != 0) {
+		s->buf = NULL;
+		fprintf(stderr, "Error: Cannot allocate extent buffer.\n");
+		return -1;
+	}
+	init_mutex(&s->local.mutex, 0);
+
+	return 0;
+}
+
+/* switch output to fd, preallocating expected size */
+int iosched_attach(iosched *s, int fd, int direct, uint64_t prealloc)
+{
+	struct stat st;
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+
+	s->fd = fd;
+	s->len = 0;
+	s->pos = pos > 0 ? (uint64_t)pos : 0;
+	s->prealloc = 0;
+	s->direct = 0;
+
+	if (direct) {
+		int flags = fcntl(fd, F_GETFL);
+
+		if (flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+			s->direct = 1;
+		} else {
+			fprintf(stderr, "Info: Direct I/O is not supported (errno=%d), fall back to buffered write.\n", errno);
+		}
+	}
+
+	if (!s->dev && fstat(fd, &st) == 0) {
+		s->dev = open_device(st.st_dev);
+		if (!s->dev) {
+			fprintf(stderr, "Info: No I/O coordinator for device %u:%u, writing unordered.\n",
+				major(st.st_dev), minor(st.st_dev));
+		}
+	}
+
+	/* contiguous blocks for whole recording */
+	if (prealloc > s->pos && fallocate(fd, FALLOC_FL_KEEP_SIZE, (off_t)s->pos, (off_t)(prealloc - s->pos)) == 0) {
+		s->prealloc = prealloc;
+	}
+
+	return 0;
+}
+
+/* write n bytes of buffer as one run on device */
+static int write_extent(iosched *s, size_t n)
+{
+	iosched_device *d = s->dev ? s->dev : &s->local;
+	const uint8_t *p = s->buf;
+	size_t left = n;
+	uint64_t t0, t1, t2;
+	int rc = 0, locked;
+
+	t0 = trace_now();
+	locked = lock_device(d, !s->unordered) == 0;
+	t1 = trace_now();
+	if (!locked) {
+		/* stopped or stuck holder, do not stall this recording too */
+		if (!s->unordered) {
+			fprintf(stderr, "Info: I/O coordinator is held over %dms, writing unordered.\n", IOSCHED_LOCK_MSEC);
+		}
+		s->unordered = 1;
+		s->lock_timeouts++;
+	} else if (s->unordered) {
+		fprintf(stderr, "Info: I/O coordinator is released, writing in turn again.\n");
+		s->unordered = 0;
+	}
+
+	while (left > 0) {
+		ssize_t wc = write(s->fd, p, left);
+
+		if (wc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EINVAL && s->direct) {
+				/* filesystem accepted flag but not the write */
+				int flags = fcntl(s->fd, F_GETFL);
+
+				fprintf(stderr, "Info: Direct I/O write failed, fall back to buffered write.\n");
+				fcntl(s->fd, F_SETFL, flags & ~O_DIRECT);
+				s->direct = 0;
+				continue;
+			}
+			rc = -1;
+			break;
+		}
+		p += wc;
+		left -= (size_t)wc;
+	}
+
+	/* on disk before next stream gets device */
+	if (rc == 0 && !s->direct) {
+		sync_file_range(s->fd, (off_t)s->pos, (off_t)n,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	}
+	t2 = trace_now();
+	if (locked) {
+		d->extents++;
+		d->bytes += n;
+		d->busy_ns += t2 - t1;
+		pthread_mutex_unlock(&d->mutex);
+	}
+
+	if (rc == 0 && !s->direct) {
+		posix_fadvise(s->fd, (off_t)s->pos, (off_t)n, POSIX_FADV_DONTNEED);
+	}
+	s->pos += n;
+	s->extents++;
+	s->wait_ns_total += t1 - t0;
+	if (t1 - t0 > s->wait_ns_max) {
+		s->wait_ns_max = t1 - t0;
+	}
+	s->write_ns_total += t2 - t1;
+
+	return rc;
+}
+
+/* gather data, write whole extents. returns len or -1. */
+ssize_t iosched_write(iosched *s, const uint8_t *data, size_t len)
+{
+	size_t done = 0;
+
+	while (done < len) {
+		size_t n = s->extent - s->len;
+
+		if (n > len - done) {
+			n = len - done;
+		}
+		memcpy(s->buf + s->len, data + done, n);
+		s->len += n;
+		done += n;
+
+		if (s->len == s->extent) {
+			if (write_extent(s, s->len) != 0) {
+				return -1;
+			}
+			s->len = 0;
+		}
+	}
+
+	return (ssize_t)len;
+}
+
+/* write rest and release unused preallocation */
+int iosched_finish(iosched *s)
+{
+	size_t n;
+	int rc = 0;
+
+	if (s->fd == -1) {
+		return 0;
+	}
+
+	/* aligned part as extent, tail without O_DIRECT */
+	n = s->len & ~(size_t)(IOSCHED_ALIGN - 1);
+	if (n > 0) {
+		rc = write_extent(s, n);
+		memmove(s->buf, s->buf + n, s->len - n);
+		s->len -= n;
+	}
+	if (rc == 0 && s->len > 0) {
+		if (s->direct) {
+			int flags = fcntl(s->fd, F_GETFL);
+
+			fcntl(s->fd, F_SETFL, flags & ~O_DIRECT);
+			s->direct = 0;
+		}
+		rc = write_extent(s, s->len);
+	}
+	s->len = 0;
+
+	if (s->prealloc > s->pos && ftruncate(s->fd, (off_t)s->pos) != 0) {
+		fprintf(stderr, "Error: Cannot release preallocated space. (errno=%d)\n", errno);
+	}
+	s->prealloc = 0;
+	s->fd = -1;
+
+	return rc;
+}
+
+void iosched_destroy(iosched *s)
+{
+	if (s->dev) {
+		munmap(s->dev, sizeof(iosched_device));
+		s->dev = NULL;
+	}
+	pthread_mutex_destroy(&s->local.mutex);
+	free(s->buf);
+	s->buf = NULL;
+}
@@ -0,0 +1,71 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_IOSCHED_H
+#define RECDVB_IOSCHED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define IOSCHED_EXTENT_DEFAULT (8 * 1024 * 1024)
+#define IOSCHED_ALIGN          4096
+#define IOSCHED_SHM_DIR        "/dev/shm"
+#define IOSCHED_MAGIC          0x72647669 /* "rdvi" */
+#define IOSCHED_LOCK_MSEC      2000       /* wait for device before writing unordered */
+
+/* one per block device, shared by every recdvb process writing to it */
+typedef struct iosched_device {
+	uint32_t magic;
+	pthread_mutex_t mutex;     /* process shared, robust */
+	uint64_t extents;
+	uint64_t bytes;
+	uint64_t busy_ns;
+} iosched_device;
+
+/*
+ * output of one recording. data is gathered into extents, and each
+ * extent is written and flushed to disk while holding the device, so
+ * that concurrent recordings reach the disk as long sequential runs.
+ */
+typedef struct iosched {
+	int fd;
+	int direct;                /* file is opened with O_DIRECT */
+	uint8_t *buf;
+	size_t len;
+	size_t extent;
+	uint64_t pos;
+	uint64_t prealloc;         /* allocated size, released on finish */
+	iosched_device *dev;       /* NULL if coordinator is unavailable */
+	iosched_device local;      /* used instead, within this stream only */
+	int unordered;             /* device lock timed out, only tried until free */
+
+	/* stats */
+	uint64_t extents;
+	uint64_t wait_ns_total;
+	uint64_t wait_ns_max;
+	uint64_t write_ns_total;
+	uint64_t lock_timeouts;    /* extents written without holding device */
+} iosched;
+
+int iosched_init(iosched *s, size_t extent);
+int iosched_attach(iosched *s, int fd, int direct, uint64_t prealloc);
+ssize_t iosched_write(iosched *s, const uint8_t *data, size_t len);
+int iosched_finish(iosched *s);
+void iosched_destroy(iosched *s);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#include "metrics.h"
+
+/* channel may come from control socket, quote it for JSON */
+static void json_escape(const char *s, char *out, size_t len)
+{
+	size_t n = 0;
+
+	for (; s && *s && n + 7 < len; s++) {
+		unsigned char c = (unsigned char)*s;
+
+		if (c == '"' || c == '\\') {
+			out[n++] = '\\';
+			out[n++] = (char)c;
+		} else if (c < 0x20) {
+			n += (size_t)snprintf(out + n, len - n, "\\u%04x", c);
+		} else {
+			out[n++] = (char)c;
+		}
+	}
+	out[n] = '\0';
+}
+
+int metrics_format(const struct metrics *m, char *buf, size_t len)
+{
+	char channel[256];
+	int n;
+	struct timespec now;
+	uint64_t write_ns_avg = 0;
+	uint64_t wb_ns_avg = 0;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	json_escape(m->channel, channel, sizeof(channel));
+	if (m->write_count > 0) {
+		write_ns_avg = m->write_ns_total / m->write_count;
+	}
+	if (m->wb_count > 0) {
+		wb_ns_avg = m->wb_ns_total / m->wb_count;
+	}
+
+	n = snprintf(buf, len,
+		"{\"time\":%ld.%03ld,\"dev\":%d,\"channel\":\"%s\",\"tuned\":%s,\"elapsed_ms\":%lu,"
+		"\"read_bytes\":%lu,\"write_bytes\":%lu,\"dropped_bytes\":%lu,"
+		"\"outages\":%lu,\"outage_ms\":%lu,"
+		"\"queue_depth\":%zu,\"queue_size\":%zu,"
+		"\"write_count\":%lu,\"write_latency_avg_us\":%.1f,\"write_latency_max_us\":%.1f,"
+		"\"dirty_bytes\":%lu,\"flush_count\":%lu,\"flush_latency_avg_us\":%.1f,\"flush_latency_max_us\":%.1f",
+		(long)now.tv_sec, now.tv_nsec / 1000000, m->dev_num,
+		channel, m->tuned ? "true" : "false", m->elapsed_ms,
+		m->r_byte, m->w_byte, m->o_byte,
+		m->outages, m->outage_ms,
+		m->queue_depth, m->queue_size,
+		m->write_count, write_ns_avg / 1000.0, m->write_ns_max / 1000.0,
+		m->wb_dirty, m->wb_count, wb_ns_avg / 1000.0, m->wb_ns_max / 1000.0);
+
+	/* signal values are omitted when driver does not provide them */
+	if (m->fe.cnr_valid && n < (int)len) {
+		n += snprintf(buf + n, len - n, ",\"cnr_db\":%.3f", m->fe.cnr);
+	}
+	if (m->fe.blocks_valid && n < (int)len) {
+		n += snprintf(buf + n, len - n, ",\"error_blocks\":%lu,\"total_blocks\":%lu",
+				m->fe.error_blocks, m->fe.total_blocks);
+	}
+	if (m->fe.signal_valid && n < (int)len) {
+		n += snprintf(buf + n, len - n, ",\"signal\":%.3f", m->fe.signal);
+	}
+	if (m->timeline && n < (int)len) {
+		int tn;
+
+		n += snprintf(buf + n, len - n, ",\"timeline_ms\":");
+		if (n < (int)len && (tn = timeline_format(m->timeline, buf + n, len - n)) > 0) {
+			n += tn;
+		} else {
+			return -1;
+		}
+	}
+	if (m->trace && n < (int)len) {
+		int tn;
+
+		n += snprintf(buf + n, len - n, ",\"latency_us\":");
+		if (n < (int)len && (tn = trace_format(m->trace, buf + n, len - n)) > 0) {
+			n += tn;
+		} else {
+			return -1;
+		}
+	}
+	if (n < (int)len) {
+		n += snprintf(buf + n, len - n, "}\n");
+	}
+
+	if (n >= (int)len) {
+		return -1;
+	}
+	return n;
+}
+
+/* accept pending clients, send one snapshot each and disconnect */
+void metrics_serve(int lfd, const struct metrics *m)
+{
+	int cfd;
+	int n;
+	char line[METRICS_LINE_MAX];
+
+	n = metrics_format(m, line, sizeof(line));
+
+	while ((cfd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		if (n > 0 && send(cfd, line, (size_t)n, MSG_NOSIGNAL | MSG_DONTWAIT) != n) {
+			fprintf(stderr, "Warning: metrics client too slow, dropped. (errno=%d)\n", errno);
+		}
+		close(cfd);
+	}
+}
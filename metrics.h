@@ -0,0 +1,73 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_METRICS_H
+#define RECDVB_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "recdvbcore.h"
+#include "trace.h"
+#include "timeline.h"
+
+#define METRICS_LINE_MAX 8192
+
+/* snapshot served to metrics socket clients, one JSON object per line */
+struct metrics {
+	int dev_num;
+	const char *channel;
+	int tuned;
+	uint64_t elapsed_ms;
+
+	/* signal outages recovered by retuning */
+	uint64_t outages;
+	uint64_t outage_ms;
+
+	/* byte counters */
+	uint64_t r_byte;
+	uint64_t w_byte;
+	uint64_t o_byte;
+
+	/* queue gauges */
+	size_t queue_depth;
+	size_t queue_size;
+
+	/* output write latency */
+	uint64_t write_count;
+	uint64_t write_ns_total;
+	uint64_t write_ns_max;
+
+	/* rolling writeback of output */
+	uint64_t wb_dirty;
+	uint64_t wb_count;
+	uint64_t wb_ns_total;
+	uint64_t wb_ns_max;
+
+	/* signal, refreshed every second */
+	struct frontend_stats fe;
+
+	/* chunk latency, NULL if disabled */
+	const trace *trace;
+
+	/* startup milestones */
+	const timeline *timeline;
+};
+
+int metrics_format(const struct metrics *m, char *buf, size_t len);
+void metrics_serve(int lfd, const struct metrics *m);
+
+#endif
@@ -0,0 +1,470 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include "multi.h"
+
+#include "recdvbcore.h"
+#include "tuner.h"
+#include "adapter.h"
+#include "queue.h"
+#include "reader.h"
+#include "writer.h"
+#include "bufpool.h"
+#include "preset.h"
+#include "trace.h"
+#include "probe.h"
+
+#define NEVENTS 64
+#define TUNE_TIMEOUT 5
+#define READ_TIMEOUT 5
+
+typedef struct recording {
+	struct recdvb_options opts;    /* copy with this tuner's device, channel and file */
+	char spec[256];                /* storage for channel and file of --add-tuner */
+	tuner tuner;
+	thread_data tdata;
+	int active;                    /* tuner running and reader open */
+	int notune_count;
+	int noread_count;
+	uint64_t r_byte;
+	uint64_t p_r_byte;
+	uint64_t o_byte;
+	uint64_t first_ns;             /* first byte read */
+} recording;
+
+static recording recs[MULTI_MAX_TUNERS];
+static int num_recs;
+
+/* "DEV[.FE]:CHANNEL:DESTFILE" */
+static int parse_spec(recording *rec, const char *str)
+{
+	char *channel, *destfile;
+	const char *end;
+
+	snprintf(rec->spec, sizeof(rec->spec), "%s", str);
+	rec->opts.dev_auto = !strncmp(rec->spec, "auto:", 5);
+	if (rec->opts.dev_auto) {
+		end = rec->spec + 4;
+	} else {
+		end = parse_device(rec->spec, &rec->opts.dev_num, &rec->opts.fe_num);
+	}
+	if (!end || *end != ':') {
+		return -1;
+	}
+	channel = (char *)end + 1;
+	destfile = strchr(channel, ':');
+	if (!destfile || destfile == channel || destfile[1] == '\0') {
+		return -1;
+	}
+	*destfile++ = '\0';
+
+	rec->opts.channel = channel;
+	rec->opts.destfile = destfile;
+	rec->opts.use_stdout = !strcmp(destfile, "-");
+	rec->opts.tsid = 0;
+	set_bs_tsid(channel, &rec->opts.tsid);
+
+	return 0;
+}
+
+static void show_stats(recording *rec)
+{
+	fprintf(stderr, "Info: [%d.%d %s] Read %lubyte, Write %lubyte, Overrun %lubyte\n",
+		rec->opts.dev_num, rec->opts.fe_num, rec->opts.channel,
+		rec->r_byte, __atomic_load_n(&rec->tdata.w_byte, __ATOMIC_RELAXED), rec->o_byte);
+}
+
+/* hand end of stream to writer */
+static void finish_reader(writer_pool *w, recording *rec)
+{
+	queue_close(rec->tdata.queue);
+	writer_notify(w, &rec->tdata);
+}
+
+static void stop_recording(writer_pool *w, recording *rec, const char *reason)
+{
+	if (!rec->active) {
+		return;
+	}
+	if (reason) {
+		fprintf(stderr, "Error: [%d.%d %s] %s\n",
+			rec->opts.dev_num, rec->opts.fe_num, rec->opts.channel, reason);
+	}
+	tuner_close(&rec->tuner);
+	finish_reader(w, rec);
+	rec->active = 0;
+}
+
+/* one second tick, returns number of tuners still recording */
+static int check_recordings(writer_pool *w)
+{
+	int i, alive, active = 0;
+
+	for (i = 0; i < num_recs; i++) {
+		recording *rec = &recs[i];
+
+		if (!rec->active) {
+			continue;
+		}
+
+		/* reader gave up, output failed */
+		pthread_mutex_lock(&rec->tdata.mutex);
+		alive = rec->tdata.alive;
+		pthread_mutex_unlock(&rec->tdata.mutex);
+		if (!alive) {
+			stop_recording(w, rec, "Output failed.");
+			continue;
+		}
+
+		if (rec->tuner.state == TUNER_TUNING) {
+			if (++rec->notune_count >= TUNE_TIMEOUT) {
+				stop_recording(w, rec, "Tune timeout.");
+				continue;
+			}
+		} else if (rec->tuner.state == TUNER_RECOVERING) {
+			rec->noread_count = 0;
+			if (tuner_outage_ms(&rec->tuner) >= (uint64_t)rec->opts.recover * 1000) {
+				stop_recording(w, rec, "Recover timeout.");
+				continue;
+			}
+		} else if (rec->p_r_byte == rec->r_byte) {
+			if (++rec->noread_count >= READ_TIMEOUT) {
+				rec->noread_count = 0;
+				if (!rec->tuner.recover) {
+					stop_recording(w, rec, "Read timeout.");
+					continue;
+				}
+				/* locked but no data, retune */
+				if (tuner_lost(&rec->tuner) != 0) {
+					stop_recording(w, rec, "Retune failed.");
+					continue;
+				}
+			}
+		} else {
+			rec->noread_count = 0;
+			rec->p_r_byte = rec->r_byte;
+		}
+
+		show_stats(rec);
+		active++;
+	}
+
+	return active;
+}
+
+static void read_dvr(writer_pool *w, recording *rec)
+{
+	BUFSZ *bufptr = bufpool_get();
+	ssize_t size;
+
+	if (!bufptr) {
+		/* budget used up, leave data to the driver */
+		char drop[MAX_READ_SIZE];
+		size = read(rec->tuner.dvrfd, drop, sizeof(drop));
+		if (size > 0) {
+			rec->o_byte += (uint64_t)size;
+		}
+		return;
+	}
+
+	bufptr->size = read(rec->tuner.dvrfd, bufptr->buffer, MAX_READ_SIZE);
+	if (bufptr->size <= 0) {
+		bufpool_put(bufptr);
+		return;
+	}
+	size = bufptr->size;
+
+	PROBE3(dvr_read, size, rec->r_byte, trace_now());
+
+	if (rec->r_byte == 0) {
+		rec->first_ns = trace_now();
+		PROBE2(first_byte, rec->opts.dev_num, rec->first_ns);
+	}
+	rec->r_byte += (uint64_t)size;
+	tuner_data(&rec->tuner);
+
+	if (enqueue(rec->tdata.queue, bufptr) != 0) {
+		/* queue is full, dropped */
+		bufpool_put(bufptr);
+		rec->o_byte += (uint64_t)size;
+	}
+	writer_notify(w, &rec->tdata);
+}
+
+static int start_recording(recording *rec, int epfd)
+{
+	thread_data *tdata = &rec->tdata;
+
+	tdata->opts = &rec->opts;
+	tdata->queue = create_queue(MAX_QUEUE);
+	tdata->trace = NULL;
+	tdata->status = READER_EXIT_NOERROR;
+	tdata->alive = 1;
+	tdata->scheduled = 0;
+	tdata->w_byte = 0;
+	tdata->w_count = 0;
+	tdata->w_ns_total = 0;
+	tdata->w_ns_max = 0;
+	tdata->abort = 0;
+	tdata->d_byte = 0;
+	pthread_mutex_init(&tdata->mutex, NULL);
+	if (!tdata->queue) {
+		fprintf(stderr, "Error: Cannot allocate queue.\n");
+		return -1;
+	}
+
+	if (reader_open(tdata) != 0) {
+		reader_show_error(tdata->status);
+		reader_close(tdata);
+		return -1;
+	}
+
+	tuner_init(&rec->tuner, rec->opts.dev_num, rec->opts.fe_num);
+	rec->tuner.recover = rec->opts.recover > 0;
+	if (rec->opts.dev_auto) {
+		if (adapter_claim(&rec->tuner, channel_isdbtype(rec->opts.channel)) != 0) {
+			reader_close(tdata);
+			return -1;
+		}
+		rec->opts.dev_num = rec->tuner.dev_num;
+		rec->opts.fe_num = rec->tuner.fe_num;
+	}
+	if (tuner_start(&rec->tuner, rec->opts.channel, rec->opts.tsid, rec->opts.lnb) != 0 ||
+	    tuner_watch(&rec->tuner, epfd) != 0) {
+		tuner_close(&rec->tuner);
+		reader_close(tdata);
+		return -1;
+	}
+
+	fprintf(stderr, "Info: [%d.%d %s] Recording to %s\n",
+		rec->opts.dev_num, rec->opts.fe_num, rec->opts.channel, rec->opts.destfile);
+	rec->active = 1;
+	return 0;
+}
+
+int multi_main(struct recdvb_options *opts)
+{
+	int i, j;
+	int f_exit = 0;
+	int epfd = -1;
+	int sfd = -1;
+	int tfd = -1;
+	int nfds;
+	int nstdout = 0;
+	int started = 0;
+	int rc = 1;
+	uint64_t start_ns = trace_now();
+	uint64_t drain_ns;
+	struct epoll_event ev, evs[NEVENTS];
+	struct itimerspec interval = {{1, 0}, {1, 0}};
+	sigset_t mask;
+	static writer_pool writers;
+
+	/* first tuner from usual arguments */
+	recs[0].opts = *opts;
+	num_recs = 1;
+	for (i = 0; i < opts->num_add_tuner; i++) {
+		recording *rec = &recs[num_recs];
+
+		rec->opts = *opts;
+		if (parse_spec(rec, opts->add_tuner[i]) != 0) {
+			fprintf(stderr, "Error: Invalid tuner '%s', expected DEV[.FE]:CHANNEL:DESTFILE.\n", opts->add_tuner[i]);
+			return 1;
+		}
+		num_recs++;
+	}
+	for (i = 0; i < num_recs; i++) {
+		nstdout += recs[i].opts.use_stdout ? 1 : 0;
+		for (j = 0; j < i && !recs[i].opts.dev_auto; j++) {
+			if (!recs[j].opts.dev_auto && recs[i].opts.dev_num == recs[j].opts.dev_num && recs[i].opts.fe_num == recs[j].opts.fe_num) {
+				fprintf(stderr, "Error: Device %d.%d is given twice.\n", recs[i].opts.dev_num, recs[i].opts.fe_num);
+				return 1;
+			}
+		}
+	}
+	if (nstdout > 1) {
+		fprintf(stderr, "Error: Only one tuner can write to stdout.\n");
+		return 1;
+	}
+
+	/* all tuners share the budget of one queue */
+	bufpool_init(MAX_QUEUE);
+
+	epfd = epoll_create(NEVENTS);
+	if (epfd == -1) {
+		fprintf(stderr, "Error: failed to call epoll_create. (errno=%d)\n", errno);
+		return 1;
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGPIPE);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+	ev.data.fd = sfd;
+	ev.events = EPOLLIN;
+	if (sfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot create signalfd. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	ev.data.fd = tfd;
+	ev.events = EPOLLIN;
+	if (tfd == -1 || timerfd_settime(tfd, 0, &interval, NULL) == -1 ||
+	    epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot create timerfd. (errno=%d)\n", errno);
+		goto end;
+	}
+
+	if (writer_start(&writers, opts->writers > 0 ? opts->writers : writer_default_threads(num_recs), num_recs) != 0) {
+		goto end;
+	}
+	fprintf(stderr, "Info: %d tuner(s), %d writer thread(s).\n", num_recs, writers.nthreads);
+
+	/* tune all first, they lock in parallel */
+	for (i = 0; i < num_recs; i++) {
+		if (start_recording(&recs[i], epfd) != 0) {
+			fprintf(stderr, "Error: [%d.%d %s] Cannot start recording.\n",
+				recs[i].opts.dev_num, recs[i].opts.fe_num, recs[i].opts.channel);
+			continue;
+		}
+		started++;
+	}
+	if (started == 0) {
+		goto end;
+	}
+	rc = 0;
+
+	start_ns = trace_now();
+	while (!f_exit) {
+		nfds = epoll_wait(epfd, evs, NEVENTS, -1);
+		if (nfds < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: epoll_wait failed. (errno=%d)\n", errno);
+			break;
+		}
+
+		/* stop recording */
+		if (opts->recsec != -1 && (trace_now() - start_ns) / 1000000000 >= (uint64_t)opts->recsec) {
+			break;
+		}
+
+		for (i = 0; i < nfds; ++i) {
+			int fd = evs[i].data.fd;
+
+			if (fd == sfd) {
+				struct signalfd_siginfo info;
+				read(sfd, &info, sizeof(info));
+				fprintf(stderr, "\nInfo: Catch signal.\n");
+				for (j = 0; j < num_recs; j++) {
+					if (recs[j].active) {
+						reader_shutdown(&recs[j].tdata, opts->shutdown_mode);
+					}
+				}
+				f_exit = 1;
+				break;
+			}
+
+			if (fd == tfd) {
+				uint64_t exp;
+				read(tfd, &exp, sizeof(exp));
+				if (check_recordings(&writers) == 0) {
+					fprintf(stderr, "Info: No tuner is recording.\n");
+					f_exit = 1;
+					break;
+				}
+				continue;
+			}
+
+			for (j = 0; j < num_recs; j++) {
+				recording *rec = &recs[j];
+
+				if (!rec->active) {
+					continue;
+				}
+				if (fd == rec->tuner.dvrfd) {
+					if (evs[i].events & EPOLLIN) {
+						read_dvr(&writers, rec);
+					}
+					break;
+				}
+				if (fd == rec->tuner.fefd || fd == rec->tuner.pollfd) {
+					if (tuner_handle(&rec->tuner, fd) == -1) {
+						stop_recording(&writers, rec, "Frontend failed.");
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	fprintf(stderr, "Info: Elapsed time %.2lfsec\n", (trace_now() - start_ns) / 1000000000.0);
+
+end:
+	/* finish outputs, writers exit after last chunk */
+	drain_ns = trace_now();
+	for (i = 0; i < num_recs; i++) {
+		stop_recording(&writers, &recs[i], NULL);
+	}
+	writer_stop(&writers);
+	fprintf(stderr, "Info: Drained in %.1lfms\n", (trace_now() - drain_ns) / 1000000.0);
+
+	for (i = 0; i < num_recs; i++) {
+		recording *rec = &recs[i];
+
+		if (!rec->tdata.queue) {
+			continue;
+		}
+		show_stats(rec);
+		if (rec->first_ns) {
+			fprintf(stderr, "      (Tuning %.2lfsec)\n", (rec->first_ns - start_ns) / 1000000000.0);
+		}
+		if (rec->tuner.outages > 0) {
+			fprintf(stderr, "      Signal lost %lu times, total %.2lfsec\n",
+				rec->tuner.outages, rec->tuner.outage_ns_total / 1000000000.0);
+		}
+		destroy_queue(rec->tdata.queue);
+	}
+	bufpool_destroy();
+
+	if (tfd != -1) {
+		close(tfd);
+	}
+	if (sfd != -1) {
+		close(sfd);
+	}
+	if (epfd != -1) {
+		close(epfd);
+	}
+
+	return rc;
+}
@@ -0,0 +1,33 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_MULTI_H
+#define RECDVB_MULTI_H
+
+#include "recdvb.h"
+
+/*
+ * record from several tuners in one process. one event loop serves
+ * every frontend and dvr, chunks come from the shared buffer pool and
+ * are written by a writer pool (see writer.h). first tuner is the one
+ * given by --dev and the positional arguments, others come from
+ * --add-tuner DEV[.FE]:CHANNEL:DESTFILE.
+ */
+#define MULTI_MAX_TUNERS 16
+
+int multi_main(struct recdvb_options *opts);
+
+#endif
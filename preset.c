@@ -18,6 +18,8 @@
 #include <string.h>
 
 #include "preset.h"
+#include "recdvbcore.h"
+#include "chdb.h"
 
 #define NUM_PRESET_CH 88
 static const struct {
@@ -71,10 +73,35 @@ static const struct {
 	{ "nd22", 0x7160 }, { "nd24", 0x7180 }
 };
 
+/* scanned channels, take precedence over preset_ch */
+static chdb db;
+
+int preset_load(const char *path)
+{
+	chdb_close(&db);
+	if (chdb_open(&db, path) != 0) {
+		return -1;
+	}
+	fprintf(stderr, "Info: Loaded %u channels from %s\n", db.hdr->nentries, path);
+	return 0;
+}
+
+/* loaded database or NULL */
+const chdb *preset_db(void)
+{
+	return db.hdr ? &db : NULL;
+}
+
 void set_bs_tsid(char *pch, unsigned int *tsid)
 {
 	int i;
 	char channel[8] = {0};
+	const chdb_entry *e = chdb_lookup(&db, pch);
+
+	if (e && e->isdbtype == ISDBTYPE_ISDBS) {
+		*tsid = e->tsid;
+		return;
+	}
 	if (((pch[0] == 'b')|| (pch[0] == 'B')) && ((pch[1] == 's') || (pch[1] == 'S'))) {
 		channel[0] = 'b';
 		channel[1] = 's';
@@ -97,3 +124,15 @@ void set_bs_tsid(char *pch, unsigned int *tsid)
 	}
 }
 
+
+/* bs## and nd## are satellite, others terrestrial */
+int channel_isdbtype(const char *channel)
+{
+	if (((channel[0] == 'b') || (channel[0] == 'B')) && ((channel[1] == 's') || (channel[1] == 'S'))) {
+		return ISDBTYPE_ISDBS;
+	}
+	if (((channel[0] == 'n') || (channel[0] == 'N')) && ((channel[1] == 'd') || (channel[1] == 'D'))) {
+		return ISDBTYPE_ISDBS;
+	}
+	return ISDBTYPE_ISDBT;
+}
@@ -17,6 +17,11 @@
 #ifndef RECDVB_PRESET_H
 #define RECDVB_PRESET_H
 
+#include "chdb.h"
+
+int preset_load(const char *path);
+const chdb *preset_db(void);
 void set_bs_tsid(char *pch, unsigned int *tsid);
+int channel_isdbtype(const char *channel);
 
 #endif
@@ -0,0 +1,54 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_PROBE_H
+#define RECDVB_PROBE_H
+
+#ifndef RECDVB_CONFIG_H
+#define RECDVB_CONFIG_H
+#include "config.h"
+#endif
+
+/*
+ * USDT probes, provider "recdvb".
+ *
+ *   dvr_read(size, total_read, ns)
+ *   enqueue(size, depth), enqueue_drop(size, depth)
+ *   dequeue(size, depth)
+ *   b25_decode_entry(size), b25_decode_exit(size, decoded, code)
+ *   write(fd, size, latency_ns)
+ *   tune_start(dev, channel, ns), lock(dev, ns), first_byte(dev, ns)
+ *
+ * ns is CLOCK_MONOTONIC in nanoseconds. arguments are not evaluated
+ * when sys/sdt.h is not available.
+ */
+#ifdef HAVE_SYS_SDT_H
+
+#include <sys/sdt.h>
+
+#define PROBE1(name, a)          DTRACE_PROBE1(recdvb, name, a)
+#define PROBE2(name, a, b)       DTRACE_PROBE2(recdvb, name, a, b)
+#define PROBE3(name, a, b, c)    DTRACE_PROBE3(recdvb, name, a, b, c)
+
+#else
+
+#define PROBE1(name, a)          do {} while (0)
+#define PROBE2(name, a, b)       do {} while (0)
+#define PROBE3(name, a, b, c)    do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "psi.h"
+
+static void table_init(psi_table *t, uint16_t pid)
+{
+	ts_section_init(&t->sec, pid);
+	t->cc = -1;
+	t->len = 0;
+}
+
+void psi_init(psi_cache *c)
+{
+	ts_reader_init(&c->reader);
+	table_init(&c->pat, TS_PID_PAT);
+	c->num_pmt = 0;
+	c->num_video = 0;
+	c->pcr_pid = TS_PID_NULL;
+	c->cur = NULL;
+}
+
+static int is_video(uint8_t type)
+{
+	return type == 0x01 || type == 0x02 || type == 0x1b || type == 0x24;
+}
+
+static void add_video(psi_cache *c, uint16_t pid, uint8_t type)
+{
+	int i;
+
+	for (i = 0; i < c->num_video; i++) {
+		if (c->video_pid[i] == pid) {
+			c->video_type[i] = type;
+			return;
+		}
+	}
+	if (c->num_video < PSI_MAX_VIDEO) {
+		c->video_pid[c->num_video] = pid;
+		c->video_type[c->num_video] = type;
+		c->num_video++;
+	}
+}
+
+static void on_pmt(void *arg, const uint8_t *sec, size_t len)
+{
+	psi_cache *c = arg;
+	psi_table *t = c->cur;
+	size_t i;
+
+	if (sec[0] != 0x02 || len < 16 || len > PSI_SECTION_MAX || ts_crc32(sec, len) != 0) {
+		return;
+	}
+	memcpy(t->data, sec, len);
+	t->len = len;
+	if (t == &c->pmt[0]) {
+		c->pcr_pid = (uint16_t)(((sec[8] & 0x1f) << 8) | sec[9]);
+	}
+
+	/* elementary streams follow program info */
+	i = 12 + (((size_t)(sec[10] & 0x0f) << 8) | sec[11]);
+	while (i + 5 <= len - 4) {
+		uint8_t type = sec[i];
+		uint16_t pid = (uint16_t)(((sec[i + 1] & 0x1f) << 8) | sec[i + 2]);
+
+		if (is_video(type)) {
+			add_video(c, pid, type);
+		}
+		i += 5 + (((size_t)(sec[i + 3] & 0x0f) << 8) | sec[i + 4]);
+	}
+}
+
+static void on_pat(void *arg, const uint8_t *sec, size_t len)
+{
+	psi_cache *c = arg;
+	size_t i;
+
+	if (sec[0] != 0x00 || len < 12 || len > PSI_SECTION_MAX || ts_crc32(sec, len) != 0) {
+		return;
+	}
+
+	/* same as cached, PMT list is valid */
+	if (c->pat.len == len && memcmp(c->pat.data, sec, len) == 0) {
+		return;
+	}
+	memcpy(c->pat.data, sec, len);
+	c->pat.len = len;
+
+	/* program map changed, start over */
+	c->num_pmt = 0;
+	c->num_video = 0;
+	c->pcr_pid = TS_PID_NULL;
+	for (i = 8; i + 4 <= len - 4 && c->num_pmt < PSI_MAX_PMT; i += 4) {
+		uint16_t program = (uint16_t)((sec[i] << 8) | sec[i + 1]);
+		uint16_t pid = (uint16_t)(((sec[i + 2] & 0x1f) << 8) | sec[i + 3]);
+
+		if (program != 0) {
+			table_init(&c->pmt[c->num_pmt++], pid);
+		}
+	}
+}
+
+/* follow PAT/PMT packet by packet */
+void psi_packet(psi_cache *c, const uint8_t *pkt)
+{
+	uint16_t pid = TS_PID(pkt);
+	int i;
+
+	if (pid == TS_PID_PAT) {
+		c->pat.cc = TS_CC(pkt);
+		ts_section_feed(&c->pat.sec, pkt, on_pat, c);
+		return;
+	}
+
+	for (i = 0; i < c->num_pmt; i++) {
+		if (c->pmt[i].sec.pid == pid) {
+			c->pmt[i].cc = TS_CC(pkt);
+			c->cur = &c->pmt[i];
+			ts_section_feed(&c->pmt[i].sec, pkt, on_pmt, c);
+			return;
+		}
+	}
+}
+
+static void on_packet(void *arg, const uint8_t *pkt)
+{
+	psi_packet(arg, pkt);
+}
+
+/* follow PAT/PMT of stream */
+void psi_feed(psi_cache *c, const uint8_t *data, size_t len)
+{
+	ts_reader_feed(&c->reader, data, len, on_packet, c);
+}
+
+/* PAT and every PMT it lists are cached */
+int psi_ready(const psi_cache *c)
+{
+	int i;
+
+	if (c->pat.len == 0 || c->num_pmt == 0) {
+		return 0;
+	}
+	for (i = 0; i < c->num_pmt; i++) {
+		if (c->pmt[i].len == 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* continuity counter of first packet of pid in data, -1 if none */
+static int first_cc(uint16_t pid, const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i + TS_PACKET_SIZE <= len; i += TS_PACKET_SIZE) {
+		if (data[i] == TS_SYNC_BYTE && TS_PID(data + i) == pid && TS_HAS_PAYLOAD(data + i)) {
+			return TS_CC(data + i);
+		}
+	}
+	return -1;
+}
+
+/*
+ * packetize one table ahead of next. continuity counters end just before
+ * the next packet of the pid, so that the stream follows without a gap.
+ * first packet sets discontinuity_indicator, since the consumer may have
+ * seen other packets with these counters.
+ */
+static size_t put_table(const psi_table *t, const uint8_t *next, size_t nlen, uint8_t *buf, size_t len)
+{
+	size_t head = TS_PACKET_SIZE - 7; /* after adaptation field and pointer_field */
+	size_t npkt, off = 0, i;
+	int cc;
+
+	if (t->len == 0) {
+		return 0;
+	}
+	npkt = t->len <= head ? 1 : 1 + (t->len - head + TS_PACKET_SIZE - 5) / (TS_PACKET_SIZE - 4);
+	if (npkt * TS_PACKET_SIZE > len) {
+		return 0;
+	}
+	cc = first_cc(t->sec.pid, next, nlen);
+	if (cc == -1) {
+		cc = t->cc == -1 ? 0 : t->cc + 1;
+	}
+	cc -= (int)npkt;
+
+	for (i = 0; i < npkt; i++) {
+		uint8_t *pkt = buf + i * TS_PACKET_SIZE;
+		size_t room = TS_PACKET_SIZE - 4;
+		size_t n;
+
+		pkt[0] = TS_SYNC_BYTE;
+		pkt[1] = (uint8_t)((i == 0 ? 0x40 : 0x00) | (t->sec.pid >> 8));
+		pkt[2] = (uint8_t)(t->sec.pid & 0xff);
+		pkt[3] = (uint8_t)(0x10 | ((cc + (int)i) & 0x0f));
+		if (i == 0) {
+			pkt[3] |= 0x20;
+			pkt[4] = 1;    /* adaptation_field_length */
+			pkt[5] = 0x80; /* discontinuity_indicator */
+			pkt[6] = 0;    /* pointer_field */
+			room = head;
+		}
+		n = t->len - off < room ? t->len - off : room;
+		memcpy(pkt + TS_PACKET_SIZE - room, t->data + off, n);
+		memset(pkt + TS_PACKET_SIZE - room + n, 0xff, room - n);
+		off += n;
+	}
+
+	return npkt * TS_PACKET_SIZE;
+}
+
+/*
+ * write cached PAT and PMTs as packets to go right before next, which
+ * is packet aligned data not output yet (NULL if none). returns bytes
+ * written.
+ */
+size_t psi_packets_before(psi_cache *c, const uint8_t *next, size_t nlen, uint8_t *buf, size_t len)
+{
+	size_t n, total;
+	int i;
+
+	total = put_table(&c->pat, next, nlen, buf, len);
+	if (total == 0) {
+		return 0;
+	}
+	for (i = 0; i < c->num_pmt; i++) {
+		n = put_table(&c->pmt[i], next, nlen, buf + total, len - total);
+		if (n == 0 && c->pmt[i].len > 0) {
+			break;
+		}
+		total += n;
+	}
+
+	return total;
+}
+
+/* write cached PAT and PMTs as packets after all data fed, returns bytes written */
+size_t psi_packets(psi_cache *c, uint8_t *buf, size_t len)
+{
+	return psi_packets_before(c, NULL, 0, buf, len);
+}
+
+/* sequence header, SPS/IDR or VPS/IDR in first payload of PES */
+static int starts_gop(const uint8_t *pkt, uint8_t type)
+{
+	int off = ts_payload_offset(pkt);
+	const uint8_t *p, *end = pkt + TS_PACKET_SIZE;
+
+	if (off < 0 || off + 9 > TS_PACKET_SIZE) {
+		return 0;
+	}
+	p = pkt + off;
+	if (p[0] != 0 || p[1] != 0 || p[2] != 1) {
+		return 0;
+	}
+	p += 9 + p[8];
+
+	for (; p + 4 <= end; p++) {
+		if (p[0] != 0 || p[1] != 0 || p[2] != 1) {
+			continue;
+		}
+		switch (type) {
+		case 0x1b:
+			if ((p[3] & 0x1f) == 7 || (p[3] & 0x1f) == 5) {
+				return 1;
+			}
+			break;
+		case 0x24:
+			if (((p[3] >> 1) & 0x3f) == 32 || ((p[3] >> 1) & 0x3f) == 19 || ((p[3] >> 1) & 0x3f) == 20) {
+				return 1;
+			}
+			break;
+		default:
+			if (p[3] == 0xb3) {
+				return 1;
+			}
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* packet is video random access point */
+int psi_is_rap(const psi_cache *c, const uint8_t *pkt)
+{
+	int i;
+
+	for (i = 0; i < c->num_video; i++) {
+		if (TS_PID(pkt) != c->video_pid[i]) {
+			continue;
+		}
+		/* random_access_indicator */
+		if (TS_HAS_AF(pkt) && pkt[4] > 0 && (pkt[5] & 0x40)) {
+			return 1;
+		}
+		if (TS_PUSI(pkt) && starts_gop(pkt, c->video_type[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* offset of first video random access point in packet aligned data, or -1 */
+long psi_find_rap(const psi_cache *c, const uint8_t *data, size_t len)
+{
+	size_t off = 0;
+
+	while (off + TS_PACKET_SIZE <= len) {
+		const uint8_t *pkt = data + off;
+
+		if (pkt[0] != TS_SYNC_BYTE) {
+			off++;
+			continue;
+		}
+		if (psi_is_rap(c, pkt)) {
+			return (long)off;
+		}
+		off += TS_PACKET_SIZE;
+	}
+
+	return -1;
+}
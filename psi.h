@@ -0,0 +1,64 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_PSI_H
+#define RECDVB_PSI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ts.h"
+
+#define PSI_MAX_PMT       32
+#define PSI_MAX_VIDEO     32
+#define PSI_SECTION_MAX   1024 /* PAT/PMT limit by ISO/IEC 13818-1 */
+
+/* packets of largest section after adaptation field and pointer_field */
+#define PSI_TABLE_PACKETS (1 + (PSI_SECTION_MAX - (TS_PACKET_SIZE - 7) + TS_PACKET_SIZE - 5) / (TS_PACKET_SIZE - 4))
+/* room for PAT and every PMT from psi_packets */
+#define PSI_PACKETS_SIZE  ((1 + PSI_MAX_PMT) * PSI_TABLE_PACKETS * TS_PACKET_SIZE)
+
+/* latest section of one pid */
+typedef struct psi_table {
+	ts_section sec;            /* reassembly */
+	int cc;                    /* last continuity counter seen, -1 if none */
+	size_t len;                /* 0 if not cached yet */
+	uint8_t data[PSI_SECTION_MAX];
+} psi_table;
+
+/* latest PAT and PMTs of a stream, to be replayed ahead of output */
+typedef struct psi_cache {
+	ts_reader reader;
+	psi_table pat;
+	psi_table pmt[PSI_MAX_PMT];
+	int num_pmt;
+	uint16_t video_pid[PSI_MAX_VIDEO];
+	uint8_t video_type[PSI_MAX_VIDEO];
+	int num_video;
+	uint16_t pcr_pid;          /* of first program, TS_PID_NULL if unknown */
+	psi_table *cur;            /* table being fed */
+} psi_cache;
+
+void psi_init(psi_cache *c);
+void psi_feed(psi_cache *c, const uint8_t *data, size_t len);
+void psi_packet(psi_cache *c, const uint8_t *pkt);
+int psi_ready(const psi_cache *c);
+size_t psi_packets(psi_cache *c, uint8_t *buf, size_t len);
+size_t psi_packets_before(psi_cache *c, const uint8_t *next, size_t nlen, uint8_t *buf, size_t len);
+int psi_is_rap(const psi_cache *c, const uint8_t *pkt);
+long psi_find_rap(const psi_cache *c, const uint8_t *data, size_t len);
+
+#endif
@@ -19,6 +19,7 @@
 #include <sys/time.h>
 
 #include "queue.h"
+#include "probe.h"
 
 #define QUEUE_TIMEOUT 15
 
@@ -34,6 +35,7 @@ QUEUE_T * create_queue(size_t size)
 		p_queue->size = size;
 		p_queue->num_avail = size;
 		p_queue->num_used = 0;
+		p_queue->closed = 0;
 		pthread_mutex_init(&p_queue->mutex, NULL);
 		pthread_cond_init(&p_queue->cond_avail, NULL);
 		pthread_cond_init(&p_queue->cond_used, NULL);
@@ -58,9 +60,10 @@ int enqueue(QUEUE_T *p_queue, BUFSZ *data)
 	pthread_mutex_lock(&p_queue->mutex);
 	/* entered critical section */
 
-	/* quit when queue is full */
-	if (p_queue->num_avail == 0) {
+	/* quit when queue is full or closed */
+	if (p_queue->num_avail == 0 || p_queue->closed) {
 		pthread_mutex_unlock(&p_queue->mutex);
+		PROBE2(enqueue_drop, data ? data->size : 0, p_queue->size);
 		return -1;
 	}
 
@@ -74,6 +77,8 @@ int enqueue(QUEUE_T *p_queue, BUFSZ *data)
 	p_queue->num_avail--;
 	p_queue->num_used++;
 
+	PROBE2(enqueue, data ? data->size : 0, p_queue->num_used);
+
 	/* leaving critical section */
 	pthread_mutex_unlock(&p_queue->mutex);
 	pthread_cond_signal(&p_queue->cond_used);
@@ -81,7 +86,25 @@ int enqueue(QUEUE_T *p_queue, BUFSZ *data)
 	return 0;
 }
 
-/* dequeue data. this function will block if queue is empty. */
+/* take one buffer, called with mutex held and queue not empty */
+static void take(QUEUE_T *p_queue, BUFSZ **data)
+{
+	/* take buffer address */
+	*data = p_queue->buffer[p_queue->out];
+
+	/* move position marker for output to next position */
+	p_queue->out++;
+	p_queue->out %= p_queue->size;
+
+	/* update counters */
+	p_queue->num_avail++;
+	p_queue->num_used--;
+
+	PROBE2(dequeue, *data ? (*data)->size : 0, p_queue->num_used);
+}
+
+/* dequeue data. this function will block if queue is empty.
+ * returns QUEUE_CLOSED once queue is closed and every buffer is taken. */
 int dequeue(QUEUE_T *p_queue, BUFSZ **data)
 {
 	struct timespec now;
@@ -90,35 +113,66 @@ int dequeue(QUEUE_T *p_queue, BUFSZ **data)
 	/* entered the critical section */
 
 	/* wait while queue is empty */
-	if (p_queue->num_used == 0) {
+	if (p_queue->num_used == 0 && !p_queue->closed) {
 
 		clock_gettime(CLOCK_REALTIME_COARSE, &now);
 		now.tv_sec += QUEUE_TIMEOUT;
 
 		pthread_cond_timedwait(&p_queue->cond_used,
 				       &p_queue->mutex, &now);
-
-		if (p_queue->num_used == 0) {
-			pthread_mutex_unlock(&p_queue->mutex);
-			return -1;
-		}
+	}
+	if (p_queue->num_used == 0) {
+		int rc = p_queue->closed ? QUEUE_CLOSED : -1;
+		pthread_mutex_unlock(&p_queue->mutex);
+		return rc;
 	}
 
-	/* take buffer address */
-	*data = p_queue->buffer[p_queue->out];
+	take(p_queue, data);
 
-	/* move position marker for output to next position */
-	p_queue->out++;
-	p_queue->out %= p_queue->size;
+	/* leaving the critical section */
+	pthread_mutex_unlock(&p_queue->mutex);
+	pthread_cond_signal(&p_queue->cond_avail);
 
-	/* update counters */
-	p_queue->num_avail++;
-	p_queue->num_used--;
+	return 0;
+}
+
+/* dequeue data without waiting, returns -1 if queue is empty. */
+int dequeue_nowait(QUEUE_T *p_queue, BUFSZ **data)
+{
+	pthread_mutex_lock(&p_queue->mutex);
+
+	if (p_queue->num_used == 0) {
+		int rc = p_queue->closed ? QUEUE_CLOSED : -1;
+		pthread_mutex_unlock(&p_queue->mutex);
+		return rc;
+	}
+
+	take(p_queue, data);
 
-	/* leaving the critical section */
 	pthread_mutex_unlock(&p_queue->mutex);
 	pthread_cond_signal(&p_queue->cond_avail);
 
 	return 0;
 }
 
+/* number of queued buffers. lock free, so value may be stale. */
+size_t queue_depth(QUEUE_T *p_queue)
+{
+	return __atomic_load_n(&p_queue->num_used, __ATOMIC_RELAXED);
+}
+
+
+/* no more enqueue, wakes up consumer. queued buffers are still dequeued. */
+void queue_close(QUEUE_T *p_queue)
+{
+	pthread_mutex_lock(&p_queue->mutex);
+	__atomic_store_n(&p_queue->closed, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&p_queue->mutex);
+	pthread_cond_broadcast(&p_queue->cond_used);
+}
+
+/* lock free, so value may be stale. */
+int queue_closed(QUEUE_T *p_queue)
+{
+	return __atomic_load_n(&p_queue->closed, __ATOMIC_ACQUIRE);
+}
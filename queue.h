@@ -23,8 +23,24 @@
 
 #define MAX_READ_SIZE           (188 * 87) // 188 * 87 = 16356
 
+/* time stamps of a chunk, see trace.h */
+enum bufsz_stamp {
+	STAMP_READ,
+	STAMP_ENQUEUE,
+	STAMP_DEQUEUE,
+	STAMP_DECODE,
+	STAMP_WRITE,
+	STAMP_MAX,
+};
+
+/* flags of a chunk */
+#define BUFSZ_BOUNDARY 0x01 /* no data, channel changed after this point */
+
 typedef struct _BUFSZ {
 	ssize_t size;
+	unsigned int flags;
+	int refs;                  /* holders, see bufpool_ref() */
+	uint64_t stamp[STAMP_MAX];
 	uint8_t buffer[MAX_READ_SIZE];
 } BUFSZ;
 
@@ -34,6 +50,7 @@ typedef struct _QUEUE_T {
 	size_t size;               // queue size
 	size_t num_avail;          // when fill queue, set to zero.
 	size_t num_used;           // when become empty, set to zero.
+	int closed;                // no more input, see queue_close()
 	pthread_mutex_t mutex;
 	pthread_cond_t cond_avail; // cond for waiting when fill queue
 	pthread_cond_t cond_used;  // cond for waiting when become empty queue
@@ -42,8 +59,15 @@ typedef struct _QUEUE_T {
 
 QUEUE_T *create_queue(size_t size);
 void destroy_queue(QUEUE_T *p_queue);
+/* dequeue result when queue is closed and empty */
+#define QUEUE_CLOSED 1
+
 int enqueue(QUEUE_T *p_queue, BUFSZ *data);
 int dequeue(QUEUE_T *p_queue, BUFSZ **data);
+int dequeue_nowait(QUEUE_T *p_queue, BUFSZ **data);
+size_t queue_depth(QUEUE_T *p_queue);
+void queue_close(QUEUE_T *p_queue);
+int queue_closed(QUEUE_T *p_queue);
 
 #endif
 
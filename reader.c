@@ -24,165 +24,707 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
 
 #include "reader.h"
 
 #include "mkpath.h"
 #include "decoder.h"
 #include "recdvbcore.h"
+#include "probe.h"
+#include "bufpool.h"
+#include "preset.h"
 
 /* maximum write length at once */
 #define SIZE_CHANK 1316
 
-/* this function will be reader thread */
-void *reader_func(void *p)
+/* Mbps of whole transport stream, with some margin */
+#define BITRATE_ISDBS 60
+#define BITRATE_ISDBT 20
+
+static uint64_t elapsed_ns(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)(now.tv_sec - start->tv_sec) * 1000000000 + (uint64_t)now.tv_nsec - (uint64_t)start->tv_nsec;
+}
+
+/* account writeback after write */
+static void writeback_account(thread_data *tdata, int waited, uint64_t ns)
+{
+	if (waited) {
+		__atomic_add_fetch(&tdata->wb_count, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&tdata->wb_ns_total, ns, __ATOMIC_RELAXED);
+		if (ns > tdata->wb_ns_max) {
+			__atomic_store_n(&tdata->wb_ns_max, ns, __ATOMIC_RELAXED);
+		}
+		hist_record(&tdata->wb_hist, ns);
+	}
+	__atomic_store_n(&tdata->wb_dirty, writeback_dirty(tdata->wb), __ATOMIC_RELAXED);
+}
+/* output size for whole recording by expected bitrate, 0 if unknown */
+static uint64_t expected_size(struct recdvb_options *opts)
+{
+	int mbps = opts->bitrate;
+
+	if (opts->recsec <= 0) {
+		return 0;
+	}
+	if (mbps <= 0) {
+		if (!opts->channel) {
+			return 0;
+		}
+		mbps = channel_isdbtype(opts->channel) == ISDBTYPE_ISDBS ? BITRATE_ISDBS : BITRATE_ISDBT;
+	}
+	return (uint64_t)mbps * 1000000 / 8 * (uint64_t)opts->recsec;
+}
+
+/* write whole buffer to output. returns -1 when output cannot be written. */
+static int write_buf(thread_data *tdata, int wfd, ARIB_STD_B25_BUFFER *buf)
+{
+	ssize_t wc = 0;
+	int file_err = 0;
+	int size_remain = buf->size;
+	int offset = 0;
+	struct timespec w_start;
+
+	clock_gettime(CLOCK_MONOTONIC, &w_start);
+	while (size_remain > 0) {
+		size_t ws = size_remain < SIZE_CHANK ? (size_t)size_remain : SIZE_CHANK;
+
+		if (__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED)) {
+			break;
+		}
+
+		/* staged and written in large blocks */
+		if (tdata->shift) {
+			wc = timeshift_write(tdata->shift, buf->data + offset, (size_t)size_remain);
+		} else if (tdata->io) {
+			wc = iosched_write(tdata->io, buf->data + offset, (size_t)size_remain);
+		} else if (tdata->direct) {
+			wc = direct_write(tdata->direct, buf->data + offset, (size_t)size_remain);
+		} else {
+			wc = write(wfd, buf->data + offset, ws);
+		}
+		if (wc < 0) {
+			file_err = 1;
+			break;
+		}
+		if (tdata->hash) {
+			xxh64_update(&tdata->hash->all, buf->data + offset, (size_t)wc);
+			if (tdata->seg) {
+				xxh64_update(&tdata->hash->part, buf->data + offset, (size_t)wc);
+			}
+		}
+		PROBE3(write, wfd, wc, elapsed_ns(&w_start));
+		size_remain -= wc;
+		offset += wc;
+
+		/* keep dirty pages bounded */
+		if (tdata->wb) {
+			uint64_t ns = 0;
+			int waited = writeback_wrote(tdata->wb, (size_t)wc, &ns);
+
+			writeback_account(tdata, waited, ns);
+		}
+	}
+
+	/* count up */
+	{
+		int written = buf->size - size_remain;
+		uint64_t ns = elapsed_ns(&w_start);
+
+		if (written > 0) {
+			__atomic_add_fetch(&tdata->w_byte, (uint64_t)written, __ATOMIC_RELAXED);
+		}
+		__atomic_add_fetch(&tdata->w_count, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&tdata->w_ns_total, ns, __ATOMIC_RELAXED);
+		/* only this thread stores max */
+		if (ns > tdata->w_ns_max) {
+			__atomic_store_n(&tdata->w_ns_max, ns, __ATOMIC_RELAXED);
+		}
+	}
+
+	return file_err ? -1 : 0;
+}
+
+/* add line for finished file to sidecar */
+static void hash_file(output_hash *h, uint64_t digest, const char *path)
+{
+	if (h->fp) {
+		fprintf(h->fp, "%016lx  %s\n", digest, path);
+		fflush(h->fp);
+	}
+}
+
+/* sidecar next to output, or next to manifest of segments */
+static int hash_open(thread_data *tdata)
 {
-	thread_data *tdata = (thread_data *)p;
-	QUEUE_T *p_queue = tdata->queue;
 	struct recdvb_options *opts = tdata->opts;
-	int wfd = -1;
-#ifdef HAVE_LIBARIB25
-	int code;
-	int use_b25 = 0;
-	decoder *decoder = NULL;
-	decoder_options dopt = {
-		opts->round,
-		opts->strip ? 1 : 0,
-		opts->emm ? 1 : 0
-	};
-	ARIB_STD_B25_BUFFER dbuf;
-#endif
+	output_hash *h;
+	char path[SEGMENT_MAX_PATH + 8];
+
+	h = calloc(1, sizeof(output_hash));
+	if (!h) {
+		return -1;
+	}
+	xxh64_reset(&h->all, 0);
+	xxh64_reset(&h->part, 0);
+
+	if (tdata->seg) {
+		const char *dot = strrchr(tdata->seg->manifest, '.');
+		int len = dot ? (int)(dot - tdata->seg->manifest) : (int)strlen(tdata->seg->manifest);
+
+		snprintf(path, sizeof(path), "%.*s.xxh64", len, tdata->seg->manifest);
+	} else if (!opts->use_stdout) {
+		snprintf(path, sizeof(path), "%s.xxh64", opts->destfile);
+	}
+	if (tdata->seg || !opts->use_stdout) {
+		h->fp = fopen(path, "w");
+		if (!h->fp) {
+			fprintf(stderr, "Error: Cannot open hash file %s. (errno=%d)\n", path, errno);
+		}
+	}
+	tdata->hash = h;
+
+	return 0;
+}
+
+static void hash_close(thread_data *tdata)
+{
+	output_hash *h = tdata->hash;
+	uint64_t digest = xxh64_digest(&h->all);
+
+	if (!tdata->seg && !tdata->opts->use_stdout) {
+		hash_file(h, digest, tdata->opts->destfile);
+	}
+	fprintf(stderr, "Info: XXH64 of output is %016lx (%lubyte).\n", digest, h->all.total);
+	if (h->fp) {
+		fclose(h->fp);
+	}
+	free(h);
+	tdata->hash = NULL;
+}
+
+/* queue chunk for main output too, it is one more consumer like extra outputs */
+static void share_chunk(thread_data *tdata, BUFSZ *buf)
+{
+	tee_chunk(tdata->tee, buf);
+	if (!tdata->main_queue) {
+		return;
+	}
+	bufpool_ref(buf);
+	if (enqueue(tdata->main_queue, buf) != 0) {
+		/* behind, extra outputs go on */
+		__atomic_add_fetch(&tdata->l_byte, (uint64_t)buf->size, __ATOMIC_RELAXED);
+		bufpool_put(buf);
+	}
+}
+
+/*
+ * hand decoded data to extra outputs and main output writer. the chunk
+ * itself is shared when it was not decoded, decoder output is copied
+ * once for all outputs.
+ */
+static void tee_out(thread_data *tdata, BUFSZ *qbuf, const ARIB_STD_B25_BUFFER *buf)
+{
+	const uint8_t *p = buf->data;
+	int32_t left = buf->size;
+
+	if (!tdata->tee || left <= 0) {
+		return;
+	}
+	if (qbuf && p == qbuf->buffer && left == qbuf->size) {
+		share_chunk(tdata, qbuf);
+		return;
+	}
+
+	while (left > 0) {
+		BUFSZ *b = bufpool_get();
+		int32_t n = left < MAX_READ_SIZE ? left : MAX_READ_SIZE;
+
+		if (!b) {
+			/* budget used up, outputs miss it like a full queue */
+			return;
+		}
+		memcpy(b->buffer, p, (size_t)n);
+		b->size = n;
+		if (qbuf) {
+			memcpy(b->stamp, qbuf->stamp, sizeof(b->stamp));
+		} else {
+			memset(b->stamp, 0, sizeof(b->stamp));
+		}
+		share_chunk(tdata, b);
+		bufpool_put(b);
+		p += n;
+		left -= n;
+	}
+}
+
+/* write to output, rotating segments on the way */
+static int write_out(thread_data *tdata, ARIB_STD_B25_BUFFER *buf, uint64_t stamp)
+{
+	segmenter *seg = tdata->seg;
+	ARIB_STD_B25_BUFFER part = *buf;
+
+	if (!seg) {
+		if (tdata->idx) {
+			seekidx_feed(tdata->idx, buf->data, (size_t)buf->size);
+		}
+		return write_buf(tdata, tdata->wfd, buf);
+	}
+
+	while (part.size > 0) {
+		size_t n = segment_room(seg, part.data, (size_t)part.size, stamp);
+
+		if (n > 0) {
+			ARIB_STD_B25_BUFFER head = {part.data, (int32_t)n};
+
+			if (write_buf(tdata, tdata->wfd, &head) != 0) {
+				return -1;
+			}
+			segment_wrote(seg, part.data, n);
+		}
+		if (n == (size_t)part.size) {
+			break;
+		}
+		if (tdata->direct && direct_finish(tdata->direct) != 0) {
+			return -1;
+		}
+		if (tdata->io && iosched_finish(tdata->io) != 0) {
+			return -1;
+		}
+		if (tdata->hash) {
+			hash_file(tdata->hash, xxh64_digest(&tdata->hash->part), seg->path);
+			xxh64_reset(&tdata->hash->part, 0);
+		}
+		if (tdata->wb) {
+			uint64_t ns = 0;
+
+			/* queue rest of old segment, do not wait */
+			writeback_finish(tdata->wb, 0, &ns);
+		}
+		if (segment_rotate(seg, stamp) != 0) {
+			return -1;
+		}
+		tdata->wfd = seg->fd;
+		if (tdata->direct) {
+			direct_attach(tdata->direct, tdata->wfd);
+		}
+		if (tdata->io) {
+			/* segment is preallocated by segmenter */
+			iosched_attach(tdata->io, tdata->wfd, tdata->opts->direct, 0);
+		}
+		if (tdata->wb) {
+			writeback_attach(tdata->wb, tdata->wfd, tdata->opts->writeback);
+		}
+		part.data += n;
+		part.size -= (int32_t)n;
+
+		/* PAT/PMT first */
+		{
+			ARIB_STD_B25_BUFFER hbuf = {seg->head, (int32_t)segment_head(seg, seg->head, sizeof(seg->head))};
+
+			if (hbuf.size > 0 && write_buf(tdata, tdata->wfd, &hbuf) == 0) {
+				segment_wrote(seg, seg->head, (size_t)hbuf.size);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* output of decoder, to main output writer if it has one. returns -1 when output cannot be written. */
+static int decoded_out(thread_data *tdata, BUFSZ *qbuf, ARIB_STD_B25_BUFFER *buf)
+{
+	tee_out(tdata, qbuf, buf);
+	if (tdata->main_queue) {
+		return __atomic_load_n(&tdata->main_error, __ATOMIC_RELAXED) ? -1 : 0;
+	}
+	return write_out(tdata, buf, qbuf ? qbuf->stamp[STAMP_READ] : 0);
+}
+
+/* writer of main output when stream is teed, slow disk does not hold up extra outputs */
+static void *main_func(void *p)
+{
+	thread_data *tdata = p;
+	ARIB_STD_B25_BUFFER buf;
 	BUFSZ *qbuf;
-	ARIB_STD_B25_BUFFER sbuf, buf;
+	int rc;
+
+	while ((rc = dequeue(tdata->main_queue, &qbuf)) != QUEUE_CLOSED) {
+		if (rc != 0) {
+			continue;
+		}
+		if (__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED)) {
+			__atomic_add_fetch(&tdata->d_byte, (uint64_t)qbuf->size, __ATOMIC_RELAXED);
+			bufpool_put(qbuf);
+			continue;
+		}
+		if (qbuf->flags & BUFSZ_BOUNDARY) {
+			fprintf(stderr, "Info: Channel boundary at %lubyte.\n",
+				__atomic_load_n(&tdata->w_byte, __ATOMIC_RELAXED));
+			bufpool_put(qbuf);
+			continue;
+		}
+		if (__atomic_load_n(&tdata->main_error, __ATOMIC_RELAXED)) {
+			bufpool_put(qbuf);
+			continue;
+		}
+
+		buf.data = qbuf->buffer;
+		buf.size = (int32_t)qbuf->size;
+		if (write_out(tdata, &buf, qbuf->stamp[STAMP_READ]) != 0) {
+			__atomic_store_n(&tdata->main_error, 1, __ATOMIC_RELAXED);
+		}
+
+		/* decoder flush has no stamps */
+		if (tdata->trace && qbuf->stamp[STAMP_READ]) {
+			qbuf->stamp[STAMP_WRITE] = trace_now();
+			trace_record(tdata->trace, qbuf);
+		}
+		bufpool_put(qbuf);
+	}
+
+	return NULL;
+}
+
+static void main_start(thread_data *tdata)
+{
+	tdata->main_queue = create_queue(TEE_QUEUE_SIZE);
+	if (!tdata->main_queue || pthread_create(&tdata->main_thread, NULL, main_func, tdata) != 0) {
+		fprintf(stderr, "Warning: Cannot start writer of main output, written by reader.\n");
+		destroy_queue(tdata->main_queue);
+		tdata->main_queue = NULL;
+	}
+}
 
-	buf.size = 0;
-	buf.data = NULL;
+/* write what is queued for main output and stop its writer */
+static void main_stop(thread_data *tdata)
+{
+	uint64_t l_byte;
+
+	if (!tdata->main_queue) {
+		return;
+	}
+	queue_close(tdata->main_queue);
+	pthread_join(tdata->main_thread, NULL);
+	destroy_queue(tdata->main_queue);
+	tdata->main_queue = NULL;
+
+	l_byte = __atomic_load_n(&tdata->l_byte, __ATOMIC_RELAXED);
+	if (l_byte > 0) {
+		fprintf(stderr, "Info: Main output dropped %lubyte while behind.\n", l_byte);
+	}
+}
+
+/* start decoder and open output, called once before any chunk */
+int reader_open(thread_data *tdata)
+{
+	struct recdvb_options *opts = tdata->opts;
 
+	tdata->wfd = -1;
+	tdata->seg = NULL;
+	tdata->direct = NULL;
+	tdata->wb = NULL;
+	tdata->io = NULL;
+	tdata->shift = NULL;
+	tdata->idx = NULL;
+	tdata->hash = NULL;
+	tdata->main_queue = NULL;
+	hist_reset(&tdata->wb_hist);
 #ifdef HAVE_LIBARIB25
+	tdata->use_b25 = 0;
+	tdata->decoder = NULL;
+
 	/* initialize decoder */
 	if (opts->b25) {
-		decoder = b25_startup(&dopt);
-		if (decoder == NULL) {
+		decoder_options dopt = {
+			opts->round,
+			opts->strip ? 1 : 0,
+			opts->emm ? 1 : 0
+		};
+
+		tdata->decoder = b25_startup(&dopt);
+		if (tdata->decoder == NULL) {
 			tdata->status = READER_EXIT_EINIT_DECODER;
-			goto end;
+			return -1;
 		}
 		fprintf(stderr, "Info: B25 startup successfully.\n");
-		use_b25 = 1;
+		tdata->use_b25 = 1;
 	}
 #endif
 
 	/* open output file */
-	if (opts->use_stdout) {
-		wfd = 1; /* stdout */
+	if (opts->segment_sec > 0 || opts->segment_bytes > 0) {
+		tdata->seg = calloc(1, sizeof(segmenter));
+		if (!tdata->seg || segment_open(tdata->seg, opts) != 0) {
+			free(tdata->seg);
+			tdata->seg = NULL;
+			tdata->status = READER_EXIT_EOPEN_DESTFILE;
+			return -1;
+		}
+		tdata->wfd = tdata->seg->fd;
+	} else if (opts->use_stdout) {
+		tdata->wfd = 1; /* stdout */
 	} else {
 		int status;
 		char *path = strdup(opts->destfile);
 		char *dir = dirname(path);
 		status = mkpath(dir, 0777);
+		free(path);
 		if (status == -1) {
 			tdata->status = READER_EXIT_EMKPATH;
-			goto end;
+			return -1;
+		}
+
+		/* fixed size ring, nothing else applies to it */
+		if (opts->timeshift > 0) {
+			tdata->shift = calloc(1, sizeof(timeshift));
+			if (!tdata->shift || timeshift_open(tdata->shift, opts->destfile, opts->timeshift) != 0) {
+				free(tdata->shift);
+				tdata->shift = NULL;
+				tdata->status = READER_EXIT_EOPEN_DESTFILE;
+				return -1;
+			}
+			tdata->wfd = tdata->shift->fd;
+			return 0;
 		}
-		free(path);
 
-		wfd = open(opts->destfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
-		if (wfd < 0) {
+		tdata->wfd = open(opts->destfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (tdata->wfd < 0) {
 			tdata->status = READER_EXIT_EOPEN_DESTFILE;
-			goto end;
+			return -1;
+		}
+
+		/* recording goes on without index */
+		if (opts->index > 0) {
+			tdata->idx = calloc(1, sizeof(seekidx));
+			if (tdata->idx && seekidx_open(tdata->idx, opts->destfile, opts->index) != 0) {
+				free(tdata->idx);
+				tdata->idx = NULL;
+			}
 		}
 	}
 
-	while (1) {
-		ssize_t wc = 0;
-		int file_err = 0;
+	if (opts->hash) {
+		hash_open(tdata);
+	}
 
-		if (dequeue(p_queue, &qbuf) != 0) {
-			/* no queue timeout */
-			tdata->status = READER_EXIT_TIMEOUT;
-			break;
+	/* extents are written and flushed in turn with other recordings */
+	if (opts->extent > 0 && !opts->use_stdout) {
+		tdata->io = calloc(1, sizeof(iosched));
+		if (tdata->io && iosched_init(tdata->io, (size_t)opts->extent) == 0) {
+			iosched_attach(tdata->io, tdata->wfd, opts->direct, tdata->seg ? 0 : expected_size(opts));
+		} else {
+			free(tdata->io);
+			tdata->io = NULL;
 		}
+	}
 
-		/* normal exit */
-		if (qbuf == NULL) {
-			break;
+	/* bypass page cache, buffered write if it is not possible */
+	if (opts->direct && !opts->use_stdout && !tdata->io) {
+		tdata->direct = calloc(1, sizeof(direct_writer));
+		if (tdata->direct && direct_init(tdata->direct) == 0) {
+			direct_attach(tdata->direct, tdata->wfd);
+		} else {
+			free(tdata->direct);
+			tdata->direct = NULL;
 		}
+	}
 
-		sbuf.data = qbuf->buffer;
-		sbuf.size = (int32_t)qbuf->size;
+	/* page cache is used, flush in windows */
+	if (opts->writeback > 0 && !opts->use_stdout && !tdata->io && !(tdata->direct && tdata->direct->enabled)) {
+		tdata->wb = calloc(1, sizeof(writeback));
+		if (tdata->wb) {
+			writeback_attach(tdata->wb, tdata->wfd, opts->writeback);
+		}
+	}
 
-		buf = sbuf; /* default */
+	return 0;
+}
 
+/* decode and write one chunk, chunk is released. returns -1 when output cannot be written. */
+int reader_process(thread_data *tdata, BUFSZ *qbuf)
+{
+	int file_err = 0;
+	ARIB_STD_B25_BUFFER sbuf, buf;
 #ifdef HAVE_LIBARIB25
-		if (use_b25) {
-			code = b25_decode(decoder, &sbuf, &dbuf);
-			if (code < 0) {
-				fprintf(stderr, "Error: b25_decode failed (code=%d).\n", code);
-				fprintf(stderr, "       fall back to encrypted recording.\n");
-				use_b25 = 0;
-			} else {
-				buf = dbuf;
-			}
-		}
+	int code;
+	ARIB_STD_B25_BUFFER dbuf;
 #endif
 
-		/* write data to output file */
-		int size_remain = buf.size;
-		int offset = 0;
+	/* shutting down without drain */
+	if (__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED)) {
+		__atomic_add_fetch(&tdata->d_byte, (uint64_t)qbuf->size, __ATOMIC_RELAXED);
+		bufpool_put(qbuf);
+		return 0;
+	}
 
-		while (size_remain > 0) {
-			size_t ws = size_remain < SIZE_CHANK ? (size_t)size_remain : SIZE_CHANK;
+	if (tdata->trace) {
+		qbuf->stamp[STAMP_DEQUEUE] = trace_now();
+	}
 
-			wc = write(wfd, buf.data + offset, ws);
-			if (wc < 0) {
-				file_err = 1;
-				break;
+	/* channel changed */
+	if (qbuf->flags & BUFSZ_BOUNDARY) {
+		if (!tdata->main_queue) {
+			fprintf(stderr, "Info: Channel boundary at %lubyte.\n",
+				__atomic_load_n(&tdata->w_byte, __ATOMIC_RELAXED));
+		}
+#ifdef HAVE_LIBARIB25
+		if (tdata->use_b25) {
+			/* write out data held by decoder and start over */
+			code = b25_finish(tdata->decoder, &dbuf);
+			if (code >= 0 && dbuf.size > 0) {
+				file_err = decoded_out(tdata, NULL, &dbuf);
 			}
-			size_remain -= wc;
-			offset += wc;
+			b25_reset(tdata->decoder);
+		}
+#endif
+		if (tdata->tee) {
+			tee_boundary(tdata->tee);
 		}
+		/* main output writer reports it in order */
+		if (tdata->main_queue && enqueue(tdata->main_queue, qbuf) == 0) {
+			return file_err;
+		}
+		bufpool_put(qbuf);
+		return file_err;
+	}
 
-		free(qbuf);
-		qbuf = NULL;
-		
-		/* count up */
-		if (pthread_mutex_lock(&tdata->mutex) == 0) {
-			int written = buf.size - size_remain;
+	sbuf.data = qbuf->buffer;
+	sbuf.size = (int32_t)qbuf->size;
 
-			if (written > 0) {
-				tdata->w_byte += (uint64_t)written;
-			}
+	buf = sbuf; /* default */
 
-			pthread_mutex_unlock(&tdata->mutex);
+#ifdef HAVE_LIBARIB25
+	if (tdata->use_b25) {
+		code = b25_decode(tdata->decoder, &sbuf, &dbuf);
+		if (code < 0) {
+			fprintf(stderr, "Error: b25_decode failed (code=%d).\n", code);
+			fprintf(stderr, "       fall back to encrypted recording.\n");
+			tdata->use_b25 = 0;
+		} else {
+			buf = dbuf;
 		}
+	}
+#endif
 
-		/* cannot write file */
-		if (file_err) {
-			break;
-		}
+	if (tdata->trace) {
+		qbuf->stamp[STAMP_DECODE] = trace_now();
+	}
 
-	} /* while (1) */
+	/* decoded once, shared with extra outputs */
+	file_err = decoded_out(tdata, qbuf, &buf);
 
-end:
+	/* traced by main output writer when it has one */
+	if (tdata->trace && !tdata->main_queue) {
+		qbuf->stamp[STAMP_WRITE] = trace_now();
+		trace_record(tdata->trace, qbuf);
+	}
+
+	bufpool_put(qbuf);
+
+	return file_err;
+}
 
+/* flush decoder, close output and mark reader finished */
+void reader_close(thread_data *tdata)
+{
 #ifdef HAVE_LIBARIB25
-	if (use_b25) {
-		code = b25_finish(decoder, &dbuf);
+	int code;
+	ARIB_STD_B25_BUFFER dbuf;
+
+	if (tdata->use_b25) {
+		code = b25_finish(tdata->decoder, &dbuf);
 		if (code < 0) {
 			tdata->status = READER_EXIT_EB25FINISH;
+		} else if (dbuf.size > 0 && tdata->wfd >= 0) {
+			decoded_out(tdata, NULL, &dbuf);
 		}
 	}
 #endif
 
+	/* main output writer finishes before output is closed */
+	main_stop(tdata);
+
+	uint64_t close_start = trace_now();
+
+	/* write staged data */
+	if (tdata->direct) {
+		direct_finish(tdata->direct);
+		direct_destroy(tdata->direct);
+		free(tdata->direct);
+		tdata->direct = NULL;
+	}
+
+	if (tdata->io) {
+		iosched *io = tdata->io;
+
+		iosched_finish(io);
+		if (io->extents > 0) {
+			fprintf(stderr, "Info: Wrote %lu extents, waited for disk %.1lfms avg, %.1lfms max.\n",
+				io->extents, (double)io->wait_ns_total / io->extents / 1e6, (double)io->wait_ns_max / 1e6);
+		}
+		if (io->lock_timeouts > 0) {
+			fprintf(stderr, "Info: %lu extents written unordered after lock timeout.\n", io->lock_timeouts);
+		}
+		iosched_destroy(io);
+		free(io);
+		tdata->io = NULL;
+	}
+
+	/* little is left for fsync after this */
+	if (tdata->wb) {
+		uint64_t ns = 0;
+		int waited = 0;
+
+		if (!__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED)) {
+			waited = writeback_finish(tdata->wb, 1, &ns);
+		}
+		writeback_account(tdata, waited, ns);
+		free(tdata->wb);
+		tdata->wb = NULL;
+	}
+
+	if (tdata->idx) {
+		seekidx_close(tdata->idx);
+		free(tdata->idx);
+		tdata->idx = NULL;
+	}
+
+	if (tdata->hash) {
+		if (tdata->seg && tdata->seg->fd != -1) {
+			hash_file(tdata->hash, xxh64_digest(&tdata->hash->part), tdata->seg->path);
+		}
+		hash_close(tdata);
+	}
+
 	/* close output file */
-	if (wfd > 0 && !opts->use_stdout) {
-		fsync(wfd);
-		close(wfd);
+	if (tdata->shift) {
+		timeshift_close(tdata->shift);
+		free(tdata->shift);
+		tdata->shift = NULL;
+	} else if (tdata->seg) {
+		segment_close(tdata->seg, !__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED));
+		free(tdata->seg);
+		tdata->seg = NULL;
+	} else if (tdata->wfd > 0 && !tdata->opts->use_stdout) {
+		if (!__atomic_load_n(&tdata->abort, __ATOMIC_RELAXED)) {
+			fsync(tdata->wfd);
+		}
+		close(tdata->wfd);
 	}
+	tdata->wfd = -1;
+	__atomic_store_n(&tdata->close_ns, trace_now() - close_start, __ATOMIC_RELAXED);
 
 #ifdef HAVE_LIBARIB25
 	/* release decoder */
-	if (decoder != NULL) {
-		b25_shutdown(decoder);
+	if (tdata->decoder != NULL) {
+		b25_shutdown(tdata->decoder);
+		tdata->decoder = NULL;
 	}
 #endif
 
@@ -190,6 +732,67 @@ end:
 		tdata->alive = 0;
 		pthread_mutex_unlock(&tdata->mutex);
 	}
+}
+
+/* decide whether queued data is written on signal, see enum shutdown_mode */
+void reader_shutdown(thread_data *tdata, int mode)
+{
+	struct stat st;
+
+	if (mode == SHUTDOWN_DRAIN) {
+		return;
+	}
+	if (mode == SHUTDOWN_AUTO && tdata->wfd >= 0 &&
+	    fstat(tdata->wfd, &st) == 0 && S_ISREG(st.st_mode)) {
+		return;
+	}
+	__atomic_store_n(&tdata->abort, 1, __ATOMIC_RELAXED);
+}
+
+/* this function will be reader thread */
+void *reader_func(void *p)
+{
+	thread_data *tdata = (thread_data *)p;
+	QUEUE_T *p_queue = tdata->queue;
+	struct recdvb_options *opts = tdata->opts;
+	BUFSZ *qbuf;
+	int rc;
+
+	if (reader_open(tdata) != 0) {
+		goto end;
+	}
+
+	/* main output is written like extra outputs, on own thread */
+	if (tdata->tee) {
+		main_start(tdata);
+	}
+
+	while (1) {
+		rc = dequeue(p_queue, &qbuf);
+
+		/* normal exit, queue closed and drained */
+		if (rc == QUEUE_CLOSED) {
+			break;
+		}
+
+		if (rc != 0) {
+			/* main thread is retuning, keep waiting */
+			if (opts->recover > 0 || opts->control_path) {
+				continue;
+			}
+			/* no queue timeout */
+			tdata->status = READER_EXIT_TIMEOUT;
+			break;
+		}
+
+		/* cannot write file */
+		if (reader_process(tdata, qbuf) != 0) {
+			break;
+		}
+	}
+
+end:
+	reader_close(tdata);
 
 	return NULL;
 }
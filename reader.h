@@ -17,11 +17,23 @@
 #ifndef RECDVB_READER_H
 #define RECDVB_READER_H
 
+#include <stdio.h>
 #include <pthread.h>
 #include <stdint.h>
 
 #include "recdvb.h"
 #include "queue.h"
+#include "trace.h"
+#include "decoder.h"
+#include "segment.h"
+#include "direct.h"
+#include "writeback.h"
+#include "iosched.h"
+#include "timeshift.h"
+#include "seekidx.h"
+#include "xxhash.h"
+#include "histogram.h"
+#include "tee.h"
 
 /* enum definitions */
 enum reader_exit_status {
@@ -34,15 +46,58 @@ enum reader_exit_status {
 };
 
 /* type definitions */
+
+/* hash of bytes written, whole and per segment */
+typedef struct output_hash {
+	xxh64_state all;
+	xxh64_state part;          /* current segment */
+	FILE *fp;                  /* sidecar in xxhsum format, NULL if none */
+} output_hash;
+
 typedef struct thread_data {
 	struct recdvb_options *opts;
 	QUEUE_T *queue;
+	trace *trace;              /* NULL if tracing is disabled */
 	pthread_mutex_t mutex;
 	enum reader_exit_status status;
 	int alive;
+	int wfd;
+#ifdef HAVE_LIBARIB25
+	int use_b25;
+	decoder *decoder;
+#endif
+	segmenter *seg;            /* NULL unless output is segmented */
+	direct_writer *direct;     /* NULL unless writing with O_DIRECT */
+	writeback *wb;             /* NULL unless flushing in windows */
+	iosched *io;               /* NULL unless writing in extents */
+	timeshift *shift;          /* NULL unless output is timeshift ring */
+	seekidx *idx;              /* NULL unless seek index is written */
+	output_hash *hash;         /* NULL unless hashing output */
+	tee_group *tee;            /* NULL unless stream goes to more outputs */
+	QUEUE_T *main_queue;       /* decoded chunks for main output, NULL if written inline */
+	pthread_t main_thread;
+	int main_error;            /* set atomically when main output cannot be written */
+	int scheduled;             /* waiting for or owned by a writer, see writer.h */
+	int abort;                 /* set atomically, drop queued data and skip fsync */
+	/* following counters are updated atomically, read without mutex */
 	uint64_t w_byte;
+	uint64_t w_count;
+	uint64_t w_ns_total;
+	uint64_t w_ns_max;
+	uint64_t d_byte;           /* dropped by abort */
+	uint64_t l_byte;           /* dropped while main output was behind extra outputs */
+	uint64_t wb_dirty;         /* written but not flushed */
+	uint64_t wb_count;         /* waits for writeback */
+	uint64_t wb_ns_total;
+	uint64_t wb_ns_max;
+	uint64_t close_ns;         /* final flush and close of output */
+	histogram wb_hist;         /* wait latency, read after reader finished */
 } thread_data;
 
+int reader_open(thread_data *tdata);
+int reader_process(thread_data *tdata, BUFSZ *qbuf);
+void reader_close(thread_data *tdata);
+void reader_shutdown(thread_data *tdata, int mode);
 void *reader_func(void *p);
 void reader_show_error(enum reader_exit_status s);
 
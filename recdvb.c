@@ -22,6 +22,7 @@
 #include <errno.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include <sys/epoll.h>
 #include <sys/timerfd.h>
@@ -30,14 +31,73 @@
 #include "recdvb.h"
 
 #include "recdvbcore.h"
+#include "tuner.h"
 #include "time.h"
 #include "queue.h"
 #include "reader.h"
 #include "preset.h"
+#include "metrics.h"
+#include "sock.h"
+#include "control.h"
+#include "probe.h"
+#include "daemon.h"
+#include "bufpool.h"
+#include "multi.h"
+#include "adapter.h"
+#include "scan.h"
+#include "chdb.h"
+#include "epg.h"
+#include "psi.h"
+#include "segment.h"
+#include "iosched.h"
+#include "timeshift.h"
+#include "tee.h"
 
 #define NEVENTS 32
 #define TUNE_TIMEOUT 5
 #define READ_TIMEOUT 5
+#define TUNE_LEAD_SEC 20           /* tune this long before --start-at and --preroll */
+#define PREROLL_MAX_SEC 300        /* longest --preroll */
+#define PREROLL_CHUNKS_PER_SEC 512 /* about twice BS rate in full chunks */
+#define DRAIN_GRACE_MSEC 500       /* wait after abort when drain timed out */
+#define WAIT_RAP_SEC 5             /* give up waiting for random access point */
+
+/* long options without short form */
+enum {
+	OPT_METRICS = 0x100,
+	OPT_TRACE,
+	OPT_RECOVER,
+	OPT_CONTROL,
+	OPT_DAEMON,
+	OPT_CONNECT,
+	OPT_ADD_TUNER,
+	OPT_WRITERS,
+	OPT_SCAN,
+	OPT_CHDB,
+	OPT_EPG,
+	OPT_START_AT,
+	OPT_END_AT,
+	OPT_PREROLL,
+	OPT_SHUTDOWN,
+	OPT_DRAIN_TIMEOUT,
+	OPT_NO_PSI_INJECT,
+	OPT_WAIT_RAP,
+	OPT_SEGMENT,
+	OPT_SEGMENT_SIZE,
+	OPT_SEGMENT_PSI,
+	OPT_MANIFEST,
+	OPT_DIRECT,
+	OPT_WRITEBACK,
+	OPT_EXTENT,
+	OPT_BITRATE,
+	OPT_TIMESHIFT,
+	OPT_INDEX,
+	OPT_HASH,
+	OPT_OUTPUT,
+	OPT_RING,
+	OPT_RING_SIZE,
+	OPT_SERVE,
+};
 
 static const char short_options[] = "br:smn:d:hvi:t:c";
 static const struct option long_options[] = {
@@ -55,14 +115,106 @@ static const struct option long_options[] = {
 	{ "help",      0, NULL, 'h'},
 	{ "version",   0, NULL, 'v'},
 	{ "tsid",      1, NULL, 't'},
+	{ "metrics",   1, NULL, OPT_METRICS},
+	{ "trace",     1, NULL, OPT_TRACE},
+	{ "recover",   1, NULL, OPT_RECOVER},
+	{ "control",   1, NULL, OPT_CONTROL},
+	{ "daemon",    1, NULL, OPT_DAEMON},
+	{ "connect",   1, NULL, OPT_CONNECT},
+	{ "add-tuner", 1, NULL, OPT_ADD_TUNER},
+	{ "writers",   1, NULL, OPT_WRITERS},
+	{ "scan",      1, NULL, OPT_SCAN},
+	{ "chdb",      1, NULL, OPT_CHDB},
+	{ "epg",       1, NULL, OPT_EPG},
+	{ "start-at",  1, NULL, OPT_START_AT},
+	{ "end-at",    1, NULL, OPT_END_AT},
+	{ "preroll",   1, NULL, OPT_PREROLL},
+	{ "shutdown",  1, NULL, OPT_SHUTDOWN},
+	{ "drain-timeout", 1, NULL, OPT_DRAIN_TIMEOUT},
+	{ "no-psi-inject", 0, NULL, OPT_NO_PSI_INJECT},
+	{ "wait-rap",  0, NULL, OPT_WAIT_RAP},
+	{ "segment",   1, NULL, OPT_SEGMENT},
+	{ "segment-size", 1, NULL, OPT_SEGMENT_SIZE},
+	{ "segment-psi", 0, NULL, OPT_SEGMENT_PSI},
+	{ "manifest",  1, NULL, OPT_MANIFEST},
+	{ "direct",    0, NULL, OPT_DIRECT},
+	{ "writeback", 1, NULL, OPT_WRITEBACK},
+	{ "extent",    1, NULL, OPT_EXTENT},
+	{ "bitrate",   1, NULL, OPT_BITRATE},
+	{ "timeshift", 1, NULL, OPT_TIMESHIFT},
+	{ "index",     1, NULL, OPT_INDEX},
+	{ "hash",      0, NULL, OPT_HASH},
+	{ "output",    1, NULL, OPT_OUTPUT},
+	{ "ring",      1, NULL, OPT_RING},
+	{ "ring-size", 1, NULL, OPT_RING_SIZE},
+	{ "serve",     1, NULL, OPT_SERVE},
 	{ 0,           0, NULL,  0 } /* terminate */
 };
 
 static const char options_desc[] =
 "Common options:\n"
-"  -d, --dev N:             Use DVB device /dev/dvb/adapterN\n"
+"  -d, --dev N[.F]:         Use DVB device /dev/dvb/adapterN (frontendF)\n"
+"      --dev auto:          Use first free tuner for the channel\n"
 "  -h, --help:              Show this help\n"
 "  -v, --version:           Show version\n"
+"  --metrics PATH:          Serve JSON metrics on unix socket PATH\n"
+"  --trace SEC:             Trace chunk latency, dump every SEC seconds\n"
+"                           (0 dumps at exit only)\n"
+"  --recover SEC:           Retune on signal loss, give up after SEC seconds\n"
+"  --start-at TIME:         Tune early, start output at TIME\n"
+"  --end-at TIME:           End output at TIME (overrides rectime)\n"
+"                           TIME is YYYY-MM-DDTHH:MM:SS[.mmm], HH:MM[:SS],\n"
+"                           +SEC or @EPOCH\n"
+"  --preroll SEC:           Also output SEC seconds before --start-at\n"
+"                           (300 at most, tunes that much earlier)\n"
+"  --control PATH:          Accept commands on unix socket PATH\n"
+"                           (\"tune CHANNEL [TSID]\" switches channel)\n"
+"  --daemon PATH:           Run as tuner daemon serving clients on PATH,\n"
+"                           --dev takes a list of devices (e.g. 0,1,2)\n"
+"  --connect PATH:          Record through the daemon listening on PATH\n"
+"  --add-tuner DEV[.F]:CHANNEL:DESTFILE:\n"
+"                           Record another tuner in this process, repeatable\n"
+"  --writers N:             Decode/write threads shared by tuners\n"
+"                           (default is number of tuners, at most cores)\n"
+"  --scan PATH:             Scan all channels with free tuners, write\n"
+"                           channel database to PATH\n"
+"  --chdb PATH:             Load channel database (default " CHDB_DEFAULT_PATH ")\n"
+"  --epg PATH [channel...]: Collect EPG sections of channels (default all\n"
+"                           in channel database) with free tuners\n"
+"  --shutdown MODE:         On signal, drain|abort|auto queued data\n"
+"                           auto drains to file, aborts pipe output\n"
+"  --drain-timeout SEC:     Drop data not written SEC after stop\n"
+"  --no-psi-inject:         Do not repeat cached PAT/PMT at output start\n"
+"                           and after resync (single tuner only)\n"
+"  --wait-rap:              Start output at video random access point\n"
+"                           (single tuner only)\n"
+"  --segment TIME:          Split output every TIME (e.g. 30m)\n"
+"  --segment-size SIZE:     Split output at SIZE bytes (K, M, G suffix)\n"
+"                           destfile may have %%N (index) and strftime\n"
+"                           conversions, otherwise index goes before extension\n"
+"  --segment-psi:           Start each segment with PAT/PMT\n"
+"  --manifest PATH:         Write segment playlist to PATH\n"
+"  --direct:                Write output file with O_DIRECT\n"
+"  --writeback SIZE:        Flush output every SIZE bytes (e.g. 8M)\n"
+"  --extent SIZE:           Write output in SIZE extents, one recording at a time\n"
+"                           per disk (e.g. 8M)\n"
+"  --bitrate MBPS:          Expected bitrate to preallocate output\n"
+"                           (default 60 for BS/CS, 20 for terrestrial)\n"
+"  --timeshift SIZE:        Write output to ring file of SIZE bytes for live\n"
+"                           viewing, see timeshift.h for layout\n"
+"  --index MSEC:            Write seek index to DESTFILE.idx, an entry at\n"
+"                           video random access points every MSEC\n"
+"  --hash:                  Write XXH64 of output (and each segment) to\n"
+"                           DESTFILE.xxh64, check with xxhsum -c\n"
+"  --output FILTER:DEST:    Write stream also to DEST ('-' for stdout), may be\n"
+"                           repeated. FILTER is ts, nonull or sid=SID, joined\n"
+"                           by comma (e.g. sid=1024,nonull:-)\n"
+"  --ring PATH:             Publish stream in shared memory ring, local readers\n"
+"                           attach through unix socket PATH (see shmring.h)\n"
+"  --ring-size SIZE:        Size of ring (default 64M)\n"
+"  --serve ADDR:            Serve stream to local clients on unix socket ADDR,\n"
+"                           or over HTTP if ADDR is HOST:PORT or :PORT\n"
+"                           (loopback addresses only)\n"
 #ifdef HAVE_LIBARIB25
 "\n"
 "B25 options:\n"
@@ -85,7 +237,29 @@ static void show_usage(char *cmd)
 		"[--dev devicenumber] "
 		"[--lnb voltage] "
 		"[--tsid TSID] "
+		"[--metrics PATH] "
+		"[--trace SEC] "
+		"[--recover SEC] "
+		"[--start-at TIME] [--end-at TIME] [--preroll SEC] "
+		"[--control PATH] "
+		"[--shutdown MODE] [--drain-timeout SEC] "
+		"[--no-psi-inject] [--wait-rap] "
+		"[--segment TIME] [--segment-size SIZE] [--segment-psi] [--manifest PATH] "
+		"[--direct] [--writeback SIZE] [--extent SIZE] [--bitrate MBPS] "
+		"[--timeshift SIZE] [--index MSEC] [--hash] [--output FILTER:DEST ...] "
+		"[--ring PATH] [--ring-size SIZE] [--serve ADDR] "
+		"[--connect PATH] "
+		"[--add-tuner DEV[.F]:CHANNEL:DESTFILE ...] [--writers N] "
 		"channel rectime destfile\n", cmd);
+	fprintf(stderr, "%s "
+#ifdef HAVE_LIBARIB25
+		"[--b25 [--round N] [--strip] [--EMM]] "
+#endif
+		"[--dev N[,N...]] "
+		"[--lnb voltage] "
+		"--daemon PATH\n", cmd);
+	fprintf(stderr, "%s [--lnb voltage] --scan PATH\n", cmd);
+	fprintf(stderr, "%s [--lnb voltage] [--chdb PATH] --epg PATH [channel...]\n", cmd);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "Remarks:\n");
 	fprintf(stderr, "if channel begins with 'bs##' or 'nd##', "
@@ -114,6 +288,32 @@ static void show_version(char **argv)
 	fprintf(stderr, "recorder command for DVB tuner.\n");
 }
 
+/* bytes with optional K, M or G suffix */
+static int parse_size(const char *str, uint64_t *bytes)
+{
+	char *end;
+	double v = strtod(str, &end);
+
+	switch (*end) {
+	case 'G': case 'g':
+		v *= 1024;
+		/* fall through */
+	case 'M': case 'm':
+		v *= 1024;
+		/* fall through */
+	case 'K': case 'k':
+		v *= 1024;
+		end++;
+		break;
+	}
+	if (end == str || *end != '\0' || v < 0) {
+		return -1;
+	}
+	*bytes = (uint64_t)v;
+
+	return 0;
+}
+
 static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 {
 	int rc;
@@ -127,6 +327,22 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 	char *tsidstr = NULL;
 	char *recsecstr = NULL;
 	char *dev_numstr = NULL;
+	char *tracestr = NULL;
+	char *recoverstr = NULL;
+	char *writersstr = NULL;
+	char *startstr = NULL;
+	char *endstr = NULL;
+	char *prerollstr = NULL;
+	char *shutdownstr = NULL;
+	char *drainstr = NULL;
+	char *segmentstr = NULL;
+	char *segsizestr = NULL;
+	char *writebackstr = NULL;
+	char *extentstr = NULL;
+	char *bitratestr = NULL;
+	char *timeshiftstr = NULL;
+	char *indexstr = NULL;
+	char *ringsizestr = NULL;
 #ifdef HAVE_LIBARIB25
 	char *roundstr = NULL;
 #endif
@@ -134,11 +350,49 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 	/* set defaults */
 	opts->lnb = 0;
 	opts->dev_num = 0;
+	opts->fe_num = 0;
+	opts->dev_auto = false;
 	opts->tsid = 0;
 	opts->destfile = NULL;
 	opts->channel = NULL;
 	opts->recsec = 0;
 	opts->use_stdout = false;
+	opts->metrics_path = NULL;
+	opts->trace_interval = -1;
+	opts->recover = 0;
+	opts->control_path = NULL;
+	opts->daemon_path = NULL;
+	opts->connect_path = NULL;
+	opts->devices = NULL;
+	opts->num_add_tuner = 0;
+	opts->writers = 0;
+	opts->scan_path = NULL;
+	opts->chdb_path = NULL;
+	opts->epg_path = NULL;
+	opts->start_at = 0;
+	opts->end_at = 0;
+	opts->preroll = 0;
+	opts->shutdown_mode = SHUTDOWN_DRAIN;
+	opts->drain_timeout = 0;
+	opts->psi_inject = true;
+	opts->wait_rap = false;
+	opts->segment_sec = 0;
+	opts->segment_bytes = 0;
+	opts->segment_psi = false;
+	opts->manifest_path = NULL;
+	opts->direct = false;
+	opts->writeback = 0;
+	opts->extent = 0;
+	opts->bitrate = 0;
+	opts->timeshift = 0;
+	opts->index = 0;
+	opts->hash = false;
+	opts->num_outputs = 0;
+	opts->ring_path = NULL;
+	opts->ring_size = SHMRING_SIZE_DEFAULT;
+	opts->serve_addr = NULL;
+	opts->epg_channels = NULL;
+	opts->num_epg_channels = 0;
 #ifdef HAVE_LIBARIB25
 	opts->b25 = false;
 	opts->strip = false;
@@ -179,6 +433,114 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 		case 't':
 			tsidstr = optarg;
 			break;
+		case OPT_METRICS:
+			opts->metrics_path = optarg;
+			break;
+		case OPT_TRACE:
+			tracestr = optarg;
+			break;
+		case OPT_RECOVER:
+			recoverstr = optarg;
+			break;
+		case OPT_CONTROL:
+			opts->control_path = optarg;
+			break;
+		case OPT_DAEMON:
+			opts->daemon_path = optarg;
+			break;
+		case OPT_CONNECT:
+			opts->connect_path = optarg;
+			break;
+		case OPT_ADD_TUNER:
+			if (opts->num_add_tuner == RECDVB_MAX_ADD_TUNERS) {
+				fprintf(stderr, "Error: Too many tuners.\n");
+				validation = false;
+				break;
+			}
+			opts->add_tuner[opts->num_add_tuner++] = optarg;
+			break;
+		case OPT_WRITERS:
+			writersstr = optarg;
+			break;
+		case OPT_SCAN:
+			opts->scan_path = optarg;
+			break;
+		case OPT_CHDB:
+			opts->chdb_path = optarg;
+			break;
+		case OPT_EPG:
+			opts->epg_path = optarg;
+			break;
+		case OPT_START_AT:
+			startstr = optarg;
+			break;
+		case OPT_END_AT:
+			endstr = optarg;
+			break;
+		case OPT_PREROLL:
+			prerollstr = optarg;
+			break;
+		case OPT_SHUTDOWN:
+			shutdownstr = optarg;
+			break;
+		case OPT_DRAIN_TIMEOUT:
+			drainstr = optarg;
+			break;
+		case OPT_NO_PSI_INJECT:
+			opts->psi_inject = false;
+			break;
+		case OPT_WAIT_RAP:
+			opts->wait_rap = true;
+			break;
+		case OPT_SEGMENT:
+			segmentstr = optarg;
+			break;
+		case OPT_SEGMENT_SIZE:
+			segsizestr = optarg;
+			break;
+		case OPT_SEGMENT_PSI:
+			opts->segment_psi = true;
+			break;
+		case OPT_MANIFEST:
+			opts->manifest_path = optarg;
+			break;
+		case OPT_DIRECT:
+			opts->direct = true;
+			break;
+		case OPT_WRITEBACK:
+			writebackstr = optarg;
+			break;
+		case OPT_EXTENT:
+			extentstr = optarg;
+			break;
+		case OPT_BITRATE:
+			bitratestr = optarg;
+			break;
+		case OPT_TIMESHIFT:
+			timeshiftstr = optarg;
+			break;
+		case OPT_INDEX:
+			indexstr = optarg;
+			break;
+		case OPT_HASH:
+			opts->hash = true;
+			break;
+		case OPT_OUTPUT:
+			if (opts->num_outputs >= RECDVB_MAX_OUTPUTS) {
+				fprintf(stderr, "Error: Too many outputs (max %d).\n", RECDVB_MAX_OUTPUTS);
+				return -1;
+			}
+			opts->outputs[opts->num_outputs++] = optarg;
+			break;
+		case OPT_RING:
+			opts->ring_path = optarg;
+			break;
+		case OPT_RING_SIZE:
+			ringsizestr = optarg;
+			break;
+		case OPT_SERVE:
+			opts->serve_addr = optarg;
+			break;
 		}
 	}
 
@@ -192,16 +554,37 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 		return 1;
 	}
 
-	if (argc - optind < 3) {
+	/* scanned channels are used for TSID lookup */
+	if (opts->chdb_path) {
+		if (preset_load(opts->chdb_path) != 0) {
+			fprintf(stderr, "Error: Cannot load channel database '%s'.\n", opts->chdb_path);
+			return -1;
+		}
+	} else if (!opts->scan_path) {
+		preset_load(CHDB_DEFAULT_PATH);
+	}
+
+	/* daemon takes no channel, recording is requested by clients */
+	if (opts->scan_path) {
+		recsecstr = "-";
+	} else if (opts->epg_path) {
+		opts->epg_channels = &argv[optind];
+		opts->num_epg_channels = argc - optind;
+		recsecstr = "-";
+	} else if (opts->daemon_path) {
+		opts->devices = dev_numstr;
+		dev_numstr = NULL;
+		recsecstr = "-";
+	} else if (argc - optind < 3) {
 		fprintf(stderr, "Error: Some required parameters are missing!\n");
 		fprintf(stderr, "       Try '%s --help' for more information.\n", argv[0]);
 		return -1;
+	} else {
+		/* get no option args */
+		opts->channel = argv[optind];
+		recsecstr = argv[optind + 1];
+		opts->destfile = argv[optind + 2];
 	}
-
-	/* get no option args */
-	opts->channel = argv[optind];
-	recsecstr = argv[optind + 1];
-	opts->destfile = argv[optind + 2];
 	
 	/* check options */
 #ifdef HAVE_LIBARIB25
@@ -232,14 +615,13 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 		}
 	}
 
-	if (dev_numstr) {
-		opts->dev_num = (int)strtol(dev_numstr, &endptr, 10);
-		if (*endptr != '\0') {
+	if (dev_numstr && !strcmp(dev_numstr, "auto")) {
+		opts->dev_auto = true;
+	} else if (dev_numstr) {
+		const char *end = parse_device(dev_numstr, &opts->dev_num, &opts->fe_num);
+		if (!end || *end != '\0') {
 			fprintf(stderr, "Error: Parse device number failed.\n");
 			validation = false;
-		} else if (opts->dev_num < 0) {
-			fprintf(stderr, "Error: device number must be positive.\n");
-			validation = false;
 		}
 	}
 
@@ -251,7 +633,209 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 		}
 	}
 
-	if (opts->tsid == 0) {
+	if (tracestr) {
+		opts->trace_interval = (int)strtol(tracestr, &endptr, 10);
+		if (*endptr != '\0' || opts->trace_interval < 0) {
+			fprintf(stderr, "Error: Parse trace interval failed.\n");
+			validation = false;
+		}
+	}
+
+	if (recoverstr) {
+		opts->recover = (int)strtol(recoverstr, &endptr, 10);
+		if (*endptr != '\0' || opts->recover < 0) {
+			fprintf(stderr, "Error: Parse recover seconds failed.\n");
+			validation = false;
+		}
+	}
+
+	if (startstr && parse_clock(startstr, &opts->start_at) != 0) {
+		fprintf(stderr, "Error: Parse start time failed.\n");
+		validation = false;
+	}
+
+	if (endstr && parse_clock(endstr, &opts->end_at) != 0) {
+		fprintf(stderr, "Error: Parse end time failed.\n");
+		validation = false;
+	}
+
+	if (opts->start_at || opts->end_at) {
+		struct timespec now;
+		uint64_t now_ns;
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		now_ns = (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+		if ((opts->start_at && opts->start_at <= now_ns) || (opts->end_at && opts->end_at <= now_ns)) {
+			fprintf(stderr, "Error: Scheduled time is already past.\n");
+			validation = false;
+		}
+	}
+
+	if (opts->start_at && opts->end_at && opts->end_at <= opts->start_at) {
+		fprintf(stderr, "Error: End time is not after start time.\n");
+		validation = false;
+	}
+
+	if (prerollstr) {
+		opts->preroll = (int)strtol(prerollstr, &endptr, 10);
+		if (*endptr != '\0' || opts->preroll < 0) {
+			fprintf(stderr, "Error: Parse preroll seconds failed.\n");
+			validation = false;
+		} else if (opts->preroll > PREROLL_MAX_SEC) {
+			fprintf(stderr, "Error: Preroll must be %dsec or less.\n", PREROLL_MAX_SEC);
+			validation = false;
+		}
+	}
+
+	if (shutdownstr) {
+		if (strcmp(shutdownstr, "drain") == 0) {
+			opts->shutdown_mode = SHUTDOWN_DRAIN;
+		} else if (strcmp(shutdownstr, "abort") == 0) {
+			opts->shutdown_mode = SHUTDOWN_ABORT;
+		} else if (strcmp(shutdownstr, "auto") == 0) {
+			opts->shutdown_mode = SHUTDOWN_AUTO;
+		} else {
+			fprintf(stderr, "Error: Unknown shutdown mode.\n");
+			validation = false;
+		}
+	}
+
+	if (drainstr) {
+		double sec = strtod(drainstr, &endptr);
+		if (*endptr != '\0' || sec < 0) {
+			fprintf(stderr, "Error: Parse drain timeout failed.\n");
+			validation = false;
+		} else {
+			opts->drain_timeout = (int)(sec * 1000);
+		}
+	}
+
+	if (segmentstr && (parse_time(segmentstr, &opts->segment_sec) != 0 || opts->segment_sec <= 0)) {
+		fprintf(stderr, "Error: Parse segment time failed.\n");
+		validation = false;
+	}
+
+	if (segsizestr) {
+		if (parse_size(segsizestr, &opts->segment_bytes) != 0 || opts->segment_bytes < SEGMENT_MIN_BYTES) {
+			fprintf(stderr, "Error: Segment size must be %dMB or more.\n", SEGMENT_MIN_BYTES >> 20);
+			validation = false;
+		}
+	}
+
+	if (writebackstr && parse_size(writebackstr, &opts->writeback) != 0) {
+		fprintf(stderr, "Error: Parse writeback window failed.\n");
+		validation = false;
+	}
+
+	if (extentstr) {
+		if (parse_size(extentstr, &opts->extent) != 0 || (opts->extent > 0 && opts->extent < IOSCHED_ALIGN)) {
+			fprintf(stderr, "Error: Extent must be %dbyte or more.\n", IOSCHED_ALIGN);
+			validation = false;
+		}
+	}
+
+	if (bitratestr) {
+		opts->bitrate = (int)strtol(bitratestr, &endptr, 10);
+		if (*endptr != '\0' || opts->bitrate < 1) {
+			fprintf(stderr, "Error: Parse bitrate failed.\n");
+			validation = false;
+		}
+	}
+
+	if (timeshiftstr) {
+		if (parse_size(timeshiftstr, &opts->timeshift) != 0 || opts->timeshift < TIMESHIFT_MIN_SIZE) {
+			fprintf(stderr, "Error: Timeshift size must be %dMB or more.\n", TIMESHIFT_MIN_SIZE >> 20);
+			validation = false;
+		} else if (opts->segment_sec > 0 || opts->segment_bytes > 0 || (opts->destfile && !strcmp("-", opts->destfile))) {
+			fprintf(stderr, "Error: Timeshift needs a single output file.\n");
+			validation = false;
+		}
+	}
+
+	if (indexstr) {
+		opts->index = (int)strtol(indexstr, &endptr, 10);
+		if (*endptr != '\0' || opts->index < 1) {
+			fprintf(stderr, "Error: Parse index interval failed.\n");
+			validation = false;
+		} else if (opts->segment_sec > 0 || opts->segment_bytes > 0 || opts->timeshift > 0 ||
+			   (opts->destfile && !strcmp("-", opts->destfile))) {
+			fprintf(stderr, "Error: Seek index needs a single output file.\n");
+			validation = false;
+		}
+	}
+
+	{
+		int i, to_stdout = opts->destfile && !strcmp("-", opts->destfile);
+
+		for (i = 0; i < opts->num_outputs; i++) {
+			const char *dest = strchr(opts->outputs[i], ':');
+
+			if (tee_parse(opts->outputs[i]) != 0) {
+				fprintf(stderr, "Error: Invalid output %s.\n", opts->outputs[i]);
+				validation = false;
+			} else if (!strcmp(dest + 1, "-") && to_stdout++) {
+				fprintf(stderr, "Error: Only one output can be standard output.\n");
+				validation = false;
+			}
+		}
+	}
+
+	if (ringsizestr) {
+		if (parse_size(ringsizestr, &opts->ring_size) != 0 || opts->ring_size < TIMESHIFT_MIN_SIZE) {
+			fprintf(stderr, "Error: Ring size must be %dMB or more.\n", TIMESHIFT_MIN_SIZE >> 20);
+			validation = false;
+		}
+	}
+
+	if (opts->hash && opts->timeshift > 0) {
+		fprintf(stderr, "Error: Cannot hash timeshift ring.\n");
+		validation = false;
+	}
+
+	/* ring is written through shared mapping, not write(2) */
+	if (opts->timeshift > 0 && (opts->extent > 0 || opts->direct || opts->writeback > 0)) {
+		fprintf(stderr, "Error: --timeshift cannot be used with --extent, --direct or --writeback.\n");
+		validation = false;
+	}
+
+	if ((opts->segment_sec > 0 || opts->segment_bytes > 0) && opts->destfile && !strcmp("-", opts->destfile)) {
+		fprintf(stderr, "Error: Cannot segment standard output.\n");
+		validation = false;
+	}
+
+	if (writersstr) {
+		opts->writers = (int)strtol(writersstr, &endptr, 10);
+		if (*endptr != '\0' || opts->writers < 1) {
+			fprintf(stderr, "Error: Parse writer threads failed.\n");
+			validation = false;
+		}
+	}
+
+	if (opts->num_add_tuner > 0 && (opts->metrics_path || opts->control_path ||
+					opts->trace_interval >= 0 || opts->connect_path || opts->daemon_path)) {
+		fprintf(stderr, "Error: --add-tuner cannot be used with --metrics, --control, --trace, --connect or --daemon.\n");
+		validation = false;
+	}
+
+	/* PSI tracking and output start are done by main loop of single tuner */
+	if (opts->num_add_tuner > 0 && opts->wait_rap) {
+		fprintf(stderr, "Error: --add-tuner cannot be used with --wait-rap.\n");
+		validation = false;
+	}
+
+	/* extra outputs are fed by reader of single tuner */
+	if (opts->num_add_tuner > 0 && (opts->num_outputs > 0 || opts->ring_path || opts->serve_addr)) {
+		fprintf(stderr, "Error: --add-tuner cannot be used with --output, --ring or --serve.\n");
+		validation = false;
+	}
+
+	/* scheduling is done by main loop of single tuner */
+	if (opts->num_add_tuner > 0 && (opts->start_at || opts->end_at || prerollstr)) {
+		fprintf(stderr, "Error: --add-tuner cannot be used with --start-at, --end-at or --preroll.\n");
+		validation = false;
+	}
+
+	if (opts->tsid == 0 && opts->channel) {
 		/* update tsid when channel is BS */
 		set_bs_tsid(opts->channel, &(opts->tsid));
 	}
@@ -272,8 +856,21 @@ static int parse_options(struct recdvb_options *opts, int argc, char **argv)
 	return 0;
 }
 
+static void show_clock(const char *label, uint64_t ns)
+{
+	char buf[32];
+	time_t t = (time_t)(ns / 1000000000);
+	struct tm tm;
+
+	localtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+	fprintf(stderr, "      %s: %s.%03lu\n", label, buf, (unsigned long)(ns % 1000000000 / 1000000));
+}
+
 static void show_user_input(struct recdvb_options *opts)
 {
+	int i;
+
 	fprintf(stderr, "Info: Specified options:\n");
 	fprintf(stderr, "      Channel: %s\n", opts->channel);
 	fprintf(stderr, "      Destination file: %s\n", opts->destfile);
@@ -282,9 +879,82 @@ static void show_user_input(struct recdvb_options *opts)
 	} else {
 		fprintf(stderr, "      Record seconds: %d\n", opts->recsec);
 	}
-	fprintf(stderr, "      Device Number: %d\n", opts->dev_num);
+	if (opts->dev_auto) {
+		fprintf(stderr, "      Device Number: auto\n");
+	} else {
+		fprintf(stderr, "      Device Number: %d.%d\n", opts->dev_num, opts->fe_num);
+	}
 	fprintf(stderr, "      TSID: 0x%x\n", opts->tsid);
 	fprintf(stderr, "      LNB: %dV\n", opts->lnb);
+	if (opts->metrics_path) {
+		fprintf(stderr, "      Metrics socket: %s\n", opts->metrics_path);
+	}
+	if (opts->trace_interval >= 0) {
+		fprintf(stderr, "      Trace interval: %dsec\n", opts->trace_interval);
+	}
+	if (opts->recover > 0) {
+		fprintf(stderr, "      Recover: %dsec\n", opts->recover);
+	}
+	if (opts->start_at) {
+		show_clock("Start at", opts->start_at);
+		if (opts->preroll > 0) {
+			fprintf(stderr, "      Preroll: %dsec\n", opts->preroll);
+		}
+	}
+	if (opts->end_at) {
+		show_clock("End at", opts->end_at);
+	}
+	if (opts->control_path) {
+		fprintf(stderr, "      Control socket: %s\n", opts->control_path);
+	}
+	if (opts->segment_sec > 0) {
+		fprintf(stderr, "      Segment: %dsec\n", opts->segment_sec);
+	}
+	if (opts->segment_bytes > 0) {
+		fprintf(stderr, "      Segment size: %lubyte\n", opts->segment_bytes);
+	}
+	if (opts->direct) {
+		fprintf(stderr, "      Direct I/O: enable\n");
+	}
+	if (opts->extent > 0) {
+		fprintf(stderr, "      Extent: %lubyte\n", opts->extent);
+	}
+	if (opts->bitrate > 0) {
+		fprintf(stderr, "      Bitrate: %dMbps\n", opts->bitrate);
+	}
+	if (opts->timeshift > 0) {
+		fprintf(stderr, "      Timeshift: %lubyte\n", opts->timeshift);
+	}
+	if (opts->index > 0) {
+		fprintf(stderr, "      Seek index: every %dmsec\n", opts->index);
+	}
+	if (opts->hash) {
+		fprintf(stderr, "      Hash: XXH64\n");
+	}
+	for (i = 0; i < opts->num_outputs; i++) {
+		fprintf(stderr, "      Output: %s\n", opts->outputs[i]);
+	}
+	if (opts->ring_path) {
+		fprintf(stderr, "      Ring: %s (%lubyte)\n", opts->ring_path, opts->ring_size);
+	}
+	if (opts->serve_addr) {
+		fprintf(stderr, "      Serve: %s%s\n", streamer_addr_is_http(opts->serve_addr) ? "http://" : "",
+			opts->serve_addr);
+	}
+	if (!opts->psi_inject) {
+		fprintf(stderr, "      PSI inject: disable\n");
+	}
+	if (opts->wait_rap) {
+		fprintf(stderr, "      Wait random access point: enable\n");
+	}
+	if (opts->shutdown_mode != SHUTDOWN_DRAIN || opts->drain_timeout > 0) {
+		static const char *modes[] = {"drain", "abort", "auto"};
+		fprintf(stderr, "      Shutdown: %s", modes[opts->shutdown_mode]);
+		if (opts->drain_timeout > 0) {
+			fprintf(stderr, " within %dmsec", opts->drain_timeout);
+		}
+		fprintf(stderr, "\n");
+	}
 #ifdef HAVE_LIBARIB25
 	fprintf(stderr, "      B25 decode: %s\n", opts->b25 ? "enable" : "disable");
 	if (opts->b25) {
@@ -309,14 +979,322 @@ static uint64_t diff_timespec(struct timespec *a, struct timespec *b)
 	return d;
 }
 
+/* monotonic time (see trace_now) of a wall clock instant */
+static uint64_t realtime_to_mono(uint64_t rt_ns)
+{
+	struct timespec rt;
+	uint64_t mono = trace_now();
+
+	clock_gettime(CLOCK_REALTIME, &rt);
+	return mono + rt_ns - ((uint64_t)rt.tv_sec * 1000000000 + (uint64_t)rt.tv_nsec);
+}
+
+/* one-shot timer at absolute time, added to epoll */
+static int oneshot_timer(int epfd, int clockid, uint64_t ns)
+{
+	struct itimerspec its = {{0, 0}, {(time_t)(ns / 1000000000), (long)(ns % 1000000000)}};
+	struct epoll_event ev;
+	int fd;
+
+	fd = timerfd_create(clockid, TFD_CLOEXEC);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create timerfd. (errno=%d)\n", errno);
+		return -1;
+	}
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		fprintf(stderr, "Error: cannot set timer. (errno=%d)\n", errno);
+		close(fd);
+		return -1;
+	}
+
+	ev.data.fd = fd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		fprintf(stderr, "Error: cannot add source timer fd to epoll. (errno=%d)\n", errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* block until wall clock instant, returns -1 when signal arrived */
+static int wait_until(int sfd, uint64_t rt_ns)
+{
+	struct itimerspec its = {{0, 0}, {(time_t)(rt_ns / 1000000000), (long)(rt_ns % 1000000000)}};
+	struct pollfd pfd[2];
+	int fd, rc;
+
+	fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+	if (fd == -1 || timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == -1) {
+		fprintf(stderr, "Error: cannot set timer. (errno=%d)\n", errno);
+		if (fd != -1) {
+			close(fd);
+		}
+		return -1;
+	}
+
+	pfd[0].fd = sfd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = fd;
+	pfd[1].events = POLLIN;
+	do {
+		rc = poll(pfd, 2, -1);
+	} while (rc < 0 && errno == EINTR);
+	close(fd);
+
+	return (rc > 0 && !(pfd[0].revents & POLLIN)) ? 0 : -1;
+}
+
+/* state of data handed to reader */
+typedef struct output {
+	QUEUE_T *queue;
+	psi_cache *psi;            /* PAT/PMT of stream, NULL if not injected */
+	int need_psi;              /* inject before next packet aligned chunk */
+	int wait_rap;              /* hold output until video random access point */
+	uint64_t rap_since;
+	uint64_t skip_byte;        /* dropped waiting for random access point */
+	uint64_t first, last;      /* read stamps of first and last chunk queued */
+	BUFSZ *boundary;           /* channel marker not queued yet */
+} output;
+
+/* queue pending channel boundary marker, reader flushes decoder on it */
+static int flush_boundary(output *out)
+{
+	if (!out->boundary) {
+		return 0;
+	}
+	if (enqueue(out->queue, out->boundary) != 0) {
+		return -1;
+	}
+	out->boundary = NULL;
+	return 0;
+}
+
+/* drop data before first video random access point. returns -1 if none. */
+static int trim_to_rap(BUFSZ *buf, psi_cache *psi)
+{
+	long off;
+
+	if (!psi_ready(psi)) {
+		return -1;
+	}
+	off = psi_find_rap(psi, buf->buffer, (size_t)buf->size);
+	if (off < 0) {
+		return -1;
+	}
+	if (off > 0) {
+		memmove(buf->buffer, buf->buffer + off, (size_t)(buf->size - off));
+		buf->size -= off;
+	}
+
+	return 0;
+}
+
+/* hand chunk to reader, chunk is released. returns bytes dropped by full queue. */
+static uint64_t output_chunk(output *out, BUFSZ *buf, psi_cache *psi)
+{
+	ssize_t size;
+
+	/* new channel data must not pass its boundary */
+	if (flush_boundary(out) != 0) {
+		size = buf->size;
+		bufpool_put(buf);
+		if (out->psi) {
+			out->need_psi = 1;
+		}
+		return (uint64_t)size;
+	}
+
+	if (out->wait_rap) {
+		if (out->rap_since == 0) {
+			out->rap_since = buf->stamp[STAMP_READ];
+		}
+		if (trim_to_rap(buf, psi) != 0) {
+			if (buf->stamp[STAMP_READ] - out->rap_since < (uint64_t)WAIT_RAP_SEC * 1000000000) {
+				out->skip_byte += (uint64_t)buf->size;
+				bufpool_put(buf);
+				return 0;
+			}
+			fprintf(stderr, "Info: No random access point in %dsec, start anyway.\n", WAIT_RAP_SEC);
+		} else {
+			fprintf(stderr, "Info: Output waited %.1lfms for random access point.\n",
+				(buf->stamp[STAMP_READ] - out->rap_since) / 1000000.0);
+		}
+		out->wait_rap = 0;
+	}
+
+	if (out->first == 0) {
+		out->first = buf->stamp[STAMP_READ];
+	}
+	out->last = buf->stamp[STAMP_READ];
+
+	/* consumer can decode from here without waiting next PAT/PMT */
+	if (out->psi && out->need_psi && buf->size > 0 && buf->buffer[0] == TS_SYNC_BYTE && psi_ready(out->psi)) {
+		BUFSZ *pbuf = bufpool_get();
+
+		if (pbuf) {
+			memcpy(pbuf->stamp, buf->stamp, sizeof(pbuf->stamp));
+			/* chunk was fed already, counters continue into it */
+			pbuf->size = (ssize_t)psi_packets_before(out->psi, buf->buffer, (size_t)buf->size,
+								 pbuf->buffer, MAX_READ_SIZE);
+			if (pbuf->size > 0 && enqueue(out->queue, pbuf) == 0) {
+				out->need_psi = 0;
+			} else {
+				bufpool_put(pbuf);
+			}
+		}
+	}
+
+	size = buf->size;
+	if (enqueue(out->queue, buf) != 0) {
+		/* queue is full, dropped */
+		bufpool_put(buf);
+		if (out->psi) {
+			out->need_psi = 1;
+		}
+		return (uint64_t)size;
+	}
+
+	return 0;
+}
+
+/* chunks read before scheduled start, oldest first */
+static BUFSZ **preroll;
+static int preroll_max;
+static int preroll_head;
+static int preroll_count;
+
+/* room for sec seconds of stream */
+static int preroll_init(int sec)
+{
+	preroll_max = (sec + 1) * PREROLL_CHUNKS_PER_SEC;
+	preroll = calloc((size_t)preroll_max, sizeof(BUFSZ *));
+	if (!preroll) {
+		fprintf(stderr, "Error: Cannot allocate preroll buffer.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void preroll_push(BUFSZ *buf, uint64_t window_ns)
+{
+	while (preroll_count > 0 &&
+	       (preroll_count == preroll_max ||
+		buf->stamp[STAMP_READ] - preroll[preroll_head]->stamp[STAMP_READ] > window_ns)) {
+		bufpool_put(preroll[preroll_head]);
+		preroll_head = (preroll_head + 1) % preroll_max;
+		preroll_count--;
+	}
+	preroll[(preroll_head + preroll_count) % preroll_max] = buf;
+	preroll_count++;
+}
+
+static BUFSZ *preroll_pop(void)
+{
+	BUFSZ *buf;
+
+	if (preroll_count == 0) {
+		return NULL;
+	}
+	buf = preroll[preroll_head];
+	preroll_head = (preroll_head + 1) % preroll_max;
+	preroll_count--;
+
+	return buf;
+}
+
+/* join reader within timeout_ms of start, abort output when it expires.
+ * returns -1 when reader is blocked on output and left running. */
+static int join_reader(pthread_t th, thread_data *tdata, int timeout_ms, struct timespec *start)
+{
+	struct timespec now, dl;
+	uint64_t elapsed_ms, left_ns;
+
+	if (timeout_ms <= 0) {
+		return pthread_join(th, NULL) == 0 ? 0 : -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed_ms = diff_timespec(&now, start);
+	left_ns = elapsed_ms < (uint64_t)timeout_ms ? ((uint64_t)timeout_ms - elapsed_ms) * 1000000 : 0;
+
+	clock_gettime(CLOCK_REALTIME, &dl);
+	dl.tv_sec += (time_t)(left_ns / 1000000000);
+	dl.tv_nsec += (long)(left_ns % 1000000000);
+	if (dl.tv_nsec >= 1000000000) {
+		dl.tv_sec++;
+		dl.tv_nsec -= 1000000000;
+	}
+	if (pthread_timedjoin_np(th, NULL, &dl) == 0) {
+		return 0;
+	}
+
+	fprintf(stderr, "Info: Drain timeout, dropping %zu queued chunks.\n", queue_depth(tdata->queue));
+	__atomic_store_n(&tdata->abort, 1, __ATOMIC_RELAXED);
+
+	dl.tv_sec += DRAIN_GRACE_MSEC / 1000;
+	dl.tv_nsec += (DRAIN_GRACE_MSEC % 1000) * 1000000;
+	if (dl.tv_nsec >= 1000000000) {
+		dl.tv_sec++;
+		dl.tv_nsec -= 1000000000;
+	}
+	if (pthread_timedjoin_np(th, NULL, &dl) == 0) {
+		return 0;
+	}
+
+	fprintf(stderr, "Error: Output is blocked, exit without waiting reader.\n");
+	return -1;
+}
+
+/* execute control command. returns 1 if reply is deferred. */
+static int control_command(control *ctl, int id, char *line, tuner *t, char *chbuf, size_t chlen)
+{
+	char cmd[16] = {0};
+	char channel[32] = {0};
+	char tsidstr[16] = {0};
+	unsigned int tsid = 0;
+	char *endptr = NULL;
+	int n;
+
+	n = sscanf(line, "%15s %31s %15s", cmd, channel, tsidstr);
+	if (n >= 1 && !strcmp(cmd, "status")) {
+		control_reply(ctl, id, "OK channel=%s state=%d zaps=%lu outages=%lu\n",
+			t->channel, t->state, t->zaps, t->outages);
+		return 0;
+	}
+
+	if (n < 2 || strcmp(cmd, "tune")) {
+		control_reply(ctl, id, "ERR unknown command\n");
+		return 0;
+	}
+
+	if (n == 3) {
+		tsid = (unsigned int)strtoul(tsidstr, &endptr, 0);
+		if (*endptr != '\0') {
+			control_reply(ctl, id, "ERR invalid tsid\n");
+			return 0;
+		}
+	} else {
+		set_bs_tsid(channel, &tsid);
+	}
+
+	/* tuner keeps pointer to channel, previous one is not needed anymore */
+	snprintf(chbuf, chlen, "%s", channel);
+	if (tuner_retune(t, chbuf, tsid) != 0) {
+		control_reply(ctl, id, "ERR tune failed\n");
+		return 0;
+	}
+	fprintf(stderr, "Info: Switching channel to %s (TSID 0x%x).\n", chbuf, tsid);
+
+	return 1;
+}
+
 int main(int argc, char **argv)
 {
 	int i, rc;
-	int fefd = -1;
-	int dmxfd = -1;
-	int dvrfd = -1;
 	int f_exit = 0;
-	int tuned = 0;
+	int f_signal = 0;
 	uint64_t r_byte = 0, p_r_byte = 0;
 	uint64_t o_byte = 0;
 	int notune_count = 0;
@@ -335,15 +1313,45 @@ int main(int argc, char **argv)
 	int sfd = -1;
 	sigset_t mask;
 
+	/* for metrics */
+	int mfd = -1;
+	struct metrics metrics = {0};
+
+	/* for tuner */
+	static tuner tuner;
+	int tl_shown = 0;
+
+	/* for control */
+	static control ctl;
+	static char zap_channel[2][32];
+	int zap_slot;
+	int zap_client = -1;
+	int zap_boundary = 0;
+
+	/* for latency trace */
+	static trace trace;
+	int trace_count = 0;
+
+	/* for scheduled start/stop, monotonic ns */
+	int stfd = -1;
+	int etfd = -1;
+	int out_started = 0;
+	uint64_t start_target = 0, end_target = 0;
+	static psi_cache psi;
+	output out = {0};
+
 	/* for timerfd */
 	int tfd = -1;
 	struct itimerspec interval = {{1, 0}, {1, 0}};
 
 	/* for thread */
 	pthread_t reader_thread;
+	int reader_started = 0;
+	struct timespec drain_time = {0};
 	static thread_data tdata = {
 	};
 	QUEUE_T *p_queue = create_queue(MAX_QUEUE);
+	static tee_group outputs;
 
 	/* default value */
 
@@ -355,8 +1363,32 @@ int main(int argc, char **argv)
 		return 0; // exit successfully.
 	}
 
+	if (opts.scan_path) {
+		return scan_main(&opts);
+	}
+
+	if (opts.epg_path) {
+		return epg_main(&opts, opts.num_epg_channels, opts.epg_channels);
+	}
+
+	if (opts.daemon_path) {
+		return daemon_main(&opts);
+	}
+
 	show_user_input(&opts);
 
+	if (opts.connect_path) {
+		return client_main(&opts);
+	}
+
+	if (opts.num_add_tuner > 0) {
+		return multi_main(&opts);
+	}
+
+	tuner_init(&tuner, opts.dev_num, opts.fe_num);
+	tuner.recover = opts.recover > 0;
+	control_init(&ctl);
+
 	/* create epoll event fd */
 	epfd = epoll_create(NEVENTS);
 	if (epfd == -1)
@@ -406,53 +1438,126 @@ int main(int argc, char **argv)
 		goto end;
 	}
 
+	/* output starts with PAT/PMT when injected */
+	psi_init(&psi);
+	out.queue = p_queue;
+	out.psi = opts.psi_inject ? &psi : NULL;
+	out.need_psi = 1;
+	out.wait_rap = opts.wait_rap;
+
 	/* prepare thread data */
 	tdata.opts = &opts;
 	tdata.alive = 1;
 	tdata.queue = p_queue;
+	tdata.trace = NULL;
+	if (opts.trace_interval >= 0) {
+		trace_init(&trace);
+		tdata.trace = &trace;
+	}
 	tdata.status = READER_EXIT_NOERROR;
 	tdata.w_byte = 0;
+	tdata.w_count = 0;
+	tdata.w_ns_total = 0;
+	tdata.w_ns_max = 0;
 	pthread_mutex_init(&tdata.mutex, NULL);
 
-	/* spawn reader thread */
-	pthread_create(&reader_thread, NULL, reader_func, &tdata);
+	/* extra outputs, written by own threads from what reader decoded */
+	if (opts.num_outputs > 0 || opts.ring_path || opts.serve_addr) {
+		if (tee_open(&outputs, opts.outputs, opts.num_outputs) != 0) {
+			goto end;
+		}
+		if (opts.ring_path && tee_add_ring(&outputs, opts.ring_path, opts.ring_size) != 0) {
+			fprintf(stderr, "Error: Cannot publish ring %s.\n", opts.ring_path);
+			goto end;
+		}
+		if (opts.serve_addr && tee_add_server(&outputs, opts.serve_addr) != 0) {
+			goto end;
+		}
+		tdata.tee = &outputs;
+	}
 
-	/* open frontend */
-	fefd = open_frontend(opts.dev_num);
-	if (fefd == -1) {
+	/* spawn reader thread */
+	if (pthread_create(&reader_thread, NULL, reader_func, &tdata) != 0) {
+		fprintf(stderr, "Error: Cannot create reader thread.\n");
 		goto end;
 	}
+	reader_started = 1;
 
-	/* add epoll event source: dvb frontend */
-	ev.data.fd = fefd;
-	ev.events = EPOLLIN;
-	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fefd, &ev) == -1) {
-		fprintf(stderr, "Error: Cannot add source dvb frontend fd to epoll. (errno=%d)\n", errno);
-		goto end;
+	/* claim free tuner of the channel's delivery system */
+	if (opts.dev_auto) {
+		if (adapter_claim(&tuner, channel_isdbtype(opts.channel)) != 0) {
+			goto end;
+		}
+		opts.dev_num = tuner.dev_num;
+		opts.fe_num = tuner.fe_num;
 	}
 
-	/* tune */
-	if(frontend_tune(fefd, opts.channel, opts.tsid, opts.lnb) != 0) {
-		goto end;
+	/* create metrics socket */
+	if (opts.metrics_path) {
+		mfd = sock_listen_unix(opts.metrics_path);
+		if (mfd == -1) {
+			goto end;
+		}
+
+		/* add epoll event source: metrics */
+		ev.data.fd = mfd;
+		ev.events = EPOLLIN;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, mfd, &ev) == -1) {
+			fprintf(stderr, "Error: cannot add source metrics fd to epoll. (errno=%d)\n", errno);
+			goto end;
+		}
+	}
+	/* create control socket */
+	if (opts.control_path) {
+		if (control_open(&ctl, opts.control_path, epfd) != 0) {
+			goto end;
+		}
 	}
 
-	/* open dvb demux */
-	dmxfd = open_demux(opts.dev_num);
-	if (dmxfd == -1) {
-		goto end;
+	metrics.dev_num = opts.dev_num;
+	metrics.channel = opts.channel;
+	metrics.queue_size = MAX_QUEUE;
+	metrics.trace = tdata.trace;
+	metrics.timeline = &tuner.tl;
+
+	/* scheduled recording, tune a little before start */
+	if (opts.start_at) {
+		uint64_t tune_at = opts.start_at - (uint64_t)(TUNE_LEAD_SEC + opts.preroll) * 1000000000;
+		struct timespec now;
+
+		if (preroll_init(opts.preroll) != 0) {
+			goto end;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &now);
+		if (tune_at > (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec) {
+			fprintf(stderr, "Info: Waiting %lusec to tune.\n",
+				(unsigned long)((tune_at - (uint64_t)now.tv_sec * 1000000000) / 1000000000));
+			if (wait_until(sfd, tune_at) != 0) {
+				goto end;
+			}
+		}
+
+		stfd = oneshot_timer(epfd, CLOCK_REALTIME, opts.start_at);
+		if (stfd == -1) {
+			goto end;
+		}
+	}
+	if (opts.end_at) {
+		etfd = oneshot_timer(epfd, CLOCK_REALTIME, opts.end_at);
+		if (etfd == -1) {
+			goto end;
+		}
+		end_target = realtime_to_mono(opts.end_at);
 	}
 
-	/* open dvb dvr */
-	dvrfd = open_dvr(opts.dev_num);
-	if (dvrfd == -1) {
+	/* open frontend, tune and prepare demux/dvr while locking */
+	if (tuner_start(&tuner, opts.channel, opts.tsid, opts.lnb) != 0) {
 		goto end;
 	}
 
-	/* add epoll event source: dvb dvr */
-	ev.data.fd = dvrfd;
-	ev.events = EPOLLIN;
-	if (epoll_ctl(epfd, EPOLL_CTL_ADD, dvrfd, &ev) == -1) {
-		fprintf(stderr, "Error: Cannot add source dvb dvr fd to epoll. (errno=%d)\n", errno);
+	/* add epoll event source: dvb frontend, lock poll and dvr */
+	if (tuner_watch(&tuner, epfd) != 0) {
 		goto end;
 	}
 
@@ -483,46 +1588,90 @@ int main(int argc, char **argv)
 			continue;
 		}
 
-		/* stop recording */
 		clock_gettime(CLOCK_MONOTONIC_RAW, &cur_time);
-		if (opts.recsec != -1 && diff_timespec(&cur_time, &start_time) / 1000 >= opts.recsec) {
-			break;
-		}
 
 		/* event proc */
 		for (i = 0; i < nfds; ++i) {
 
-			if (evs[i].data.fd == sfd) {
+			if (evs[i].data.fd == stfd) {
+				/* scheduled start, older data is preroll */
+				uint64_t exp;
+				BUFSZ *pbuf;
+
+				read(stfd, &exp, sizeof(exp));
+				start_target = realtime_to_mono(opts.start_at);
+				out_started = 1;
+				while ((pbuf = preroll_pop()) != NULL) {
+					if (pbuf->stamp[STAMP_READ] + (uint64_t)opts.preroll * 1000000000 < start_target) {
+						bufpool_put(pbuf);
+						continue;
+					}
+					o_byte += output_chunk(&out, pbuf, &psi);
+				}
+				if (!opts.end_at && opts.recsec != -1) {
+					end_target = start_target + (uint64_t)opts.recsec * 1000000000;
+					etfd = oneshot_timer(epfd, CLOCK_MONOTONIC, end_target);
+				}
+				fprintf(stderr, "Info: Recording started.\n");
+				continue;
+			} else if (evs[i].data.fd == etfd) {
+				/* scheduled end */
+				f_exit = 1;
+				break;
+			} else if (evs[i].data.fd == sfd) {
 				/* signal */
 				struct signalfd_siginfo info = {0};
 				read(sfd, &info, sizeof(info));
 
 				fprintf(stderr, "\nInfo: Catch signal.\n");
 				f_exit = 1;
+				f_signal = 1;
 				break;
 			} else if (evs[i].data.fd == tfd) {
 				/* timer */
 				uint64_t exp;
 				read(tfd, &exp, sizeof(uint64_t));
 
-				if (tuned == 0) {
+				if (tuner.state == TUNER_TUNING) {
 					/* check timeout */
 					notune_count++;
 					if (notune_count < TUNE_TIMEOUT) {
 						continue;
 					}
+					if (tuner.zaps > 0) {
+						/* keep trying, another channel may be requested */
+						fprintf(stderr, "Error: Tune timeout.\n");
+						control_reply(&ctl, zap_client, "ERR tune timeout\n");
+						zap_client = -1;
+						notune_count = 0;
+						continue;
+					}
 					f_exit = 1;
 					fprintf(stderr, "Error: Tune timeout.\n");
 					break;
 				} else {
-					uint64_t w_byte = 0;
+					uint64_t w_byte = __atomic_load_n(&tdata.w_byte, __ATOMIC_RELAXED);
 					/* show stats */
-					frontend_show_stats(fefd);
-					if (pthread_mutex_trylock(&tdata.mutex) == 0) {
-						w_byte = tdata.w_byte;
-						pthread_mutex_unlock(&tdata.mutex);
+					frontend_show_stats(tuner.fefd);
+					if (mfd != -1) {
+						frontend_get_stats(tuner.fefd, &metrics.fe);
 					}
 					fprintf(stderr, "      Read %lubyte, Write %lubyte, Overrun %lubyte\n", r_byte, w_byte, o_byte);
+					if (opts.trace_interval > 0 && ++trace_count >= opts.trace_interval) {
+						trace_dump(&trace);
+						trace_count = 0;
+					}
+
+					/* check outage */
+					if (tuner.state == TUNER_RECOVERING) {
+						noread_count = 0;
+						if (tuner_outage_ms(&tuner) < (uint64_t)opts.recover * 1000) {
+							continue;
+						}
+						f_exit = 1;
+						fprintf(stderr, "Error: Recover timeout.\n");
+						break;
+					}
 
 					/* check timeout */
 					if (p_r_byte == r_byte) {
@@ -530,6 +1679,15 @@ int main(int argc, char **argv)
 						if (noread_count < READ_TIMEOUT) {
 							continue;
 						}
+						if (tuner.recover) {
+							/* locked but no data, retune */
+							noread_count = 0;
+							if (tuner_lost(&tuner) != 0) {
+								f_exit = 1;
+								break;
+							}
+							continue;
+						}
 						f_exit = 1;
 						fprintf(stderr, "Error: Read timeout.\n");
 						break;
@@ -538,35 +1696,73 @@ int main(int argc, char **argv)
 						p_r_byte = r_byte;
 					}
 				}
-			} else if (evs[i].data.fd == fefd) {
+			} else if (evs[i].data.fd == mfd) {
+				/* metrics */
+				metrics.channel = tuner.channel;
+				metrics.tuned = tuner.state == TUNER_LOCKED;
+				metrics.outages = tuner.outages;
+				metrics.outage_ms = (tuner.outage_ns_total / 1000000) + tuner_outage_ms(&tuner);
+				metrics.elapsed_ms = diff_timespec(&cur_time, &start_time);
+				metrics.r_byte = r_byte;
+				metrics.w_byte = __atomic_load_n(&tdata.w_byte, __ATOMIC_RELAXED);
+				metrics.o_byte = o_byte;
+				metrics.queue_depth = queue_depth(p_queue);
+				metrics.write_count = __atomic_load_n(&tdata.w_count, __ATOMIC_RELAXED);
+				metrics.write_ns_total = __atomic_load_n(&tdata.w_ns_total, __ATOMIC_RELAXED);
+				metrics.write_ns_max = __atomic_load_n(&tdata.w_ns_max, __ATOMIC_RELAXED);
+				metrics.wb_dirty = __atomic_load_n(&tdata.wb_dirty, __ATOMIC_RELAXED);
+				metrics.wb_count = __atomic_load_n(&tdata.wb_count, __ATOMIC_RELAXED);
+				metrics.wb_ns_total = __atomic_load_n(&tdata.wb_ns_total, __ATOMIC_RELAXED);
+				metrics.wb_ns_max = __atomic_load_n(&tdata.wb_ns_max, __ATOMIC_RELAXED);
+				metrics_serve(mfd, &metrics);
+			} else if (evs[i].data.fd == tuner.fefd || evs[i].data.fd == tuner.pollfd) {
 				/* frontend */
-				if (tuned != 0) {
-					continue;
-				}
-				if (frontend_locked(fefd) != 0) {
-					continue;
-				}
-				
-				tuned = 1;
-
-				/* demux start */
-				if (demux_start(dmxfd) != 0) {
+				rc = tuner_handle(&tuner, evs[i].data.fd);
+				if (rc == -1) {
 					f_exit = 1;
-					fprintf(stderr, "Error: Cannot start demux.\n");
 					break;
 				}
 
-				/* remove from epoll */
-				if (epoll_ctl(epfd, EPOLL_CTL_DEL, fefd, NULL) != 0) {
-					f_exit = 1;
-					fprintf(stderr, "Error: Remove fd from epoll failed. (errno=%d)\n", errno);
-					break;
+				/* data of new channel follows */
+				if (rc == TUNER_EV_LOCKED && zap_boundary) {
+					/* kept pending while queue is full, retried before next chunk */
+					if (!out.boundary && (out.boundary = bufpool_get()) != NULL) {
+						out.boundary->flags = BUFSZ_BOUNDARY;
+					}
+					if (!out.boundary) {
+						fprintf(stderr, "Error: Cannot mark channel boundary.\n");
+					}
+					flush_boundary(&out);
+					zap_boundary = 0;
+					psi_init(&psi);
 				}
 
-				/* show current frequency */
-				frontend_show_frequency(fefd);
+				/* resync point, replay PAT/PMT */
+				if (rc == TUNER_EV_LOCKED && out.psi) {
+					out.need_psi = 1;
+				}
+			} else if (control_owns(&ctl, evs[i].data.fd)) {
+				/* control */
+				char *line;
+				int id = control_handle(&ctl, evs[i].data.fd, &line);
 
-			} else if (evs[i].data.fd == dvrfd) {
+				if (id == -1) {
+					continue;
+				}
+				if (zap_client != -1) {
+					control_reply(&ctl, id, "ERR busy\n");
+					continue;
+				}
+
+				/* use buffer which tuner does not point to */
+				zap_slot = tuner.channel == zap_channel[0] ? 1 : 0;
+				if (control_command(&ctl, id, line, &tuner, zap_channel[zap_slot], sizeof(zap_channel[0])) == 1) {
+					zap_client = id;
+					zap_boundary = 1;
+					notune_count = 0;
+					tl_shown = 0;
+				}
+			} else if (evs[i].data.fd == tuner.dvrfd) {
 				/* dvr */
 
 				/* make sure event is EPOLLIN */
@@ -575,7 +1771,7 @@ int main(int argc, char **argv)
 				}
 
 				/* allocate memory for read data from dvr */
-				bufptr = malloc(sizeof(BUFSZ));
+				bufptr = bufpool_get();
 				if (!bufptr) {
 					f_exit = 1;
 					fprintf(stderr, "Error: Cannot allocate buffer memory.\n");
@@ -583,53 +1779,126 @@ int main(int argc, char **argv)
 				}
 
 				/* read dvr */
-				bufptr->size = read(dvrfd, bufptr->buffer, MAX_READ_SIZE);
+				bufptr->stamp[STAMP_READ] = trace_now();
+				bufptr->size = read(tuner.dvrfd, bufptr->buffer, MAX_READ_SIZE);
 				if (bufptr->size <= 0) {
-					free(bufptr);
+					bufpool_put(bufptr);
 					continue;
 				}
 
-				/* insert data to ring buffer */
-				if (enqueue(p_queue, bufptr) != 0) {
-					/* queue is full, dropped */
-					free(bufptr);
-					o_byte += bufptr->size;
+				PROBE3(dvr_read, bufptr->size, r_byte, trace_now());
+
+				/* leftover of previous channel */
+				if (tuner.state == TUNER_TUNING && tuner.zaps > 0) {
+					bufpool_put(bufptr);
+					continue;
+				}
+
+				/* look for first PAT/PMT/PCR */
+				timeline_mark(&tuner.tl, TL_FIRST_BYTE);
+				if (!tl_shown) {
+					timeline_feed(&tuner.tl, bufptr->buffer, (size_t)bufptr->size);
+					if (timeline_complete(&tuner.tl)) {
+						timeline_show(&tuner.tl, opts.dev_num, tuner.channel);
+						tl_shown = 1;
+					}
+				}
+
+				/* report zap latency */
+				if (tuner.zap_ns != 0) {
+					uint64_t zap_ns = trace_now() - tuner.zap_ns;
+					uint64_t lock_ns = timeline_get(&tuner.tl, TL_LOCK);
+
+					fprintf(stderr, "Info: Switched to %s in %.3lfsec (lock %.3lfsec).\n",
+						tuner.channel, zap_ns / 1000000000.0, lock_ns / 1000000000.0);
+					control_reply(&ctl, zap_client, "OK channel=%s tsid=0x%x lock_ms=%.1lf zap_ms=%.1lf\n",
+						tuner.channel, tuner.tsid, lock_ns / 1000000.0, zap_ns / 1000000.0);
+					zap_client = -1;
+					tuner.zap_ns = 0;
+				}
+
+				if (tdata.trace) {
+					bufptr->stamp[STAMP_ENQUEUE] = trace_now();
 				}
 
 				/* set first read time */
 				if (r_byte == 0) {
 					clock_gettime(CLOCK_MONOTONIC_RAW, &read_time);
+					PROBE2(first_byte, opts.dev_num, trace_now());
 				}
 
 				/* count up total read size */
 				r_byte += bufptr->size;
+				tuner_data(&tuner);
+
+				/* follow PAT/PMT for injection and random access point */
+				if (opts.psi_inject || opts.wait_rap) {
+					psi_feed(&psi, bufptr->buffer, (size_t)bufptr->size);
+				}
+
+				/* hold data until scheduled start */
+				if (opts.start_at && !out_started) {
+					preroll_push(bufptr, (uint64_t)opts.preroll * 1000000000);
+					continue;
+				}
+
+				/* data after scheduled end, timer fires soon */
+				if (end_target && bufptr->stamp[STAMP_READ] >= end_target) {
+					bufpool_put(bufptr);
+					f_exit = 1;
+					break;
+				}
+
+				/* unscheduled recording counts rectime from first data, not from tuning */
+				if (etfd == -1 && !opts.start_at && !opts.end_at && opts.recsec != -1) {
+					end_target = bufptr->stamp[STAMP_READ] + (uint64_t)opts.recsec * 1000000000;
+					etfd = oneshot_timer(epfd, CLOCK_MONOTONIC, end_target);
+					if (etfd == -1) {
+						bufpool_put(bufptr);
+						f_exit = 1;
+						break;
+					}
+				}
+
+				/* insert data to ring buffer */
+				o_byte += output_chunk(&out, bufptr, &psi);
 			}
 		}
 	} /* while (!f_exit) */
 
+	/* show timeline when stream did not complete it */
+	if (!tl_shown && tuner.tl.count > 0) {
+		timeline_show(&tuner.tl, opts.dev_num, tuner.channel);
+	}
+
 	/* show record time info */
 	fprintf(stderr, "Info: Elapsed time %.2lfsec\n", diff_timespec(&cur_time, &start_time) / 1000.0);
 	if (read_time.tv_sec > 0 || read_time.tv_nsec) {
 		/* tuning successful. */
 		fprintf(stderr, "      (Tuning %.2lfsec)\n", diff_timespec(&read_time, &start_time) / 1000.0);
 	}
+	if (start_target && out.first) {
+		fprintf(stderr, "Info: Output started %+.1lfms from target\n",
+			((double)out.first - (double)start_target + (double)opts.preroll * 1e9) / 1e6);
+	}
+	if (end_target && out.last && (opts.start_at || opts.end_at)) {
+		fprintf(stderr, "Info: Output ended %+.1lfms from target\n",
+			((double)out.last - (double)end_target) / 1e6);
+	}
+	if (out.first && out.last) {
+		fprintf(stderr, "Info: Recorded %.3lfsec\n", (double)(out.last - out.first) / 1e9);
+	}
+	if (out.skip_byte > 0) {
+		fprintf(stderr, "Info: Skipped %lubyte before random access point\n", out.skip_byte);
+	}
 
 end:
 
-	/* tell exit to thread. */
-	while (enqueue(p_queue, NULL) != 0) {
-		/* when enqueue timeout, check thread alive */
-		int thread_alive = 1;
-		if (pthread_mutex_trylock(&tdata.mutex) == 0) {
-			if (tdata.alive == 0) {
-				thread_alive = 0;
-			}
-			pthread_mutex_unlock(&tdata.mutex);
-
-			if (thread_alive == 0) {
-				break;
-			}
-		}
+	/* tell exit to thread, queued data is written or dropped */
+	queue_close(p_queue);
+	clock_gettime(CLOCK_MONOTONIC, &drain_time);
+	if (f_signal) {
+		reader_shutdown(&tdata, opts.shutdown_mode);
 	}
 
 	/* close epoll */
@@ -638,36 +1907,82 @@ end:
 	}
 
 	/* close dvr/dmx/frontend anyway */
-	if (dvrfd != -1) {
-		close(dvrfd);
-	}
-
-	if (dmxfd != -1) {
-		close(dmxfd);
-	}
-
-	if (fefd != -1) {
-		close(fefd);
-	}
+	tuner_close(&tuner);
 	
 	/* close timerfd */
 	if (tfd != -1) {
 		close(tfd);
 	}
+	if (stfd != -1) {
+		close(stfd);
+	}
+	if (etfd != -1) {
+		close(etfd);
+	}
+
+	/* drop data never reached scheduled start */
+	{
+		BUFSZ *pbuf;
+		while ((pbuf = preroll_pop()) != NULL) {
+			bufpool_put(pbuf);
+		}
+		free(preroll);
+	}
+	if (out.boundary) {
+		bufpool_put(out.boundary);
+	}
 
 	/* close signalfd */
 	if (sfd != -1) {
 		close(sfd);
 	}
 
+	/* close control socket */
+	control_close(&ctl);
+
+	/* close metrics socket */
+	if (opts.metrics_path) {
+		sock_close_unix(mfd, opts.metrics_path);
+	}
+
 	/* wait for threads */
-	pthread_join(reader_thread, NULL);
+	if (reader_started) {
+		int left = (int)queue_depth(p_queue);
+
+		if (join_reader(reader_thread, &tdata, opts.drain_timeout, &drain_time) != 0) {
+			/* reader still owns queue and buffers, leave them to exit */
+			return 1;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &cur_time);
+		fprintf(stderr, "Info: Drained %d chunks in %.1lfms\n", left,
+			(double)diff_timespec(&cur_time, &drain_time));
+		if (tdata.d_byte > 0) {
+			fprintf(stderr, "Info: Dropped %lubyte on shutdown\n", tdata.d_byte);
+		}
+		if (tdata.wb_count > 0) {
+			fprintf(stderr, "Info: Writeback waited %lu times, avg %.1lfms, p99 %.1lfms, max %.1lfms\n",
+				tdata.wb_count, tdata.wb_ns_total / tdata.wb_count / 1000000.0,
+				hist_percentile(&tdata.wb_hist, 99.0) / 1000000.0, tdata.wb_ns_max / 1000000.0);
+		}
+		fprintf(stderr, "Info: Output closed in %.1lfms\n", tdata.close_ns / 1000000.0);
+	}
+
+	/* outputs hold chunks until drained */
+	tee_close(&outputs);
 
 	/* release queue */
 	destroy_queue(p_queue);
+	bufpool_destroy();
 
 	/* show status */
 	fprintf(stderr, "Info: Read %lubyte, Write %lubyte, Overrun %lubyte\n", r_byte, tdata.w_byte, o_byte);
+	if (tuner.outages > 0) {
+		fprintf(stderr, "Info: Signal lost %lu times, total %.2lfsec\n",
+			tuner.outages, tuner.outage_ns_total / 1000000000.0);
+	}
+	if (tdata.trace) {
+		trace_dump(&trace);
+	}
 
 	return 0;
 }
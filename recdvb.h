@@ -18,6 +18,7 @@
 #define RECDVB_RECDVB_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifndef RECDVB_CONFIG_H
 #define RECDVB_CONFIG_H
@@ -27,6 +28,16 @@
 #define MAX_QUEUE                     8192
 // #define WRITE_SIZE       (1024 * 1024 * 2)
 
+#define RECDVB_MAX_ADD_TUNERS 15
+#define RECDVB_MAX_OUTPUTS    8
+
+/* what to do with queued data when signaled */
+enum shutdown_mode {
+	SHUTDOWN_DRAIN, /* write everything */
+	SHUTDOWN_ABORT, /* drop queued data */
+	SHUTDOWN_AUTO,  /* drain to file, drop if output is pipe or socket */
+};
+
 struct recdvb_options {
 #ifdef HAVE_LIBARIB25
 	/* for b25 */
@@ -37,12 +48,58 @@ struct recdvb_options {
 #endif
 	int lnb;
 	int dev_num;
+	int fe_num;
+	bool dev_auto;        /* pick free tuner, see adapter.h */
 	unsigned int tsid;
 	char *destfile;
 	char *channel;
 
 	int recsec;
 	bool use_stdout;
+
+	char *metrics_path;
+	int trace_interval;  /* -1: disabled, 0: dump at exit only */
+	int recover;         /* max outage seconds to retune through, 0: disabled */
+	char *control_path;
+	char *daemon_path;   /* run as tuner daemon on this socket */
+	char *connect_path;  /* record through daemon on this socket */
+	char *devices;       /* comma separated device list for daemon */
+
+	/* more tuners recorded by this process, "DEV[.FE]:CHANNEL:DESTFILE" */
+	char *add_tuner[RECDVB_MAX_ADD_TUNERS];
+	int num_add_tuner;
+	int writers;         /* writer threads, 0: decided by number of tuners and cores */
+
+	char *scan_path;     /* scan channels and write database here */
+	char *chdb_path;     /* channel database to load */
+	char *epg_path;      /* harvest EPG sections into this file */
+	char **epg_channels; /* channels to harvest, all in database if none */
+	int num_epg_channels;
+	uint64_t start_at;   /* realtime ns to start output, 0 for now */
+	uint64_t end_at;     /* realtime ns to end output, 0 for rectime */
+	int preroll;         /* seconds of data before start_at */
+	int shutdown_mode;   /* enum shutdown_mode */
+	int drain_timeout;   /* msec to wait for output on exit, 0 for no limit */
+	bool psi_inject;     /* repeat cached PAT/PMT at output start and resync */
+	bool wait_rap;       /* start output at video random access point */
+	int segment_sec;     /* split output every this seconds, 0 for none */
+	uint64_t segment_bytes; /* split output at this size, 0 for none */
+	bool segment_psi;    /* start each segment with PAT/PMT */
+	char *manifest_path; /* playlist of segments */
+	bool direct;         /* write output with O_DIRECT */
+	uint64_t writeback;  /* flush output in windows of this size, 0 for none */
+	uint64_t extent;     /* write output in extents ordered per disk, 0 for none */
+	int bitrate;         /* expected Mbps to preallocate output, 0 by channel */
+	uint64_t timeshift;  /* write output to ring file of this size, 0 for none */
+	int index;           /* msec between seek index entries, 0 for no index */
+	bool hash;           /* hash output while writing */
+
+	/* more outputs of this recording, "FILTER:DEST" */
+	char *outputs[RECDVB_MAX_OUTPUTS];
+	int num_outputs;
+	char *ring_path;     /* serve stream in shared memory ring on this socket */
+	uint64_t ring_size;
+	char *serve_addr;    /* serve stream on unix socket path or HOST:PORT */
 };
 
 #endif
@@ -18,8 +18,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/ioctl.h>
@@ -31,9 +34,6 @@
 
 #include "recdvbcore.h"
 
-#define ISDBTYPE_ISDBT 0
-#define ISDBTYPE_ISDBS 1
-
 #define DEVNAME_BUFFER 32
 
 static int get_isdbtype(int fefd)
@@ -66,18 +66,55 @@ static int get_isdbtype(int fefd)
 	return -1;
 }
 
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* carrier frequency in kHz (IF for satellite), 0 if channel is invalid */
+uint32_t channel_frequency(int isdbtype, const char *channel)
+{
+	uint32_t fe_freq;
+
+	if (isdbtype == ISDBTYPE_ISDBT) {
+		if ((fe_freq = (uint32_t)atoi(channel)) == 0) {
+			return 0;
+		}
+		return fe_freq * 6000 + 395143;
+	}
+
+	if (((channel[0] == 'b') || (channel[0] == 'B')) &&
+	    ((channel[1] == 's') || (channel[1] == 'S'))) {
+		if ((fe_freq = (uint32_t)atoi(channel + 2)) == 0) {
+			return 0;
+		}
+		return fe_freq * 19180 + 1030300;
+	} else if (((channel[0] == 'n')||(channel[0] == 'N')) &&
+		   ((channel[1] == 'd')||(channel[1] == 'D'))) {
+		if ((fe_freq = (uint32_t)atoi(channel + 2)) == 0) {
+			return 0;
+		}
+		return fe_freq * 20000 + 1573000;
+	}
+
+	return 0;
+}
+
 static int set_isdb_t_frequency(const char *channel, struct dtv_property *prop)
 {
 	uint32_t fe_freq;
 
 	prop->cmd = DTV_FREQUENCY;
 
-	if ((fe_freq = (uint32_t)atoi(channel)) == 0) {
+	if ((fe_freq = channel_frequency(ISDBTYPE_ISDBT, channel)) == 0) {
 		fprintf(stderr, "Error: channel is not number\n");
 		return 1;
 	}
 
-	prop->u.data = (fe_freq * 6000 + 395143) * 1000;
+	prop->u.data = fe_freq * 1000;
 	fprintf(stderr, "Info: Tuning to %d kHz\n", prop->u.data / 1000);
 
 	return 0;
@@ -85,26 +122,10 @@ static int set_isdb_t_frequency(const char *channel, struct dtv_property *prop)
 
 static int set_isdb_s_frequency(const char *channel, struct dtv_property *prop)
 {
-	uint32_t fe_freq;
-
 	prop->cmd = DTV_FREQUENCY;
 
-	if (((channel[0] == 'b') || (channel[0] == 'B')) &&
-	    ((channel[1] == 's') || (channel[1] == 'S'))) {
-		if ((fe_freq = (uint32_t)atoi(channel + 2)) == 0) {
-			fprintf(stderr, "Error: channel is not BSnn (nn=numeric)\n");
-			return 1;
-		}
-		prop->u.data = fe_freq * 19180 + 1030300;
-	} else if (((channel[0] == 'n')||(channel[0] == 'N')) &&
-		   ((channel[1] == 'd')||(channel[1] == 'D'))) {
-		if ((fe_freq = (uint32_t)atoi(channel + 2)) == 0) {
-			fprintf(stderr, "Error: channel is not NDnn (nn=numeric)\n");
-			return 1;
-		}
-		prop->u.data = fe_freq * 20000 + 1573000;
-	} else {
-		fprintf(stderr, "Error: channel is invalid\n");
+	if ((prop->u.data = channel_frequency(ISDBTYPE_ISDBS, channel)) == 0) {
+		fprintf(stderr, "Error: channel is not BSnn or NDnn (nn=numeric)\n");
 		return 1;
 	}
 
@@ -112,7 +133,7 @@ static int set_isdb_s_frequency(const char *channel, struct dtv_property *prop)
 	return 0;
 }
 
-static int frontend_show_info(int fefd)
+int frontend_show_info(int fefd)
 {
 	struct dvb_frontend_info fe_info;
 
@@ -132,14 +153,39 @@ static int frontend_show_info(int fefd)
 	return 0;
 }
 
-int open_frontend(int dev_num)
+/* parse "ADAPTER[.FRONTEND]", returns end of parsed string or NULL */
+const char *parse_device(const char *str, int *dev_num, int *fe_num)
+{
+	char *endptr;
+	long v;
+
+	v = strtol(str, &endptr, 10);
+	if (endptr == str || v < 0 || v > 255) {
+		return NULL;
+	}
+	*dev_num = (int)v;
+	*fe_num = 0;
+
+	if (*endptr == '.') {
+		str = endptr + 1;
+		v = strtol(str, &endptr, 10);
+		if (endptr == str || v < 0 || v > 255) {
+			return NULL;
+		}
+		*fe_num = (int)v;
+	}
+
+	return endptr;
+}
+
+int open_frontend(int dev_num, int fe_num)
 {
 	int fefd;
-	int isdbtype;
 	char device[DEVNAME_BUFFER] = {0};
 
-	sprintf(device, "/dev/dvb/adapter%d/frontend0", dev_num);
-	fefd = open(device, O_RDWR);
+	/* non-blocking, so that frontend events can be drained */
+	sprintf(device, "/dev/dvb/adapter%d/frontend%d", dev_num, fe_num);
+	fefd = open(device, O_RDWR | O_NONBLOCK);
 	if (fefd < 0) {
 		fprintf(stderr, "Error: Cannot open dvb frontend. (errno=%d)\n", errno);
 		return -1;
@@ -147,27 +193,54 @@ int open_frontend(int dev_num)
 	
 	fprintf(stderr, "Info: DVB frontend = %s\n", device);
 
+	return fefd;
+}
+
+/* delivery system without messages, for inventory */
+int frontend_isdbtype(int fefd)
+{
+	return get_isdbtype(fefd);
+}
+
+/* check frontend is ISDB-T/ISDB-S tuner */
+int frontend_probe(int fefd)
+{
+	int isdbtype;
+
 	/* check isdb type */
 	isdbtype = get_isdbtype(fefd);
 
 	if ((isdbtype != ISDBTYPE_ISDBT) && (isdbtype != ISDBTYPE_ISDBS)) {
 		fprintf(stderr, "Error: tuner type is not ISDB-T/ISDB-S.\n");
-		close(fefd);
 		return -1;
 	}
 	fprintf(stderr, "Info: Tuner type is %s\n", isdbtype == ISDBTYPE_ISDBT ? "ISDB-T" : "ISDB-S");
 
-	if (frontend_show_info(fefd) != 0) {
-		close(fefd);
+	return isdbtype;
+}
+
+/* take one queued frontend event. returns 1 if no event is queued. */
+int frontend_get_event(int fefd, unsigned int *status)
+{
+	struct dvb_frontend_event event;
+
+	if (ioctl(fefd, FE_GET_EVENT, &event) == -1) {
+		if (errno == EWOULDBLOCK) {
+			return 1;
+		}
+		if (errno == EOVERFLOW) {
+			/* older events are lost, next call returns the latest */
+			return frontend_get_event(fefd, status);
+		}
 		return -1;
 	}
 
-	return fefd;
+	*status = event.status;
+	return 0;
 }
 
-int frontend_tune(int fefd, char *channel, unsigned int tsid, int lnb)
+int frontend_tune(int fefd, int isdbtype, char *channel, unsigned int tsid, int lnb)
 {
-	int isdbtype;
 	struct dtv_property prop[4];
 	struct dtv_properties props;
 
@@ -175,8 +248,6 @@ int frontend_tune(int fefd, char *channel, unsigned int tsid, int lnb)
 	props.num = 0;
 	props.props = prop;
 
-	isdbtype = get_isdbtype(fefd);
-
 	if (isdbtype == ISDBTYPE_ISDBT) {
 		/* frequency */
 		if (set_isdb_t_frequency(channel, &prop[props.num]) != 0) {
@@ -270,6 +341,69 @@ void frontend_show_stats(int fefd)
 	}
 }
 
+int frontend_get_stats(int fefd, struct frontend_stats *st)
+{
+	struct dtv_property prop[4];
+	struct dtv_properties props;
+	prop[0].cmd = DTV_STAT_CNR;
+	prop[1].cmd = DTV_STAT_ERROR_BLOCK_COUNT;
+	prop[2].cmd = DTV_STAT_TOTAL_BLOCK_COUNT;
+	prop[3].cmd = DTV_STAT_SIGNAL_STRENGTH;
+	props.props = prop;
+	props.num = 4;
+
+	memset(st, 0, sizeof(*st));
+	if (ioctl(fefd, FE_GET_PROPERTY, &props) != 0) {
+		return -1;
+	}
+
+	/* only global (first) layer is taken */
+	if (prop[0].u.st.len > 0 && prop[0].u.st.stat[0].scale == FE_SCALE_DECIBEL) {
+		st->cnr_valid = 1;
+		st->cnr = (double)prop[0].u.st.stat[0].svalue / 1000;
+	}
+
+	if (prop[1].u.st.len > 0 && prop[1].u.st.stat[0].scale == FE_SCALE_COUNTER &&
+	    prop[2].u.st.len > 0 && prop[2].u.st.stat[0].scale == FE_SCALE_COUNTER) {
+		st->blocks_valid = 1;
+		st->error_blocks = prop[1].u.st.stat[0].uvalue;
+		st->total_blocks = prop[2].u.st.stat[0].uvalue;
+	}
+
+	if (prop[3].u.st.len > 0) {
+		switch (prop[3].u.st.stat[0].scale) {
+		case FE_SCALE_RELATIVE:
+			st->signal_valid = 1;
+			st->signal = (double)prop[3].u.st.stat[0].uvalue / 655.35;
+			break;
+		case FE_SCALE_DECIBEL:
+			st->signal_valid = 1;
+			st->signal = (double)prop[3].u.st.stat[0].svalue / 1000;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/* poll lock status until locked or timeout */
+int frontend_wait_lock(int fefd, int timeout_ms, uint32_t *lock_ms)
+{
+	uint64_t start = now_ms();
+
+	while (now_ms() - start < (uint64_t)timeout_ms) {
+		if (frontend_locked(fefd) == 0) {
+			*lock_ms = (uint32_t)(now_ms() - start);
+			return 0;
+		}
+		usleep(20000);
+	}
+
+	return -1;
+}
+
 int frontend_locked(int fefd)
 {
 	unsigned int status;
@@ -284,7 +418,7 @@ int frontend_locked(int fefd)
 	return 1;
 }
 
-void frontend_show_frequency(int fefd)
+void frontend_show_frequency(int fefd, int isdbtype)
 {
 	struct dtv_properties props;
 	struct dtv_property prop[1];
@@ -298,7 +432,7 @@ void frontend_show_frequency(int fefd)
 		return;
 	}
 
-	if (get_isdbtype(fefd) == ISDBTYPE_ISDBT) {
+	if (isdbtype == ISDBTYPE_ISDBT) {
 		fprintf(stderr, "Info: Tuned %d KHz.\n", prop[0].u.data / 1000);
 	} else {
 		fprintf(stderr, "Info: Tuned %d MHz.\n", prop[0].u.data / 1000);
@@ -307,12 +441,12 @@ void frontend_show_frequency(int fefd)
 	return;
 }
 
-int open_demux(int dev_num)
+int open_demux(int dev_num, int fe_num)
 {
 	int dmxfd = -1;
 	char device[DEVNAME_BUFFER] = {0};
 
-	sprintf(device, "/dev/dvb/adapter%d/demux0", dev_num);
+	sprintf(device, "/dev/dvb/adapter%d/demux%d", dev_num, fe_num);
 	if ((dmxfd = open(device, O_RDWR)) < 0) {
 		fprintf(stderr, "Error: Cannot open demux device. (errno=%d)\n", errno);
 		return -1;
@@ -321,7 +455,8 @@ int open_demux(int dev_num)
 	return dmxfd;
 }
 
-int demux_start(int dmxfd)
+/* set up filter in advance, demux_start() only has to start it on lock */
+int demux_set_filter(int dmxfd)
 {
 	struct dmx_pes_filter_params filter;
 
@@ -330,7 +465,7 @@ int demux_start(int dmxfd)
 	filter.input = DMX_IN_FRONTEND;
 	filter.output = DMX_OUT_TS_TAP;
 	filter.pes_type = DMX_PES_VIDEO;
-	filter.flags = DMX_IMMEDIATE_START;
+	filter.flags = 0;
 	if (ioctl(dmxfd, DMX_SET_PES_FILTER, &filter) == -1) {
 		fprintf(stderr,"Error: DMX_SET_PES_FILTER failed. (errno=%d)\n", errno);
 		return -1;
@@ -339,12 +474,88 @@ int demux_start(int dmxfd)
 	return 0;
 }
 
-int open_dvr(int dev_num)
+/* deliver complete sections of matching tables, checked by the driver's CRC */
+int demux_set_section(int dmxfd, uint16_t pid, uint8_t table_id, uint8_t mask)
+{
+	struct dmx_sct_filter_params filter;
+
+	memset(&filter, 0, sizeof(filter));
+	filter.pid = pid;
+	filter.filter.filter[0] = table_id;
+	filter.filter.mask[0] = mask;
+	filter.timeout = 0;
+	filter.flags = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
+	if (ioctl(dmxfd, DMX_SET_FILTER, &filter) == -1) {
+		fprintf(stderr,"Error: DMX_SET_FILTER failed. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+int demux_set_buffer(int dmxfd, unsigned long size)
+{
+	if (ioctl(dmxfd, DMX_SET_BUFFER_SIZE, size) == -1) {
+		fprintf(stderr,"Error: DMX_SET_BUFFER_SIZE failed. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* read one section within timeout, returns length or -1 */
+int demux_read_section(int dmxfd, uint8_t *buf, size_t len, int timeout_ms)
+{
+	struct pollfd pfd = {dmxfd, POLLIN, 0};
+	uint64_t deadline = now_ms() + (uint64_t)timeout_ms;
+
+	while (1) {
+		uint64_t now = now_ms();
+		ssize_t n;
+
+		if (now >= deadline) {
+			return -1;
+		}
+		if (poll(&pfd, 1, (int)(deadline - now)) <= 0) {
+			continue;
+		}
+		n = read(dmxfd, buf, len);
+		if (n >= 8) {
+			return (int)n;
+		}
+		/* overflow and CRC errors only lose a section */
+		if (n < 0 && errno != EAGAIN && errno != EOVERFLOW && errno != EINTR && errno != EBADMSG) {
+			return -1;
+		}
+	}
+}
+
+int demux_start(int dmxfd)
+{
+	if (ioctl(dmxfd, DMX_START) == -1) {
+		fprintf(stderr,"Error: DMX_START failed. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+int demux_stop(int dmxfd)
+{
+	if (ioctl(dmxfd, DMX_STOP) == -1) {
+		fprintf(stderr,"Error: DMX_STOP failed. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+int open_dvr(int dev_num, int fe_num)
 {
 	int dvrfd = -1;
 	char device[DEVNAME_BUFFER] = {0};
 
-	sprintf(device, "/dev/dvb/adapter%d/dvr0", dev_num);
+	sprintf(device, "/dev/dvb/adapter%d/dvr%d", dev_num, fe_num);
 	if ((dvrfd = open(device, O_RDONLY | O_NONBLOCK)) < 0) {
 		fprintf(stderr, "Error: Cannot open dvr device. (errno=%d)\n", errno);
 		return -1;
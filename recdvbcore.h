@@ -17,19 +17,49 @@
 #ifndef RECDVB_RECDVBCORE_H
 #define RECDVB_RECDVBCORE_H
 
+#include <stdint.h>
+
+#define ISDBTYPE_ISDBT 0
+#define ISDBTYPE_ISDBS 1
+
+struct frontend_stats {
+	int cnr_valid;
+	double cnr;                /* dB */
+	int blocks_valid;
+	uint64_t error_blocks;
+	uint64_t total_blocks;
+	int signal_valid;
+	double signal;             /* dBm or percent, same as shown */
+};
+
+/* device */
+const char *parse_device(const char *str, int *dev_num, int *fe_num);
+
 /* frontend */
-int open_frontend(int dev_num);
-int frontend_tune(int fefd, char *channel, unsigned int tsid, int lnb);
+uint32_t channel_frequency(int isdbtype, const char *channel);
+int open_frontend(int dev_num, int fe_num);
+int frontend_probe(int fefd);
+int frontend_isdbtype(int fefd);
+int frontend_get_event(int fefd, unsigned int *status);
+int frontend_show_info(int fefd);
+int frontend_tune(int fefd, int isdbtype, char *channel, unsigned int tsid, int lnb);
 void frontend_show_stats(int fefd);
+int frontend_get_stats(int fefd, struct frontend_stats *st);
 int frontend_locked(int fefd);
-void frontend_show_frequency(int fefd);
+int frontend_wait_lock(int fefd, int timeout_ms, uint32_t *lock_ms);
+void frontend_show_frequency(int fefd, int isdbtype);
 
 /* demux */
-int open_demux(int dev_num);
+int open_demux(int dev_num, int fe_num);
+int demux_set_filter(int dmxfd);
+int demux_set_section(int dmxfd, uint16_t pid, uint8_t table_id, uint8_t mask);
+int demux_set_buffer(int dmxfd, unsigned long size);
+int demux_read_section(int dmxfd, uint8_t *buf, size_t len, int timeout_ms);
 int demux_start(int dmxfd);
+int demux_stop(int dmxfd);
 
 /* dvr */
-int open_dvr(int dev_num);
+int open_dvr(int dev_num, int fe_num);
 
 #endif
 
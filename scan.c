@@ -0,0 +1,359 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "scan.h"
+
+#include "recdvbcore.h"
+#include "adapter.h"
+#include "chdb.h"
+#include "trace.h"
+
+#define SECTION_MAX 4096
+
+typedef struct scan_job {
+	int isdbtype;
+	int streams;               /* TS per transponder, index is appended if more than one */
+	char name[CHDB_NAME_MAX];  /* transponder, as users type it */
+} scan_job;
+
+typedef struct scan_worker {
+	pthread_t thread;
+	int dev_num;
+	int fe_num;
+	int isdbtype;
+	int lockfd;
+	int fefd;
+	int dmxfd;
+	int lnb;
+	int found;
+} scan_worker;
+
+/* shared by workers, guarded by mutex */
+static pthread_mutex_t scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static scan_job jobs[128];
+static int num_jobs;
+static int next_job[2];            /* next job per delivery system */
+static chdb_entry entries[SCAN_MAX_ENTRIES];
+static uint32_t num_entries;
+static chdb_service services[SCAN_MAX_SERVICES];
+static uint32_t num_services;
+
+static void add_jobs(void)
+{
+	int ch;
+
+	for (ch = 13; ch <= 62; ch++) {
+		jobs[num_jobs].isdbtype = ISDBTYPE_ISDBT;
+		jobs[num_jobs].streams = 1;
+		snprintf(jobs[num_jobs++].name, CHDB_NAME_MAX, "%d", ch);
+	}
+	for (ch = 1; ch <= 23; ch += 2) {
+		jobs[num_jobs].isdbtype = ISDBTYPE_ISDBS;
+		jobs[num_jobs].streams = SCAN_MAX_STREAMS;
+		snprintf(jobs[num_jobs++].name, CHDB_NAME_MAX, "bs%02d", ch);
+	}
+	for (ch = 2; ch <= 24; ch += 2) {
+		/* one TS on CS transponder, stored as "ndNN" */
+		jobs[num_jobs].isdbtype = ISDBTYPE_ISDBS;
+		jobs[num_jobs].streams = 1;
+		snprintf(jobs[num_jobs++].name, CHDB_NAME_MAX, "nd%02d", ch);
+	}
+}
+
+static scan_job *take_job(int isdbtype)
+{
+	scan_job *job = NULL;
+
+	pthread_mutex_lock(&scan_mutex);
+	while (next_job[isdbtype] < num_jobs) {
+		scan_job *j = &jobs[next_job[isdbtype]++];
+		if (j->isdbtype == isdbtype) {
+			job = j;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&scan_mutex);
+
+	return job;
+}
+
+/* services from SDT actual, all sections */
+static void read_sdt(scan_worker *w, chdb_entry *e, chdb_service *svc, uint32_t *nsvc, uint32_t max)
+{
+	uint8_t sec[SECTION_MAX];
+	uint8_t seen[256] = {0};
+	int last = -1, got = 0;
+	uint64_t deadline = trace_now() + (uint64_t)SCAN_SDT_MSEC * 1000000;
+
+	if (demux_set_section(w->dmxfd, 0x11, 0x42, 0xff) != 0) {
+		return;
+	}
+
+	while (last < 0 || got <= last) {
+		int len, pos, end;
+		uint64_t now = trace_now();
+
+		if (now >= deadline) {
+			break;
+		}
+		len = demux_read_section(w->dmxfd, sec, sizeof(sec), (int)((deadline - now) / 1000000) + 1);
+		if (len < 15) {
+			continue;
+		}
+		if (((sec[3] << 8) | sec[4]) != (int)e->tsid || seen[sec[6]]) {
+			continue;
+		}
+		seen[sec[6]] = 1;
+		got++;
+		last = sec[7];
+		e->network_id = (uint32_t)((sec[8] << 8) | sec[9]);
+
+		end = 3 + (((sec[1] & 0x0f) << 8) | sec[2]) - 4;
+		if (end > len) {
+			end = len;
+		}
+		for (pos = 11; pos + 5 <= end && *nsvc < max; ) {
+			chdb_service *s = &svc[*nsvc];
+			int dlen = ((sec[pos + 3] & 0x0f) << 8) | sec[pos + 4];
+			int d = pos + 5;
+
+			memset(s, 0, sizeof(*s));
+			s->service_id = (uint16_t)((sec[pos] << 8) | sec[pos + 1]);
+			for (; d + 2 <= pos + 5 + dlen && d + 2 <= end; d += 2 + sec[d + 1]) {
+				/* service descriptor */
+				if (sec[d] == 0x48 && d + 4 <= end) {
+					int plen = sec[d + 3];
+					int n = d + 4 + plen < end ? sec[d + 4 + plen] : 0;
+					if (n > CHDB_SERVICE_NAME_MAX) {
+						n = CHDB_SERVICE_NAME_MAX;
+					}
+					if (d + 5 + plen + n > end) {
+						n = 0;
+					}
+					s->type = sec[d + 2];
+					s->name_len = (uint8_t)n;
+					memcpy(s->name, &sec[d + 5 + plen], (size_t)n);
+				}
+			}
+			(*nsvc)++;
+			pos += 5 + dlen;
+		}
+	}
+}
+
+/* tune one stream and fill entry, returns -1 if nothing found */
+static int scan_stream(scan_worker *w, const scan_job *job, int index, chdb_entry *e,
+		       chdb_service *svc, uint32_t *nsvc, uint32_t max)
+{
+	uint8_t sec[SECTION_MAX];
+	struct frontend_stats st;
+
+	memset(e, 0, sizeof(*e));
+	if (job->streams > 1) {
+		snprintf(e->name, CHDB_NAME_MAX, "%s_%d", job->name, index);
+	} else {
+		snprintf(e->name, CHDB_NAME_MAX, "%s", job->name);
+	}
+	e->isdbtype = job->isdbtype;
+	e->freq_khz = channel_frequency(job->isdbtype, job->name);
+	e->cnr_x100 = INT32_MIN;
+
+	/* drivers take stream id below 8 as relative index on transponder */
+	demux_stop(w->dmxfd);
+	if (frontend_tune(w->fefd, job->isdbtype, (char *)job->name, (unsigned int)index, w->lnb) != 0) {
+		return -1;
+	}
+	if (frontend_wait_lock(w->fefd, SCAN_LOCK_MSEC, &e->lock_ms) != 0) {
+		return -1;
+	}
+	if (frontend_get_stats(w->fefd, &st) == 0 && st.cnr_valid) {
+		e->cnr_x100 = (int32_t)(st.cnr * 100);
+	}
+
+	/* TSID from PAT */
+	if (demux_set_section(w->dmxfd, 0x00, 0x00, 0xff) != 0 ||
+	    demux_read_section(w->dmxfd, sec, sizeof(sec), SCAN_PAT_MSEC) < 0) {
+		return -1;
+	}
+	e->tsid = (uint32_t)((sec[3] << 8) | sec[4]);
+
+	e->service_first = 0;
+	read_sdt(w, e, svc, nsvc, max);
+
+	return 0;
+}
+
+static void commit_entry(chdb_entry *e, const chdb_service *svc, uint32_t nsvc)
+{
+	pthread_mutex_lock(&scan_mutex);
+	if (num_entries < SCAN_MAX_ENTRIES && num_services + nsvc <= SCAN_MAX_SERVICES) {
+		e->service_first = num_services;
+		e->service_count = nsvc;
+		memcpy(&services[num_services], svc, nsvc * sizeof(chdb_service));
+		num_services += nsvc;
+		entries[num_entries++] = *e;
+	}
+	pthread_mutex_unlock(&scan_mutex);
+
+	fprintf(stderr, "Info: Found %-8s tsid=0x%04x onid=0x%04x lock=%ums cnr=%.2lfdB services=%u\n",
+		e->name, e->tsid, e->network_id, e->lock_ms,
+		e->cnr_x100 == INT32_MIN ? 0.0 : e->cnr_x100 / 100.0, nsvc);
+}
+
+static void *scan_func(void *p)
+{
+	scan_worker *w = (scan_worker *)p;
+	chdb_service svc[256];
+	scan_job *job;
+
+	while ((job = take_job(w->isdbtype)) != NULL) {
+		int index;
+		uint32_t prev_tsid = 0;
+
+		for (index = 0; index < job->streams; index++) {
+			chdb_entry e;
+			uint32_t nsvc = 0;
+
+			if (scan_stream(w, job, index, &e, svc, &nsvc, 256) != 0) {
+				break;
+			}
+			/* driver ignored stream index */
+			if (index > 0 && e.tsid == prev_tsid) {
+				break;
+			}
+			prev_tsid = e.tsid;
+			commit_entry(&e, svc, nsvc);
+			w->found++;
+		}
+	}
+
+	return NULL;
+}
+
+static int compare_entry(const void *a, const void *b)
+{
+	const chdb_entry *x = a;
+	const chdb_entry *y = b;
+
+	if (x->isdbtype != y->isdbtype) {
+		return x->isdbtype - y->isdbtype;
+	}
+	if (x->freq_khz != y->freq_khz) {
+		return x->freq_khz < y->freq_khz ? -1 : 1;
+	}
+	return strcmp(x->name, y->name);
+}
+
+int scan_main(struct recdvb_options *opts)
+{
+	static adapter_info inv[ADAPTER_MAX];
+	static scan_worker workers[ADAPTER_MAX];
+	int nworkers = 0;
+	int i, n;
+	uint64_t start = trace_now();
+
+	add_jobs();
+
+	/* one worker per free ISDB frontend */
+	n = adapter_list(inv, ADAPTER_MAX);
+	for (i = 0; i < n; i++) {
+		scan_worker *w = &workers[nworkers];
+
+		if (inv[i].isdbtype != ISDBTYPE_ISDBT && inv[i].isdbtype != ISDBTYPE_ISDBS) {
+			continue;
+		}
+		w->lockfd = adapter_lock(inv[i].dev_num, inv[i].fe_num);
+		if (w->lockfd == -1) {
+			fprintf(stderr, "Info: Device %d.%d is busy, skipped.\n", inv[i].dev_num, inv[i].fe_num);
+			continue;
+		}
+		w->dev_num = inv[i].dev_num;
+		w->fe_num = inv[i].fe_num;
+		w->isdbtype = inv[i].isdbtype;
+		w->lnb = opts->lnb;
+		w->found = 0;
+		w->fefd = open_frontend(w->dev_num, w->fe_num);
+		w->dmxfd = w->fefd < 0 ? -1 : open_demux(w->dev_num, w->fe_num);
+		if (w->dmxfd < 0) {
+			if (w->fefd >= 0) {
+				close(w->fefd);
+			}
+			if (w->lockfd >= 0) {
+				close(w->lockfd);
+			}
+			continue;
+		}
+		nworkers++;
+	}
+	if (nworkers == 0) {
+		fprintf(stderr, "Error: No tuner is available for scan.\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Info: Scanning %d transponders with %d tuner(s).\n", num_jobs, nworkers);
+	for (i = 0; i < nworkers; i++) {
+		pthread_create(&workers[i].thread, NULL, scan_func, &workers[i]);
+	}
+	for (i = 0; i < nworkers; i++) {
+		scan_worker *w = &workers[i];
+
+		pthread_join(w->thread, NULL);
+		fprintf(stderr, "Info: Device %d.%d found %d stream(s).\n", w->dev_num, w->fe_num, w->found);
+		close(w->dmxfd);
+		close(w->fefd);
+		if (w->lockfd >= 0) {
+			close(w->lockfd);
+		}
+	}
+
+	/* order does not matter for lookup, keep it readable */
+	qsort(entries, num_entries, sizeof(chdb_entry), compare_entry);
+	{
+		uint32_t k, first = 0;
+		static chdb_service sorted[SCAN_MAX_SERVICES];
+
+		for (k = 0; k < num_entries; k++) {
+			memcpy(&sorted[first], &services[entries[k].service_first],
+			       entries[k].service_count * sizeof(chdb_service));
+			entries[k].service_first = first;
+			first += entries[k].service_count;
+		}
+		memcpy(services, sorted, first * sizeof(chdb_service));
+	}
+
+	fprintf(stderr, "Info: Scan finished in %.1lfsec, %u stream(s), %u service(s).\n",
+		(trace_now() - start) / 1000000000.0, num_entries, num_services);
+
+	if (num_entries == 0) {
+		fprintf(stderr, "Error: No channel found, %s is not written.\n", opts->scan_path);
+		return 1;
+	}
+	if (chdb_write(opts->scan_path, entries, num_entries, services, num_services) != 0) {
+		return 1;
+	}
+	fprintf(stderr, "Info: Channel database written to %s\n", opts->scan_path);
+
+	return 0;
+}
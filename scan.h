@@ -0,0 +1,37 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_SCAN_H
+#define RECDVB_SCAN_H
+
+#include "recdvb.h"
+
+/*
+ * sweep ISDB-T UHF 13-62, BS odd 1-23 and CS (ND) even 2-24 with
+ * every free tuner in parallel, then write the channel database (see
+ * chdb.h). satellite transponders are tried with relative stream
+ * index 0-7, their TSID is taken from PAT.
+ */
+#define SCAN_MAX_ENTRIES 512
+#define SCAN_MAX_SERVICES 4096
+#define SCAN_MAX_STREAMS 8
+#define SCAN_LOCK_MSEC 3000
+#define SCAN_PAT_MSEC 1000
+#define SCAN_SDT_MSEC 4000
+
+int scan_main(struct recdvb_options *opts);
+
+#endif
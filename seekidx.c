@@ -0,0 +1,185 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "seekidx.h"
+
+static uint64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void flush_batch(seekidx *x)
+{
+	size_t len = (size_t)x->num * sizeof(seekidx_entry);
+
+	/* whole entries, readers never see a gap */
+	if (x->num > 0 && write(x->fd, x->batch, len) != (ssize_t)len) {
+		fprintf(stderr, "Error: Cannot write seek index. (errno=%d)\n", errno);
+	}
+	x->num = 0;
+	x->last_flush = x->now;
+}
+
+/* create DESTFILE.idx, an entry at most every granularity msec */
+int seekidx_open(seekidx *x, const char *destfile, int granularity)
+{
+	seekidx_header h;
+	char *path;
+
+	memset(x, 0, sizeof(*x));
+	path = malloc(strlen(destfile) + sizeof(SEEKIDX_SUFFIX));
+	if (!path) {
+		return -1;
+	}
+	sprintf(path, "%s%s", destfile, SEEKIDX_SUFFIX);
+	x->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (x->fd < 0) {
+		fprintf(stderr, "Error: Cannot open seek index %s. (errno=%d)\n", path, errno);
+		free(path);
+		return -1;
+	}
+	free(path);
+
+	x->granularity = (uint64_t)granularity * 27000;
+	x->pcr = SEEKIDX_NONE;
+	x->pts = SEEKIDX_NONE;
+	x->last_clock = SEEKIDX_NONE;
+	x->now = realtime_ns();
+	x->last_flush = x->now;
+	ts_reader_init(&x->reader);
+	psi_init(&x->psi);
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, SEEKIDX_MAGIC, sizeof(h.magic));
+	h.version = SEEKIDX_VERSION;
+	h.entry_size = sizeof(seekidx_entry);
+	h.granularity = (uint32_t)granularity;
+	h.start_time = x->now;
+	if (write(x->fd, &h, sizeof(h)) != sizeof(h)) {
+		fprintf(stderr, "Error: Cannot write seek index. (errno=%d)\n", errno);
+		close(x->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* 33bit PTS of PES starting in packet */
+static int get_pts(const uint8_t *pkt, uint64_t *pts)
+{
+	int off = ts_payload_offset(pkt);
+	const uint8_t *p;
+
+	if (off < 0 || off + 14 > TS_PACKET_SIZE) {
+		return 0;
+	}
+	p = pkt + off;
+	if (p[0] != 0 || p[1] != 0 || p[2] != 1 || !(p[7] & 0x80)) {
+		return 0;
+	}
+	*pts = ((uint64_t)(p[9] & 0x0e) << 29) | ((uint64_t)p[10] << 22) |
+		((uint64_t)(p[11] & 0xfe) << 14) | ((uint64_t)p[12] << 7) | (p[13] >> 1);
+
+	return 1;
+}
+
+static void add_entry(seekidx *x, const uint8_t *pkt, uint64_t offset, uint64_t clock, uint32_t flags)
+{
+	seekidx_entry *e = &x->batch[x->num++];
+
+	e->offset = offset;
+	e->time = x->now;
+	e->pcr = x->pcr;
+	e->pts = x->pts;
+	e->flags = flags;
+	e->pid = TS_PID(pkt);
+	e->reserved = 0;
+	x->last_clock = clock;
+	x->count++;
+
+	if (x->num == SEEKIDX_BATCH || x->now - x->last_flush >= SEEKIDX_FLUSH_NS) {
+		flush_batch(x);
+	}
+}
+
+static void on_packet(void *arg, const uint8_t *pkt)
+{
+	seekidx *x = arg;
+	uint16_t pid = TS_PID(pkt);
+	uint64_t offset, clock, pcr;
+	int rap = 0;
+
+	psi_packet(&x->psi, pkt);
+
+	if (pid == x->psi.pcr_pid && ts_get_pcr(pkt, &pcr)) {
+		x->pcr = pcr;
+	}
+	if (x->psi.num_video > 0 && pid == x->psi.video_pid[0]) {
+		if (TS_PUSI(pkt)) {
+			get_pts(pkt, &x->pts);
+		}
+		rap = psi_is_rap(&x->psi, pkt);
+	} else if (pid != x->psi.pcr_pid) {
+		return;
+	}
+
+	/* stream clock, wall clock until PCR is known */
+	clock = x->pcr != SEEKIDX_NONE ? x->pcr : x->now / 1000 * 27;
+	if (x->last_clock != SEEKIDX_NONE && clock >= x->last_clock && clock - x->last_clock < x->granularity) {
+		return;
+	}
+	/* prefer random access points, other packets when there is no video */
+	if (!rap && x->last_clock != SEEKIDX_NONE && clock >= x->last_clock &&
+	    clock - x->last_clock < x->granularity * 2 && x->psi.num_video > 0) {
+		return;
+	}
+
+	offset = pkt == x->reader.carry ? x->carry_pos : x->cur_pos + (uint64_t)(pkt - x->cur);
+	add_entry(x, pkt, offset, clock, rap ? SEEKIDX_RAP : 0);
+}
+
+/* follow data written to output */
+void seekidx_feed(seekidx *x, const uint8_t *data, size_t len)
+{
+	x->now = realtime_ns();
+	x->carry_pos = x->pos - x->reader.carry_len;
+	x->cur = data;
+	x->cur_pos = x->pos;
+	ts_reader_feed(&x->reader, data, len, on_packet, x);
+	x->pos += len;
+}
+
+void seekidx_close(seekidx *x)
+{
+	if (x->fd < 0) {
+		return;
+	}
+	flush_batch(x);
+	close(x->fd);
+	x->fd = -1;
+}
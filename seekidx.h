@@ -0,0 +1,80 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_SEEKIDX_H
+#define RECDVB_SEEKIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "psi.h"
+
+#define SEEKIDX_MAGIC    "RDVSIDX1"
+#define SEEKIDX_VERSION  1
+#define SEEKIDX_SUFFIX   ".idx"
+#define SEEKIDX_NONE     UINT64_MAX  /* pcr or pts not seen yet */
+#define SEEKIDX_RAP      0x0001      /* entry is video random access point */
+#define SEEKIDX_BATCH    128         /* entries appended at once */
+#define SEEKIDX_FLUSH_NS 1000000000  /* longest time entries are held */
+
+/*
+ * sidecar file, host byte order. header is followed by fixed size
+ * entries in stream order, appended while recording. a reader of a
+ * recording in progress ignores a partial entry at the end.
+ */
+typedef struct seekidx_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t granularity;      /* msec between entries */
+	uint32_t reserved;
+	uint64_t start_time;       /* realtime ns */
+} seekidx_header;
+
+typedef struct seekidx_entry {
+	uint64_t offset;           /* of packet in output file */
+	uint64_t time;             /* realtime ns when written */
+	uint64_t pcr;              /* 27MHz, latest on PCR pid */
+	uint64_t pts;              /* 90kHz, latest of video */
+	uint32_t flags;
+	uint16_t pid;              /* of packet at offset */
+	uint16_t reserved;
+} seekidx_entry;
+
+typedef struct seekidx {
+	int fd;
+	uint64_t granularity;      /* 27MHz */
+	ts_reader reader;
+	psi_cache psi;
+	uint64_t pos;              /* bytes fed */
+	const uint8_t *cur;        /* data being fed */
+	uint64_t cur_pos;
+	uint64_t carry_pos;        /* of packet completed from carry */
+	uint64_t now;              /* realtime ns of data being fed */
+	uint64_t pcr;
+	uint64_t pts;
+	uint64_t last_clock;       /* 27MHz of last entry */
+	uint64_t last_flush;
+	seekidx_entry batch[SEEKIDX_BATCH];
+	int num;
+	uint64_t count;
+} seekidx;
+
+int seekidx_open(seekidx *x, const char *destfile, int granularity);
+void seekidx_feed(seekidx *x, const uint8_t *data, size_t len);
+void seekidx_close(seekidx *x);
+
+#endif
@@ -0,0 +1,488 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+
+#include "segment.h"
+#include "mkpath.h"
+#include "trace.h"
+
+/*
+ * name of segment. "%N" in pattern is the index, other conversions are
+ * of strftime(3). without any '%', index is put before extension.
+ */
+static int segment_name(const char *pattern, unsigned int index, time_t t, char *buf, size_t len)
+{
+	char fmt[SEGMENT_MAX_PATH];
+	const char *p, *slash, *dot;
+	struct tm tm;
+	size_t n = 0;
+
+	if (!strchr(pattern, '%')) {
+		slash = strrchr(pattern, '/');
+		dot = strrchr(pattern, '.');
+		if (!dot || (slash && dot < slash)) {
+			dot = pattern + strlen(pattern);
+		}
+		n = (size_t)snprintf(buf, len, "%.*s.%03u%s", (int)(dot - pattern), pattern, index, dot);
+		return n < len ? 0 : -1;
+	}
+
+	for (p = pattern; *p && n + 16 < sizeof(fmt); p++) {
+		if (p[0] == '%' && p[1] == 'N') {
+			n += (size_t)sprintf(fmt + n, "%03u", index);
+			p++;
+		} else if (p[0] == '%' && p[1] == '%') {
+			fmt[n++] = *p++;
+			fmt[n++] = *p;
+		} else {
+			fmt[n++] = *p;
+		}
+	}
+	if (*p) {
+		return -1;
+	}
+	fmt[n] = '\0';
+
+	localtime_r(&t, &tm);
+	return strftime(buf, len, fmt, &tm) > 0 ? 0 : -1;
+}
+
+static int make_dir(const char *path)
+{
+	char *tmp = strdup(path);
+	int status;
+
+	if (!tmp) {
+		return -1;
+	}
+	status = mkpath(dirname(tmp), 0777);
+	free(tmp);
+
+	return status;
+}
+
+/* whole manifest as string, called with mutex held */
+static char *format_manifest(segmenter *s, int end)
+{
+	size_t len = 256 + (size_t)s->count * (SEGMENT_MAX_PATH + 96);
+	char *buf = malloc(len);
+	const char *dir = s->manifest;
+	size_t dirlen = strrchr(dir, '/') ? (size_t)(strrchr(dir, '/') - dir + 1) : 0;
+	double target = 1;
+	size_t n = 0;
+	int i;
+
+	if (!buf) {
+		return NULL;
+	}
+	for (i = 0; i < s->count; i++) {
+		if (s->list[i].duration > target) {
+			target = s->list[i].duration;
+		}
+	}
+
+	n += (size_t)snprintf(buf + n, len - n,
+		"#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:%d\n#EXT-X-MEDIA-SEQUENCE:0\n",
+		(int)(target + 0.999));
+	for (i = 0; i < s->count; i++) {
+		segment_entry *e = &s->list[i];
+		const char *name = e->path;
+		char date[32];
+		struct tm tm;
+
+		/* relative to manifest if in same directory */
+		if (dirlen > 0 && strncmp(name, dir, dirlen) == 0) {
+			name += dirlen;
+		}
+		localtime_r(&e->start, &tm);
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", &tm);
+		n += (size_t)snprintf(buf + n, len - n,
+			"#EXT-X-PROGRAM-DATE-TIME:%s\n#EXTINF:%.3lf,\n%s\n", date, e->duration, name);
+	}
+	if (end) {
+		snprintf(buf + n, len - n, "#EXT-X-ENDLIST\n");
+	}
+
+	return buf;
+}
+
+/* replace manifest atomically */
+static void write_manifest(const char *path, const char *text)
+{
+	char tmp[SEGMENT_MAX_PATH + 8];
+	size_t len = strlen(text);
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd == -1) {
+		fprintf(stderr, "Error: Cannot write manifest %s. (errno=%d)\n", path, errno);
+		return;
+	}
+	if (write(fd, text, len) != (ssize_t)len || rename(tmp, path) != 0) {
+		fprintf(stderr, "Error: Cannot write manifest %s. (errno=%d)\n", path, errno);
+		unlink(tmp);
+	}
+	close(fd);
+}
+
+/* creates next segment and rewrites manifest, off the write path */
+static void *segment_worker(void *p)
+{
+	segmenter *s = p;
+
+	pthread_mutex_lock(&s->mutex);
+	while (!s->stop) {
+		if (s->next_state == SEG_NEXT_WANTED) {
+			char path[SEGMENT_MAX_PATH];
+			uint64_t size = s->next_size;
+			int fd;
+
+			snprintf(path, sizeof(path), "%s", s->next_path);
+			pthread_mutex_unlock(&s->mutex);
+
+			make_dir(path);
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+			if (fd != -1 && size > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0) {
+				/* filesystem without fallocate, file is still usable */
+				size = 0;
+			}
+
+			pthread_mutex_lock(&s->mutex);
+			s->next_fd = fd;
+			s->next_size = size;
+			s->next_state = fd != -1 ? SEG_NEXT_READY : SEG_NEXT_FAILED;
+			continue;
+		}
+		if (s->manifest_dirty) {
+			char *text = format_manifest(s, 0);
+
+			s->manifest_dirty = 0;
+			pthread_mutex_unlock(&s->mutex);
+			if (text) {
+				write_manifest(s->manifest, text);
+				free(text);
+			}
+			pthread_mutex_lock(&s->mutex);
+			continue;
+		}
+		pthread_cond_wait(&s->cond, &s->mutex);
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return NULL;
+}
+
+/* ask worker for next segment file of given size */
+static void request_next(segmenter *s, uint64_t size)
+{
+	char predicted[SEGMENT_MAX_PATH];
+	char *tmp;
+
+	if (segment_name(s->pattern, s->index + 1, time(NULL), predicted, sizeof(predicted)) != 0) {
+		s->next_state = SEG_NEXT_FAILED;
+		return;
+	}
+
+	/* temporary name in the directory where next segment likely goes */
+	tmp = strdup(predicted);
+	pthread_mutex_lock(&s->mutex);
+	snprintf(s->next_path, sizeof(s->next_path), "%s/.recdvb-%d-%p.part",
+		tmp ? dirname(tmp) : ".", (int)getpid(), (void *)s);
+	s->next_size = size;
+	s->next_state = SEG_NEXT_WANTED;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+	free(tmp);
+}
+
+int segment_open(segmenter *s, const struct recdvb_options *opts)
+{
+	s->pattern = opts->destfile;
+	s->dur_ns = (uint64_t)opts->segment_sec * 1000000000;
+	s->max_bytes = opts->segment_bytes;
+	s->inject_psi = opts->segment_psi;
+	psi_init(&s->psi);
+
+	s->index = 0;
+	s->bytes = 0;
+	s->start_ns = 0;
+	s->last_ns = 0;
+	s->prealloc = 0;
+	s->start = time(NULL);
+	s->list = NULL;
+	s->count = 0;
+	s->cap = 0;
+	s->next_state = SEG_NEXT_NONE;
+	s->next_fd = -1;
+	s->manifest_dirty = 0;
+	s->stop = 0;
+	s->running = 0;
+
+	if (segment_name(s->pattern, 0, s->start, s->path, sizeof(s->path)) != 0) {
+		fprintf(stderr, "Error: Invalid segment name %s.\n", s->pattern);
+		return -1;
+	}
+	if (make_dir(s->path) != 0) {
+		return -1;
+	}
+	s->fd = open(s->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (s->fd == -1) {
+		return -1;
+	}
+
+	/* manifest next to segments unless given */
+	if (opts->manifest_path) {
+		snprintf(s->manifest, sizeof(s->manifest), "%s", opts->manifest_path);
+	} else {
+		const char *base = strchr(s->pattern, '%') ? s->path : s->pattern;
+		const char *slash = strrchr(base, '/');
+		const char *dot = strrchr(base, '.');
+
+		if (!dot || (slash && dot < slash)) {
+			dot = base + strlen(base);
+		}
+		snprintf(s->manifest, sizeof(s->manifest), "%.*s.m3u8", (int)(dot - base), base);
+	}
+
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if (pthread_create(&s->thread, NULL, segment_worker, s) != 0) {
+		fprintf(stderr, "Error: Cannot create segment thread.\n");
+		close(s->fd);
+		s->fd = -1;
+		return -1;
+	}
+	s->running = 1;
+
+	return 0;
+}
+
+/* first offset where two packets in a row start, or len */
+static size_t packet_start(const uint8_t *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len && i < TS_PACKET_SIZE; i++) {
+		if (data[i] == TS_SYNC_BYTE && (i + TS_PACKET_SIZE >= len || data[i + TS_PACKET_SIZE] == TS_SYNC_BYTE)) {
+			return i;
+		}
+	}
+	return len;
+}
+
+/* bytes of data to write into current segment before rotation */
+size_t segment_room(segmenter *s, const uint8_t *data, size_t len, uint64_t stamp)
+{
+	uint64_t elapsed;
+	size_t off;
+	int due;
+
+	/* data held by decoder belongs to latest chunk */
+	if (stamp == 0) {
+		stamp = s->last_ns ? s->last_ns : trace_now();
+	}
+	if (s->bytes == 0 && s->start_ns == 0) {
+		s->start_ns = stamp;
+	}
+	s->last_ns = stamp;
+	elapsed = stamp > s->start_ns ? stamp - s->start_ns : 0;
+
+	/* half way, prepare next with size of this one */
+	if (s->next_state == SEG_NEXT_NONE) {
+		if (s->max_bytes && s->bytes * 2 >= s->max_bytes) {
+			request_next(s, s->max_bytes);
+		} else if (s->dur_ns && elapsed * 2 >= s->dur_ns && elapsed > 0) {
+			request_next(s, (uint64_t)((double)s->bytes * s->dur_ns / elapsed * 1.1));
+		}
+	}
+
+	if (s->bytes == 0) {
+		return len;
+	}
+	due = (s->dur_ns && elapsed >= s->dur_ns) || (s->max_bytes && s->bytes + len > s->max_bytes);
+	if (!due) {
+		return len;
+	}
+
+	/* split on packet boundary, next chunk if none */
+	off = packet_start(data, len);
+	if (off == len || !(s->max_bytes && s->bytes + len > s->max_bytes)) {
+		return off;
+	}
+	if (s->max_bytes - s->bytes > off) {
+		off += (size_t)((s->max_bytes - s->bytes - off) / TS_PACKET_SIZE) * TS_PACKET_SIZE;
+	}
+
+	return off;
+}
+
+/* account data written to current segment */
+void segment_wrote(segmenter *s, const uint8_t *data, size_t len)
+{
+	s->bytes += len;
+	if (s->inject_psi) {
+		psi_feed(&s->psi, data, len);
+	}
+}
+
+/* close current segment, return unused preallocation */
+static void finish_current(segmenter *s, uint64_t stamp, int sync)
+{
+	segment_entry *e;
+
+	if (s->prealloc > s->bytes && ftruncate(s->fd, (off_t)s->bytes) != 0) {
+		fprintf(stderr, "Error: Cannot truncate %s. (errno=%d)\n", s->path, errno);
+	}
+	if (sync) {
+		fsync(s->fd);
+	}
+	close(s->fd);
+	s->fd = -1;
+
+	pthread_mutex_lock(&s->mutex);
+	if (s->count == s->cap) {
+		int cap = s->cap ? s->cap * 2 : 64;
+		segment_entry *list = realloc(s->list, (size_t)cap * sizeof(*list));
+
+		if (!list) {
+			pthread_mutex_unlock(&s->mutex);
+			return;
+		}
+		s->list = list;
+		s->cap = cap;
+	}
+	e = &s->list[s->count++];
+	snprintf(e->path, sizeof(e->path), "%s", s->path);
+	e->start = s->start;
+	e->duration = stamp > s->start_ns ? (stamp - s->start_ns) / 1000000000.0 : 0;
+	e->bytes = s->bytes;
+	s->manifest_dirty = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+}
+
+/* switch to next segment. returns -1 if it cannot be opened. */
+int segment_rotate(segmenter *s, uint64_t stamp)
+{
+	char path[SEGMENT_MAX_PATH];
+	int fd = -1;
+
+	if (stamp == 0) {
+		stamp = s->last_ns ? s->last_ns : trace_now();
+	}
+	finish_current(s, stamp, 0);
+
+	s->index++;
+	s->start = time(NULL);
+	if (segment_name(s->pattern, s->index, s->start, path, sizeof(path)) != 0) {
+		fprintf(stderr, "Error: Invalid segment name %s.\n", s->pattern);
+		return -1;
+	}
+	s->prealloc = 0;
+
+	/* prepared file, never wait for worker */
+	pthread_mutex_lock(&s->mutex);
+	if (s->next_state == SEG_NEXT_READY) {
+		if (make_dir(path) == 0 && rename(s->next_path, path) == 0) {
+			fd = s->next_fd;
+			s->prealloc = s->next_size;
+		} else {
+			close(s->next_fd);
+			unlink(s->next_path);
+		}
+		s->next_fd = -1;
+		s->next_state = SEG_NEXT_NONE;
+	} else if (s->next_state == SEG_NEXT_FAILED) {
+		s->next_state = SEG_NEXT_NONE;
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	if (fd == -1) {
+		if (make_dir(path) != 0) {
+			fprintf(stderr, "Error: Cannot create directory for %s. (errno=%d)\n", path, errno);
+			return -1;
+		}
+		fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (fd == -1) {
+			fprintf(stderr, "Error: Cannot open %s. (errno=%d)\n", path, errno);
+			return -1;
+		}
+	}
+
+	s->fd = fd;
+	snprintf(s->path, sizeof(s->path), "%s", path);
+	s->bytes = 0;
+	s->start_ns = stamp;
+
+	return 0;
+}
+
+/* data to start new segment with, so that it is decodable on its own */
+size_t segment_head(segmenter *s, uint8_t *buf, size_t len)
+{
+	if (!s->inject_psi || !psi_ready(&s->psi)) {
+		return 0;
+	}
+	return psi_packets(&s->psi, buf, len);
+}
+
+void segment_close(segmenter *s, int sync)
+{
+	char *text;
+
+	if (s->fd != -1) {
+		finish_current(s, s->last_ns ? s->last_ns : trace_now(), sync);
+	}
+	if (!s->running) {
+		return;
+	}
+
+	pthread_mutex_lock(&s->mutex);
+	s->stop = 1;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+	pthread_join(s->thread, NULL);
+	s->running = 0;
+
+	/* unused prepared file */
+	if (s->next_state == SEG_NEXT_READY) {
+		close(s->next_fd);
+		unlink(s->next_path);
+	} else if (s->next_state == SEG_NEXT_WANTED) {
+		unlink(s->next_path);
+	}
+
+	text = format_manifest(s, 1);
+	if (text) {
+		write_manifest(s->manifest, text);
+		free(text);
+	}
+	fprintf(stderr, "Info: %d segments, manifest %s\n", s->count, s->manifest);
+
+	free(s->list);
+	s->list = NULL;
+	pthread_mutex_destroy(&s->mutex);
+	pthread_cond_destroy(&s->cond);
+}
@@ -0,0 +1,91 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_SEGMENT_H
+#define RECDVB_SEGMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "recdvb.h"
+#include "psi.h"
+
+#define SEGMENT_MAX_PATH 512
+#define SEGMENT_MIN_BYTES (1 << 20)
+
+/* finished segment, listed in manifest */
+typedef struct segment_entry {
+	char path[SEGMENT_MAX_PATH];
+	time_t start;
+	double duration;
+	uint64_t bytes;
+} segment_entry;
+
+/* state of next segment file */
+enum segment_next {
+	SEG_NEXT_NONE,
+	SEG_NEXT_WANTED,           /* worker is creating it */
+	SEG_NEXT_READY,
+	SEG_NEXT_FAILED,           /* do not ask again until rotation */
+};
+
+/* output split into files by duration or size */
+typedef struct segmenter {
+	const char *pattern;
+	char manifest[SEGMENT_MAX_PATH];
+	uint64_t dur_ns;           /* 0 for no limit */
+	uint64_t max_bytes;        /* 0 for no limit */
+	int inject_psi;
+	psi_cache psi;
+	uint8_t head[PSI_PACKETS_SIZE]; /* PAT/PMT written first in segment */
+
+	/* current segment */
+	int fd;
+	unsigned int index;
+	char path[SEGMENT_MAX_PATH];
+	time_t start;
+	uint64_t start_ns;         /* read stamp of first chunk */
+	uint64_t last_ns;          /* read stamp of latest chunk */
+	uint64_t bytes;
+	uint64_t prealloc;         /* allocated size, released on close */
+
+	/* next segment, created and allocated by worker */
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int running;
+	int stop;
+	int next_state;
+	int next_fd;
+	uint64_t next_size;
+	char next_path[SEGMENT_MAX_PATH];
+	int manifest_dirty;
+
+	segment_entry *list;
+	int count;
+	int cap;
+} segmenter;
+
+int segment_open(segmenter *s, const struct recdvb_options *opts);
+size_t segment_room(segmenter *s, const uint8_t *data, size_t len, uint64_t stamp);
+void segment_wrote(segmenter *s, const uint8_t *data, size_t len);
+int segment_rotate(segmenter *s, uint64_t stamp);
+size_t segment_head(segmenter *s, uint8_t *buf, size_t len);
+void segment_close(segmenter *s, int sync);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "shmring.h"
+#include "sock.h"
+
+/* send hello, memfd and eventfd of client */
+static int send_fds(int sock, int memfd, int efd)
+{
+	char hello[] = SHMRING_HELLO;
+	struct iovec iov = {hello, sizeof(hello) - 1};
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int) * 2)];
+	} ctl;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	int fds[2] = {memfd, efd};
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&ctl, 0, sizeof(ctl));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(sock, &msg, MSG_NOSIGNAL) == (ssize_t)iov.iov_len ? 0 : -1;
+}
+
+static void accept_client(shmring *r)
+{
+	int sock, efd;
+
+	sock = accept4(r->lfd, NULL, NULL, SOCK_CLOEXEC);
+	if (sock < 0) {
+		return;
+	}
+	efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd < 0 || r->count >= SHMRING_MAX_CLIENTS || send_fds(sock, r->rofd, efd) != 0) {
+		if (efd >= 0) {
+			close(efd);
+		}
+		close(sock);
+		return;
+	}
+
+	pthread_mutex_lock(&r->mutex);
+	r->sock[r->count] = sock;
+	r->efd[r->count] = efd;
+	r->count++;
+	r->attached++;
+	pthread_mutex_unlock(&r->mutex);
+}
+
+static void remove_client(shmring *r, int i)
+{
+	pthread_mutex_lock(&r->mutex);
+	close(r->sock[i]);
+	close(r->efd[i]);
+	r->count--;
+	r->sock[i] = r->sock[r->count];
+	r->efd[i] = r->efd[r->count];
+	pthread_mutex_unlock(&r->mutex);
+}
+
+/* accepts clients and notices when they leave */
+static void *server_func(void *p)
+{
+	shmring *r = p;
+	struct pollfd pfd[SHMRING_MAX_CLIENTS + 2];
+	int i, n;
+
+	while (1) {
+		pfd[0].fd = r->stop_fd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = r->lfd;
+		pfd[1].events = POLLIN;
+		/* only this thread changes clients, no lock to read */
+		n = r->count;
+		for (i = 0; i < n; i++) {
+			pfd[i + 2].fd = r->sock[i];
+			pfd[i + 2].events = POLLIN;
+		}
+
+		if (poll(pfd, (nfds_t)n + 2, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (pfd[0].revents) {
+			break;
+		}
+		/* clients send nothing, readable means gone */
+		for (i = n - 1; i >= 0; i--) {
+			if (pfd[i + 2].revents) {
+				remove_client(r, i);
+			}
+		}
+		if (pfd[1].revents & POLLIN) {
+			accept_client(r);
+		}
+	}
+
+	return NULL;
+}
+
+/* create ring and serve it on unix socket path */
+int shmring_open(shmring *r, const char *path, uint64_t size)
+{
+	char fdpath[64];
+
+	memset(r, 0, sizeof(*r));
+	r->path = path;
+	r->lfd = -1;
+	r->stop_fd = -1;
+
+	r->rofd = -1;
+
+	if (timeshift_open_memfd(&r->ring, "recdvb-ring", size) != 0) {
+		return -1;
+	}
+
+	/* readers get a descriptor that cannot map the ring writable */
+	snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", r->ring.fd);
+	r->rofd = open(fdpath, O_RDONLY | O_CLOEXEC);
+	if (r->rofd < 0) {
+		fprintf(stderr, "Error: Cannot reopen ring read only. (errno=%d)\n", errno);
+		timeshift_close(&r->ring);
+		return -1;
+	}
+	pthread_mutex_init(&r->mutex, NULL);
+
+	r->lfd = sock_listen_unix(path);
+	r->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (r->lfd < 0 || r->stop_fd < 0 || pthread_create(&r->thread, NULL, server_func, r) != 0) {
+		shmring_close(r);
+		return -1;
+	}
+	r->running = 1;
+
+	return 0;
+}
+
+static void wake_all(shmring *r)
+{
+	uint64_t one = 1;
+	int i;
+
+	pthread_mutex_lock(&r->mutex);
+	for (i = 0; i < r->count; i++) {
+		/* EAGAIN only when counter is full, it is still a wakeup */
+		ssize_t rc = write(r->efd[i], &one, sizeof(one));
+		(void)rc;
+	}
+	pthread_mutex_unlock(&r->mutex);
+}
+
+/* copy into ring, publish and wake readers */
+void shmring_writev(shmring *r, const struct iovec *iov, int cnt)
+{
+	int i;
+
+	for (i = 0; i < cnt; i++) {
+		timeshift_write(&r->ring, iov[i].iov_base, iov[i].iov_len);
+	}
+	wake_all(r);
+}
+
+void shmring_close(shmring *r)
+{
+	uint64_t one = 1;
+
+	if (r->running) {
+		if (write(r->stop_fd, &one, sizeof(one)) < 0) {
+			fprintf(stderr, "Error: Cannot stop ring server. (errno=%d)\n", errno);
+		}
+		pthread_join(r->thread, NULL);
+		r->running = 0;
+	}
+
+	/* readers see end of stream, then hang up */
+	if (r->ring.map) {
+		timeshift_close(&r->ring);
+		wake_all(r);
+	}
+	while (r->count > 0) {
+		remove_client(r, r->count - 1);
+	}
+	if (r->stop_fd >= 0) {
+		close(r->stop_fd);
+		r->stop_fd = -1;
+	}
+	if (r->rofd >= 0) {
+		close(r->rofd);
+		r->rofd = -1;
+	}
+	sock_close_unix(r->lfd, r->path);
+	r->lfd = -1;
+	pthread_mutex_destroy(&r->mutex);
+	fprintf(stderr, "Info: Ring %s served %lu readers\n", r->path, r->attached);
+}
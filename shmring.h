@@ -0,0 +1,57 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_SHMRING_H
+#define RECDVB_SHMRING_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "timeshift.h"
+
+#define SHMRING_MAX_CLIENTS 16
+#define SHMRING_SIZE_DEFAULT (64 * 1024 * 1024)
+#define SHMRING_HELLO       "RECDVB-RING 2\n"
+
+/*
+ * stream published in a memfd ring, layout and read protocol are the
+ * ones of timeshift.h. a local process connects to the unix socket and
+ * receives SHMRING_HELLO with two descriptors: the memfd opened read
+ * only, and an eventfd of its own, signaled after new data. the memfd
+ * is also sealed against writes other than the writer's own mapping.
+ * the connection is kept open while attached.
+ */
+typedef struct shmring {
+	timeshift ring;
+	int rofd;                  /* read-only reopen of ring, passed to readers */
+	const char *path;
+	int lfd;
+	int stop_fd;               /* eventfd to end server thread */
+	pthread_t thread;
+	int running;
+	pthread_mutex_t mutex;     /* protects clients */
+	int sock[SHMRING_MAX_CLIENTS];
+	int efd[SHMRING_MAX_CLIENTS];
+	int count;
+	uint64_t attached;
+} shmring;
+
+int shmring_open(shmring *r, const char *path, uint64_t size);
+void shmring_writev(shmring *r, const struct iovec *iov, int cnt);
+void shmring_close(shmring *r);
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sock.h"
+
+#define LISTEN_BACKLOG 16
+
+/* create non-blocking unix domain socket listening on path */
+int sock_listen_unix(const char *path)
+{
+	int fd;
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: socket path is too long. (%s)\n", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create socket. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	/* remove stale socket left by previous process */
+	unlink(path);
+
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		fprintf(stderr, "Error: cannot bind socket %s. (errno=%d)\n", path, errno);
+		close(fd);
+		return -1;
+	}
+
+	if (listen(fd, LISTEN_BACKLOG) == -1) {
+		fprintf(stderr, "Error: cannot listen socket %s. (errno=%d)\n", path, errno);
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	return fd;
+}
+
+void sock_close_unix(int fd, const char *path)
+{
+	if (fd != -1) {
+		close(fd);
+		unlink(path);
+	}
+}
@@ -0,0 +1,342 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "streamer.h"
+#include "bufpool.h"
+#include "sock.h"
+#include "trace.h"
+
+#define NEVENTS 32
+
+/* "HOST:PORT" or ":PORT" is HTTP, anything else is unix socket path */
+int streamer_addr_is_http(const char *addr)
+{
+	const char *colon = strrchr(addr, ':');
+	const char *p;
+
+	if (!colon || colon[1] == '\0' || strchr(addr, '/')) {
+		return 0;
+	}
+	for (p = colon + 1; *p; p++) {
+		if (!isdigit((unsigned char)*p)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int listen_http(const char *addr)
+{
+	struct sockaddr_in sin;
+	const char *colon = strrchr(addr, ':');
+	char host[64];
+	int fd, on = 1;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons((uint16_t)atoi(colon + 1));
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (colon > addr) {
+		snprintf(host, sizeof(host), "%.*s", (int)(colon - addr), addr);
+		if (strcmp(host, "localhost") && inet_pton(AF_INET, host, &sin.sin_addr) != 1) {
+			fprintf(stderr, "Error: Invalid address %s.\n", addr);
+			return -1;
+		}
+	}
+	/* stream is served to anyone who connects */
+	if ((ntohl(sin.sin_addr.s_addr) >> 24) != 127) {
+		fprintf(stderr, "Error: Serving on %s is not allowed, use a loopback address.\n", addr);
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		fprintf(stderr, "Error: cannot create socket. (errno=%d)\n", errno);
+		return -1;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 || listen(fd, 16) == -1) {
+		fprintf(stderr, "Error: cannot listen on %s. (errno=%d)\n", addr, errno);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static int watch(int epfd, int fd, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.data.fd = fd;
+	ev.events = events;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int streamer_open(streamer *s, const char *addr, QUEUE_T *queue)
+{
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	s->addr = addr;
+	s->queue = queue;
+	s->http = streamer_addr_is_http(addr);
+	s->wake_fd = -1;
+	s->epfd = -1;
+	for (i = 0; i < STREAMER_MAX_PENDING; i++) {
+		s->pending[i].fd = -1;
+	}
+	psi_init(&s->psi);
+
+	s->lfd = s->http ? listen_http(addr) : sock_listen_unix(addr);
+	if (s->lfd == -1) {
+		return -1;
+	}
+	s->epfd = epoll_create1(EPOLL_CLOEXEC);
+	s->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	fanout_init(&s->out, s->epfd);
+	if (s->epfd == -1 || s->wake_fd == -1 ||
+	    watch(s->epfd, s->lfd, EPOLLIN) == -1 || watch(s->epfd, s->wake_fd, EPOLLIN) == -1) {
+		fprintf(stderr, "Error: Cannot start server on %s. (errno=%d)\n", addr, errno);
+		streamer_close(s);
+		return -1;
+	}
+
+	/* slow client is dropped, others keep whole stream */
+	s->out.buffer_size = STREAMER_CLIENT_BUFFER;
+	s->out.evict = 1;
+
+	return 0;
+}
+
+/* start streaming to client, PAT/PMT first */
+static void start_client(streamer *s, int fd)
+{
+	static uint8_t pkts[PSI_PACKETS_SIZE];
+
+	if (fanout_add(&s->out, fd) != 0) {
+		close(fd);
+		return;
+	}
+	if (psi_ready(&s->psi)) {
+		fanout_prime(&s->out, fd, pkts, psi_packets(&s->psi, pkts, sizeof(pkts)));
+	}
+	s->served++;
+}
+
+static void accept_clients(streamer *s)
+{
+	int fd, i;
+
+	while ((fd = accept4(s->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		if (!s->http) {
+			start_client(s, fd);
+			continue;
+		}
+		/* wait for request */
+		for (i = 0; i < STREAMER_MAX_PENDING && s->pending[i].fd != -1; i++) {
+			;
+		}
+		if (i == STREAMER_MAX_PENDING || watch(s->epfd, fd, EPOLLIN | EPOLLRDHUP) == -1) {
+			close(fd);
+			continue;
+		}
+		s->pending[i].fd = fd;
+		s->pending[i].deadline = trace_now() + (uint64_t)STREAMER_REQUEST_MSEC * 1000000;
+		s->pending[i].len = 0;
+	}
+}
+
+/* close HTTP clients that did not send request in time, returns number still pending */
+static int expire_pending(streamer *s)
+{
+	uint64_t now = trace_now();
+	int i, n = 0;
+
+	for (i = 0; i < STREAMER_MAX_PENDING; i++) {
+		streamer_pending *p = &s->pending[i];
+
+		if (p->fd == -1) {
+			continue;
+		}
+		if (now < p->deadline) {
+			n++;
+			continue;
+		}
+		epoll_ctl(s->epfd, EPOLL_CTL_DEL, p->fd, NULL);
+		close(p->fd);
+		p->fd = -1;
+	}
+
+	return n;
+}
+
+static streamer_pending *find_pending(streamer *s, int fd)
+{
+	int i;
+
+	for (i = 0; i < STREAMER_MAX_PENDING; i++) {
+		if (s->pending[i].fd == fd) {
+			return &s->pending[i];
+		}
+	}
+	return NULL;
+}
+
+/* read request header, answer when complete */
+static void handle_request(streamer *s, streamer_pending *p)
+{
+	static const char bad[] = "HTTP/1.0 405 Method Not Allowed\r\nConnection: close\r\n\r\n";
+	ssize_t n = recv(p->fd, p->req + p->len, sizeof(p->req) - 1 - p->len, 0);
+	int fd = p->fd;
+	ssize_t wc;
+
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return;
+	}
+	if (n > 0) {
+		p->len += (size_t)n;
+		p->req[p->len] = '\0';
+		if (!strstr(p->req, "\r\n\r\n") && !strstr(p->req, "\n\n") && p->len < sizeof(p->req) - 1) {
+			return;
+		}
+	}
+
+	epoll_ctl(s->epfd, EPOLL_CTL_DEL, fd, NULL);
+	p->fd = -1;
+	if (n <= 0 || p->len == sizeof(p->req) - 1) {
+		close(fd);
+		return;
+	}
+	if (strncmp(p->req, "GET ", 4)) {
+		wc = send(fd, bad, sizeof(bad) - 1, MSG_NOSIGNAL);
+		(void)wc;
+		close(fd);
+		return;
+	}
+	/* header is small, socket buffer is empty */
+	if (send(fd, STREAMER_HTTP_RESPONSE, sizeof(STREAMER_HTTP_RESPONSE) - 1, MSG_NOSIGNAL) !=
+	    (ssize_t)sizeof(STREAMER_HTTP_RESPONSE) - 1) {
+		close(fd);
+		return;
+	}
+	start_client(s, fd);
+}
+
+/* send queued chunks, returns 1 when queue is closed */
+static int drain_queue(streamer *s)
+{
+	uint64_t count;
+	BUFSZ *buf;
+	int rc;
+
+	/* count does not matter, queue tells what is there */
+	if (read(s->wake_fd, &count, sizeof(count)) < 0) {
+		count = 0;
+	}
+	while ((rc = dequeue_nowait(s->queue, &buf)) == 0) {
+		if (buf->flags & BUFSZ_BOUNDARY) {
+			psi_init(&s->psi);
+		} else {
+			psi_feed(&s->psi, buf->buffer, (size_t)buf->size);
+			fanout_write(&s->out, buf->buffer, (size_t)buf->size);
+		}
+		bufpool_put(buf);
+	}
+
+	return rc == QUEUE_CLOSED;
+}
+
+void *streamer_func(void *p)
+{
+	streamer *s = p;
+	struct epoll_event evs[NEVENTS];
+	int done = 0, pending = 0, n, i;
+
+	while (!done) {
+		/* wake up to expire pending requests */
+		n = epoll_wait(s->epfd, evs, NEVENTS, pending ? 1000 : -1);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: epoll_wait failed. (errno=%d)\n", errno);
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			int fd = evs[i].data.fd;
+			streamer_pending *pend;
+
+			if (fd == s->wake_fd) {
+				done = drain_queue(s);
+			} else if (fd == s->lfd) {
+				accept_clients(s);
+			} else if ((pend = find_pending(s, fd)) != NULL) {
+				handle_request(s, pend);
+			} else {
+				fanout_handle(&s->out, fd, evs[i].events);
+			}
+		}
+		if (s->http) {
+			pending = expire_pending(s);
+		}
+	}
+
+	return NULL;
+}
+
+void streamer_close(streamer *s)
+{
+	int i;
+
+	for (i = 0; i < STREAMER_MAX_PENDING; i++) {
+		if (s->pending[i].fd != -1) {
+			close(s->pending[i].fd);
+			s->pending[i].fd = -1;
+		}
+	}
+	if (s->epfd != -1) {
+		fanout_close(&s->out);
+		close(s->epfd);
+		s->epfd = -1;
+	}
+	if (s->wake_fd != -1) {
+		close(s->wake_fd);
+		s->wake_fd = -1;
+	}
+	if (s->http) {
+		if (s->lfd != -1) {
+			close(s->lfd);
+		}
+	} else {
+		sock_close_unix(s->lfd, s->addr);
+	}
+	s->lfd = -1;
+	fprintf(stderr, "Info: Server %s served %lu clients, evicted %lu\n", s->addr, s->served, s->out.evicted);
+}
@@ -0,0 +1,67 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_STREAMER_H
+#define RECDVB_STREAMER_H
+
+#include <stdint.h>
+
+#include "queue.h"
+#include "fanout.h"
+#include "psi.h"
+
+#define STREAMER_CLIENT_BUFFER  (16 * 1024 * 1024) /* about 2sec of BS, then evicted */
+#define STREAMER_MAX_PENDING    8                  /* HTTP clients sending request */
+#define STREAMER_REQUEST_MAX    2048
+#define STREAMER_REQUEST_MSEC   5000               /* to send request header */
+#define STREAMER_HTTP_RESPONSE  "HTTP/1.0 200 OK\r\n" \
+				"Content-Type: video/mp2t\r\n" \
+				"Cache-Control: no-cache\r\n" \
+				"Connection: close\r\n\r\n"
+
+/* HTTP client not streaming yet */
+typedef struct streamer_pending {
+	int fd;
+	uint64_t deadline;         /* trace_now() ns, closed if no request by then */
+	size_t len;
+	char req[STREAMER_REQUEST_MAX];
+} streamer_pending;
+
+/*
+ * live stream served to local clients, on a unix socket (raw TS from
+ * connect) or on HTTP (ADDR:PORT or :PORT), loopback addresses only,
+ * as there is no authentication. runs in its own
+ * thread, chunks arrive through queue and wake_fd.
+ */
+typedef struct streamer {
+	const char *addr;
+	int http;
+	int lfd;
+	int epfd;
+	int wake_fd;               /* eventfd, signaled after enqueue */
+	QUEUE_T *queue;
+	fanout out;
+	psi_cache psi;             /* sent first to joining clients */
+	streamer_pending pending[STREAMER_MAX_PENDING];
+	uint64_t served;
+} streamer;
+
+int streamer_addr_is_http(const char *addr);
+int streamer_open(streamer *s, const char *addr, QUEUE_T *queue);
+void *streamer_func(void *p);
+void streamer_close(streamer *s);
+
+#endif
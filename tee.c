@@ -0,0 +1,325 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <libgen.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "tee.h"
+#include "bufpool.h"
+#include "mkpath.h"
+
+/* "FILTER:DEST", returns length of FILTER or -1 */
+static int split_spec(const char *spec)
+{
+	const char *colon = strchr(spec, ':');
+
+	if (!colon || colon == spec || colon[1] == '\0') {
+		return -1;
+	}
+	return (int)(colon - spec);
+}
+
+/* check spec without opening, for option validation */
+int tee_parse(const char *spec)
+{
+	tsfilter f;
+	int len = split_spec(spec);
+
+	if (len < 0 || tsfilter_parse(&f, spec, (size_t)len) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, int cnt)
+{
+	while (cnt > 0) {
+		ssize_t wc = writev(fd, iov, cnt > IOV_MAX ? IOV_MAX : cnt);
+
+		if (wc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		/* skip what was written */
+		while (cnt > 0 && (size_t)wc >= iov->iov_len) {
+			wc -= (ssize_t)iov->iov_len;
+			iov++;
+			cnt--;
+		}
+		if (cnt > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + wc;
+			iov->iov_len -= (size_t)wc;
+		}
+	}
+	return 0;
+}
+
+static void *tee_func(void *p)
+{
+	tee_output *o = p;
+	struct iovec iov[TSFILTER_MAX_IOV];
+	BUFSZ *buf;
+	size_t len;
+	int rc, cnt, i;
+
+	while ((rc = dequeue(o->queue, &buf)) != QUEUE_CLOSED) {
+		if (rc != 0) {
+			continue;
+		}
+		if (buf->flags & BUFSZ_BOUNDARY) {
+			tsfilter_reset(&o->filter);
+			bufpool_put(buf);
+			continue;
+		}
+		if (o->error) {
+			__atomic_add_fetch(&o->d_byte, (uint64_t)buf->size, __ATOMIC_RELAXED);
+			bufpool_put(buf);
+			continue;
+		}
+
+		len = 0;
+		cnt = tsfilter_iov(&o->filter, buf->buffer, (size_t)buf->size, iov);
+		for (i = 0; i < cnt; i++) {
+			len += iov[i].iov_len;
+		}
+		if (o->ring) {
+			shmring_writev(o->ring, iov, cnt);
+		} else if (writev_all(o->fd, iov, cnt) != 0) {
+			fprintf(stderr, "Error: Cannot write output %s. (errno=%d)\n", o->path, errno);
+			o->error = 1;
+			len = 0;
+		}
+		__atomic_add_fetch(&o->w_byte, (uint64_t)len, __ATOMIC_RELAXED);
+		bufpool_put(buf);
+	}
+
+	return NULL;
+}
+
+static int open_dest(const char *path)
+{
+	char *dup, *dir;
+	int status;
+
+	if (!strcmp(path, "-")) {
+		return 1; /* stdout */
+	}
+	dup = strdup(path);
+	if (!dup) {
+		return -1;
+	}
+	dir = dirname(dup);
+	status = mkpath(dir, 0777);
+	free(dup);
+	if (status == -1) {
+		return -1;
+	}
+	return open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+}
+
+static int start_output(tee_output *o)
+{
+	o->queue = create_queue(TEE_QUEUE_SIZE);
+	if (!o->queue || pthread_create(&o->thread, NULL, tee_func, o) != 0) {
+		fprintf(stderr, "Error: Cannot start writer of output %s.\n", o->path);
+		return -1;
+	}
+	o->running = 1;
+
+	return 0;
+}
+
+/* open outputs and start their writers */
+int tee_open(tee_group *t, char **specs, int num)
+{
+	int i;
+
+	memset(t, 0, sizeof(*t));
+	for (i = 0; i < num && i < TEE_MAX_OUTPUTS; i++) {
+		tee_output *o = &t->out[i];
+		int len = split_spec(specs[i]);
+
+		if (len < 0 || tsfilter_parse(&o->filter, specs[i], (size_t)len) != 0) {
+			fprintf(stderr, "Error: Invalid output %s.\n", specs[i]);
+			tee_close(t);
+			return -1;
+		}
+		o->path = specs[i] + len + 1;
+		o->fd = open_dest(o->path);
+		if (o->fd < 0) {
+			fprintf(stderr, "Error: Cannot open output %s. (errno=%d)\n", o->path, errno);
+			tee_close(t);
+			return -1;
+		}
+		t->count++;
+
+		if (start_output(o) != 0) {
+			tee_close(t);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* publish whole stream in shared memory ring served on path */
+int tee_add_ring(tee_group *t, const char *path, uint64_t size)
+{
+	tee_output *o = &t->out[t->count];
+
+	memset(o, 0, sizeof(*o));
+	tsfilter_parse(&o->filter, "ts", 2);
+	o->path = path;
+	o->fd = -1;
+	o->ring = calloc(1, sizeof(shmring));
+	if (!o->ring || shmring_open(o->ring, path, size) != 0) {
+		free(o->ring);
+		o->ring = NULL;
+		return -1;
+	}
+	t->count++;
+
+	return start_output(o);
+}
+
+/* serve whole stream to local clients, server thread is the writer */
+int tee_add_server(tee_group *t, const char *addr)
+{
+	tee_output *o = &t->out[t->count];
+
+	memset(o, 0, sizeof(*o));
+	o->path = addr;
+	o->fd = -1;
+	o->queue = create_queue(TEE_QUEUE_SIZE);
+	o->srv = calloc(1, sizeof(streamer));
+	if (!o->queue || !o->srv || streamer_open(o->srv, addr, o->queue) != 0) {
+		destroy_queue(o->queue);
+		free(o->srv);
+		o->queue = NULL;
+		o->srv = NULL;
+		return -1;
+	}
+	t->count++;
+
+	if (pthread_create(&o->thread, NULL, streamer_func, o->srv) != 0) {
+		fprintf(stderr, "Error: Cannot start server %s.\n", addr);
+		return -1;
+	}
+	o->running = 1;
+
+	return 0;
+}
+
+static void wake_server(tee_output *o)
+{
+	uint64_t one = 1;
+	ssize_t rc = write(o->srv->wake_fd, &one, sizeof(one));
+
+	(void)rc; /* full counter is still a wakeup */
+}
+
+/* hand chunk to every output, caller keeps its reference */
+void tee_chunk(tee_group *t, BUFSZ *buf)
+{
+	int i;
+
+	for (i = 0; i < t->count; i++) {
+		tee_output *o = &t->out[i];
+
+		bufpool_ref(buf);
+		if (enqueue(o->queue, buf) != 0) {
+			/* behind, others go on */
+			__atomic_add_fetch(&o->d_byte, (uint64_t)buf->size, __ATOMIC_RELAXED);
+			bufpool_put(buf);
+		} else if (o->srv) {
+			__atomic_add_fetch(&o->w_byte, (uint64_t)buf->size, __ATOMIC_RELAXED);
+			wake_server(o);
+		}
+	}
+}
+
+/* program layout may change after this */
+void tee_boundary(tee_group *t)
+{
+	int i;
+
+	for (i = 0; i < t->count; i++) {
+		BUFSZ *buf = bufpool_get();
+
+		if (!buf) {
+			continue;
+		}
+		buf->flags = BUFSZ_BOUNDARY;
+		if (enqueue(t->out[i].queue, buf) != 0) {
+			bufpool_put(buf);
+		} else if (t->out[i].srv) {
+			wake_server(&t->out[i]);
+		}
+	}
+}
+
+/* drain and close outputs */
+void tee_close(tee_group *t)
+{
+	int i;
+
+	for (i = 0; i < t->count; i++) {
+		tee_output *o = &t->out[i];
+
+		if (o->running) {
+			queue_close(o->queue);
+			if (o->srv) {
+				wake_server(o);
+			}
+			pthread_join(o->thread, NULL);
+			o->running = 0;
+		}
+		if (o->srv) {
+			streamer_close(o->srv);
+			free(o->srv);
+			o->srv = NULL;
+		}
+		if (o->queue) {
+			destroy_queue(o->queue);
+			o->queue = NULL;
+		}
+		if (o->ring) {
+			shmring_close(o->ring);
+			free(o->ring);
+			o->ring = NULL;
+		}
+		if (o->fd > 1) {
+			close(o->fd);
+		}
+		o->fd = -1;
+		fprintf(stderr, "Info: Output %s wrote %lubyte", o->path, o->w_byte);
+		if (o->d_byte > 0) {
+			fprintf(stderr, ", dropped %lubyte", o->d_byte);
+		}
+		fprintf(stderr, "\n");
+	}
+	t->count = 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TEE_H
+#define RECDVB_TEE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "recdvb.h"
+#include "queue.h"
+#include "tsfilter.h"
+#include "shmring.h"
+#include "streamer.h"
+
+#define TEE_MAX_OUTPUTS (RECDVB_MAX_OUTPUTS + 2) /* and ring, server */
+#define TEE_QUEUE_SIZE  1024       /* about 16MB of chunks per output */
+
+/* extra output with own filter and writer thread */
+typedef struct tee_output {
+	const char *path;          /* "-" for standard output */
+	tsfilter filter;
+	int fd;
+	shmring *ring;             /* NULL unless output is shared memory ring */
+	streamer *srv;             /* NULL unless output is streaming server */
+	QUEUE_T *queue;
+	pthread_t thread;
+	int running;
+	int error;
+	/* following counters are updated atomically */
+	uint64_t w_byte;
+	uint64_t d_byte;           /* dropped while output was behind */
+} tee_output;
+
+/* chunks of main output, after decoding, shared by outputs, see bufpool_ref() */
+typedef struct tee_group {
+	tee_output out[TEE_MAX_OUTPUTS];
+	int count;
+} tee_group;
+
+int tee_parse(const char *spec);
+int tee_open(tee_group *t, char **specs, int num);
+int tee_add_ring(tee_group *t, const char *path, uint64_t size);
+int tee_add_server(tee_group *t, const char *addr);
+void tee_chunk(tee_group *t, BUFSZ *buf);
+void tee_boundary(tee_group *t);
+void tee_close(tee_group *t);
+
+#endif
@@ -18,6 +18,8 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "time.h"
 
@@ -85,3 +87,80 @@ int parse_time(char *rectimestr, int *recsec)
 	return 0;
 }
 
+
+static int parse_frac(const char *p, uint64_t *ns)
+{
+	uint64_t scale = 100000000;
+
+	*ns = 0;
+	if (*p == '\0') {
+		return 0;
+	}
+	if (*p++ != '.') {
+		return 1;
+	}
+	for (; isdigit((unsigned char)*p); p++) {
+		*ns += (uint64_t)(*p - '0') * scale;
+		scale /= 10;
+	}
+
+	return *p != '\0';
+}
+
+/*
+ * wall clock instant as nanoseconds since epoch. accepts
+ * "@EPOCH", "+SEC", "YYYY-MM-DD[T]HH:MM:SS" and "HH:MM[:SS]" (next
+ * occurrence), seconds may have fraction.
+ */
+int parse_clock(const char *str, uint64_t *ns)
+{
+	struct timespec now;
+	struct tm tm;
+	const char *p;
+	char *endptr;
+	uint64_t frac;
+	long long sec;
+	time_t t;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	if (*str == '@' || *str == '+') {
+		sec = strtoll(str + 1, &endptr, 10);
+		if (endptr == str + 1 || sec < 0 || parse_frac(endptr, &frac)) {
+			return 1;
+		}
+		*ns = (uint64_t)sec * 1000000000 + frac;
+		if (*str == '+') {
+			*ns += (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+		}
+		return 0;
+	}
+
+	t = now.tv_sec;
+	localtime_r(&t, &tm);
+	tm.tm_sec = 0;
+	if ((p = strptime(str, "%Y-%m-%dT%H:%M:%S", &tm)) == NULL &&
+	    (p = strptime(str, "%Y-%m-%d %H:%M:%S", &tm)) == NULL &&
+	    (p = strptime(str, "%H:%M:%S", &tm)) == NULL &&
+	    (p = strptime(str, "%H:%M", &tm)) == NULL) {
+		return 1;
+	}
+	if (parse_frac(p, &frac)) {
+		return 1;
+	}
+	tm.tm_isdst = -1;
+	t = mktime(&tm);
+	if (t == (time_t)-1) {
+		return 1;
+	}
+
+	/* time of day already passed, take tomorrow */
+	if (!strchr(str, '-') && t < now.tv_sec) {
+		tm.tm_mday++;
+		tm.tm_isdst = -1;
+		t = mktime(&tm);
+	}
+	*ns = (uint64_t)t * 1000000000 + frac;
+
+	return 0;
+}
@@ -17,6 +17,9 @@
 #ifndef RECDVB_TIME_H
 #define RECDVB_TIME_H
 
+#include <stdint.h>
+
 int parse_time(char *rectimestr, int *recsec);
+int parse_clock(const char *str, uint64_t *ns);
 
 #endif
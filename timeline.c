@@ -0,0 +1,193 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+
+#include "timeline.h"
+#include "trace.h"
+
+#define TL_BIT(e) (1ULL << (e))
+#define TL_PSI_DONE (TL_BIT(TL_FIRST_PAT) | TL_BIT(TL_FIRST_PMT) | TL_BIT(TL_FIRST_PCR))
+
+static const char *event_names[TL_EVENTS] = {
+	"fe_open",
+	"delsys",
+	"tune",
+	"fe_event",
+	"lock",
+	"demux_start",
+	"first_byte",
+	"first_pat",
+	"first_pmt",
+	"first_pcr",
+};
+
+void timeline_init(timeline *tl)
+{
+	tl->origin = trace_now();
+	tl->count = 0;
+	tl->seen = 0;
+	tl->num_pmt = 0;
+	ts_reader_init(&tl->reader);
+	ts_section_init(&tl->pat, TS_PID_PAT);
+}
+
+static void add_entry(timeline *tl, int event, unsigned int status)
+{
+	if (tl->count >= TIMELINE_MAX_ENTRIES) {
+		return;
+	}
+	tl->entry[tl->count].event = event;
+	tl->entry[tl->count].status = status;
+	tl->entry[tl->count].ns = trace_now() - tl->origin;
+	tl->count++;
+	tl->seen |= TL_BIT(event);
+}
+
+/* milestones are recorded once, except frontend events */
+void timeline_mark(timeline *tl, int event)
+{
+	if (tl->seen & TL_BIT(event)) {
+		return;
+	}
+	add_entry(tl, event, 0);
+}
+
+void timeline_mark_status(timeline *tl, unsigned int status)
+{
+	if (tl->seen & TL_BIT(TL_LOCK)) {
+		return;
+	}
+	add_entry(tl, TL_FE_EVENT, status);
+}
+
+int timeline_complete(const timeline *tl)
+{
+	return (tl->seen & TL_PSI_DONE) == TL_PSI_DONE;
+}
+
+/* nanoseconds from origin to first occurrence of event, 0 if not seen */
+uint64_t timeline_get(const timeline *tl, int event)
+{
+	int i;
+
+	for (i = 0; i < tl->count; i++) {
+		if (tl->entry[i].event == event) {
+			return tl->entry[i].ns;
+		}
+	}
+	return 0;
+}
+
+static void on_pmt(void *arg, const uint8_t *sec, size_t len)
+{
+	timeline *tl = arg;
+
+	if (sec[0] == 0x02 && ts_crc32(sec, len) == 0) {
+		timeline_mark(tl, TL_FIRST_PMT);
+	}
+}
+
+static void on_pat(void *arg, const uint8_t *sec, size_t len)
+{
+	timeline *tl = arg;
+	size_t i;
+
+	if (sec[0] != 0x00 || len < 12 || ts_crc32(sec, len) != 0) {
+		return;
+	}
+	timeline_mark(tl, TL_FIRST_PAT);
+
+	/* watch every PMT listed */
+	for (i = 8; i + 4 <= len - 4 && tl->num_pmt < TIMELINE_MAX_PMT; i += 4) {
+		uint16_t program = (uint16_t)((sec[i] << 8) | sec[i + 1]);
+		uint16_t pid = (uint16_t)(((sec[i + 2] & 0x1f) << 8) | sec[i + 3]);
+
+		if (program != 0) {
+			ts_section_init(&tl->pmt[tl->num_pmt++], pid);
+		}
+	}
+}
+
+static void on_packet(void *arg, const uint8_t *pkt)
+{
+	timeline *tl = arg;
+	uint64_t pcr;
+	int i;
+
+	if (ts_get_pcr(pkt, &pcr)) {
+		timeline_mark(tl, TL_FIRST_PCR);
+	}
+
+	if (!(tl->seen & TL_BIT(TL_FIRST_PAT))) {
+		ts_section_feed(&tl->pat, pkt, on_pat, tl);
+		return;
+	}
+
+	if (!(tl->seen & TL_BIT(TL_FIRST_PMT))) {
+		for (i = 0; i < tl->num_pmt; i++) {
+			ts_section_feed(&tl->pmt[i], pkt, on_pmt, tl);
+		}
+	}
+}
+
+/* scan dvr data until PAT, PMT and PCR are found */
+void timeline_feed(timeline *tl, const uint8_t *data, size_t len)
+{
+	if (timeline_complete(tl)) {
+		return;
+	}
+	ts_reader_feed(&tl->reader, data, len, on_packet, tl);
+}
+
+void timeline_show(const timeline *tl, int dev_num, const char *channel)
+{
+	int i;
+
+	fprintf(stderr, "Info: Startup timeline dev=%d channel=%s (msec)\n", dev_num, channel);
+	for (i = 0; i < tl->count; i++) {
+		if (tl->entry[i].event == TL_FE_EVENT) {
+			fprintf(stderr, "      %-12s %9.3lf status=0x%02x\n", event_names[TL_FE_EVENT],
+				tl->entry[i].ns / 1000000.0, tl->entry[i].status);
+		} else {
+			fprintf(stderr, "      %-12s %9.3lf\n", event_names[tl->entry[i].event],
+				tl->entry[i].ns / 1000000.0);
+		}
+	}
+}
+
+/* json array of [name, msec(, status)] */
+int timeline_format(const timeline *tl, char *buf, size_t len)
+{
+	int i;
+	int n = 0;
+
+	n += snprintf(buf + n, len - n, "[");
+	for (i = 0; i < tl->count && n < (int)len; i++) {
+		if (tl->entry[i].event == TL_FE_EVENT) {
+			n += snprintf(buf + n, len - n, "%s[\"%s\",%.3lf,%u]", i ? "," : "",
+				event_names[TL_FE_EVENT], tl->entry[i].ns / 1000000.0, tl->entry[i].status);
+		} else {
+			n += snprintf(buf + n, len - n, "%s[\"%s\",%.3lf]", i ? "," : "",
+				event_names[tl->entry[i].event], tl->entry[i].ns / 1000000.0);
+		}
+	}
+	if (n < (int)len) {
+		n += snprintf(buf + n, len - n, "]");
+	}
+
+	return n < (int)len ? n : -1;
+}
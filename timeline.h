@@ -0,0 +1,69 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TIMELINE_H
+#define RECDVB_TIMELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ts.h"
+
+#define TIMELINE_MAX_ENTRIES 64
+#define TIMELINE_MAX_PMT     16
+
+/* startup milestones, in order of occurrence */
+enum timeline_event {
+	TL_FE_OPEN,      /* frontend device opened */
+	TL_DELSYS,       /* FE_GET_PROPERTY delivery system probe done */
+	TL_TUNE,         /* FE_SET_PROPERTY returned */
+	TL_FE_EVENT,     /* frontend status change */
+	TL_LOCK,         /* FE_HAS_LOCK observed */
+	TL_DEMUX_START,  /* demux filter started */
+	TL_FIRST_BYTE,   /* first dvr read */
+	TL_FIRST_PAT,    /* first valid PAT */
+	TL_FIRST_PMT,    /* first valid PMT */
+	TL_FIRST_PCR,    /* first PCR */
+	TL_EVENTS,
+};
+
+typedef struct timeline {
+	uint64_t origin;
+	int count;
+	struct {
+		int event;
+		unsigned int status;
+		uint64_t ns;
+	} entry[TIMELINE_MAX_ENTRIES];
+	uint64_t seen;             /* bit mask of marked events */
+
+	/* for PAT/PMT/PCR detection */
+	ts_reader reader;
+	ts_section pat;
+	ts_section pmt[TIMELINE_MAX_PMT];
+	int num_pmt;
+} timeline;
+
+void timeline_init(timeline *tl);
+void timeline_mark(timeline *tl, int event);
+void timeline_mark_status(timeline *tl, unsigned int status);
+int timeline_complete(const timeline *tl);
+uint64_t timeline_get(const timeline *tl, int event);
+void timeline_feed(timeline *tl, const uint8_t *data, size_t len);
+void timeline_show(const timeline *tl, int dev_num, const char *channel);
+int timeline_format(const timeline *tl, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "timeshift.h"
+
+/* linux 5.1, not in older headers */
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010
+#endif
+
+static uint64_t realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* map allocated ring of fd and write header */
+static int map_ring(timeshift *ts, uint64_t data_size)
+{
+	ts->map = mmap(NULL, ts->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ts->fd, 0);
+	if (ts->map == MAP_FAILED) {
+		fprintf(stderr, "Error: Cannot map timeshift file. (errno=%d)\n", errno);
+		close(ts->fd);
+		return -1;
+	}
+	madvise(ts->map + TIMESHIFT_HEADER_SIZE, data_size, MADV_SEQUENTIAL);
+
+	ts->hdr = (timeshift_header *)ts->map;
+	ts->data = ts->map + TIMESHIFT_HEADER_SIZE;
+	ts->hdr->version = TIMESHIFT_VERSION;
+	ts->hdr->header_size = TIMESHIFT_HEADER_SIZE;
+	ts->hdr->data_size = data_size;
+	ts->hdr->start_time = realtime_ns();
+	ts->hdr->index_interval = TIMESHIFT_INDEX_INTERVAL;
+	ts->hdr->index_size = (uint32_t)TIMESHIFT_INDEX_SIZE;
+	ts->hdr->live = 1;
+	/* magic last, header is complete when it is seen */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(ts->hdr->magic, TIMESHIFT_MAGIC, sizeof(ts->hdr->magic));
+
+	return 0;
+}
+
+/* create ring file of size bytes and map it */
+int timeshift_open(timeshift *ts, const char *path, uint64_t size)
+{
+	uint64_t data_size = size - size % TIMESHIFT_UNIT;
+	int rc;
+
+	memset(ts, 0, sizeof(*ts));
+	ts->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (ts->fd < 0) {
+		fprintf(stderr, "Error: Cannot open timeshift file %s. (errno=%d)\n", path, errno);
+		return -1;
+	}
+
+	/* reserve blocks, writing to mapping cannot report ENOSPC */
+	ts->map_size = TIMESHIFT_HEADER_SIZE + data_size;
+	rc = posix_fallocate(ts->fd, 0, (off_t)ts->map_size);
+	if (rc != 0) {
+		fprintf(stderr, "Error: Cannot allocate timeshift file. (errno=%d)\n", rc);
+		close(ts->fd);
+		return -1;
+	}
+
+	return map_ring(ts, data_size);
+}
+
+/* same ring in anonymous memory, size and content sealed for readers */
+int timeshift_open_memfd(timeshift *ts, const char *name, uint64_t size)
+{
+	uint64_t data_size = size - size % TIMESHIFT_UNIT;
+
+	memset(ts, 0, sizeof(*ts));
+	ts->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (ts->fd < 0) {
+		fprintf(stderr, "Error: Cannot create shared memory. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	ts->map_size = TIMESHIFT_HEADER_SIZE + data_size;
+	if (ftruncate(ts->fd, (off_t)ts->map_size) != 0) {
+		fprintf(stderr, "Error: Cannot allocate shared memory. (errno=%d)\n", errno);
+		close(ts->fd);
+		return -1;
+	}
+	if (map_ring(ts, data_size) != 0) {
+		return -1;
+	}
+
+	/* only the mapping made above stays writable */
+	if (fcntl(ts->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0) {
+		fprintf(stderr, "Info: Cannot seal shared memory against writes (errno=%d), readers rely on read-only fd.\n", errno);
+		fcntl(ts->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+	}
+
+	return 0;
+}
+
+/* copy into ring and publish. always returns len. */
+ssize_t timeshift_write(timeshift *ts, const uint8_t *data, size_t len)
+{
+	timeshift_header *h = ts->hdr;
+	uint64_t pos = h->write_pos;
+	uint64_t now = realtime_ns();
+	size_t done = 0;
+
+	/* entry points to start of this write */
+	if (now >= ts->next_index) {
+		uint32_t n = h->index_count;
+
+		h->index[n % h->index_size].time = now;
+		h->index[n % h->index_size].pos = pos;
+		__atomic_store_n(&h->index_count, n + 1, __ATOMIC_RELEASE);
+		ts->next_index = now + (uint64_t)h->index_interval * 1000000;
+	}
+
+	/* readers drop what is about to be overwritten */
+	__atomic_store_n(&h->reserve_pos, pos + len, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	while (done < len) {
+		size_t off = (size_t)((pos + done) % h->data_size);
+		size_t n = (size_t)h->data_size - off;
+
+		if (n > len - done) {
+			n = len - done;
+		}
+		memcpy(ts->data + off, data + done, n);
+		done += n;
+	}
+	__atomic_store_n(&h->write_pos, pos + len, __ATOMIC_RELEASE);
+
+	return (ssize_t)len;
+}
+
+void timeshift_close(timeshift *ts)
+{
+	if (!ts->map) {
+		return;
+	}
+	__atomic_store_n(&ts->hdr->live, 0, __ATOMIC_RELEASE);
+	munmap(ts->map, ts->map_size);
+	close(ts->fd);
+	ts->map = NULL;
+	ts->fd = -1;
+}
@@ -0,0 +1,107 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TIMESHIFT_H
+#define RECDVB_TIMESHIFT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TIMESHIFT_MAGIC          "RDVSHIFT"
+#define TIMESHIFT_VERSION        2
+#define TIMESHIFT_HEADER_SIZE    (64 * 1024)
+#define TIMESHIFT_INDEX_INTERVAL 1000 /* msec */
+#define TIMESHIFT_MIN_SIZE       (16 * 1024 * 1024)
+#define TIMESHIFT_UNIT           (188 * 4096) /* data size is multiple of this */
+
+/*
+ * ring file layout. the header is followed by data_size bytes of
+ * stream, byte N of stream is at header_size + N % data_size.
+ *
+ * the writer stores reserve_pos (release) before it copies into the
+ * ring, and write_pos (release) after. stream bytes before
+ * reserve_pos - data_size may be overwritten at any time.
+ *
+ * readers map the file shared and read without locking:
+ * - load write_pos (acquire), data before it is complete.
+ * - copy data from at least write_pos - data_size.
+ * - then load reserve_pos (acquire, after an acquire fence), and
+ *   discard whatever of the copy is before reserve_pos - data_size,
+ *   it may be torn by a write in progress.
+ */
+typedef struct timeshift_index {
+	uint64_t time;             /* realtime ns */
+	uint64_t pos;              /* stream position */
+} timeshift_index;
+
+typedef struct timeshift_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint64_t data_size;
+	uint64_t write_pos;        /* bytes written since start */
+	uint64_t reserve_pos;      /* bytes being written, >= write_pos */
+	uint64_t start_time;       /* realtime ns */
+	uint32_t live;             /* cleared when writer closed */
+	uint32_t index_interval;   /* msec */
+	uint32_t index_size;       /* capacity of index */
+	uint32_t index_count;      /* entries added, entry n is index[n % index_size] */
+	timeshift_index index[];
+} timeshift_header;
+
+#define TIMESHIFT_INDEX_SIZE ((TIMESHIFT_HEADER_SIZE - sizeof(timeshift_header)) / sizeof(timeshift_index))
+
+/* position of last index entry at or before time, or oldest one still in ring */
+static inline uint64_t timeshift_find(const timeshift_header *h, uint64_t time)
+{
+	uint32_t count = __atomic_load_n(&h->index_count, __ATOMIC_ACQUIRE);
+	uint64_t wpos = __atomic_load_n(&h->write_pos, __ATOMIC_ACQUIRE);
+	uint64_t rpos = __atomic_load_n(&h->reserve_pos, __ATOMIC_ACQUIRE);
+	uint64_t oldest = rpos > h->data_size ? rpos - h->data_size : 0;
+	uint64_t found = wpos;
+	uint32_t n, first = count > h->index_size ? count - h->index_size : 0;
+
+	for (n = count; n > first; n--) {
+		const timeshift_index *e = &h->index[(n - 1) % h->index_size];
+
+		if (e->pos < oldest) {
+			break;
+		}
+		found = e->pos;
+		if (e->time <= time) {
+			break;
+		}
+	}
+
+	return found;
+}
+
+/* writer side, see reader.c */
+typedef struct timeshift {
+	int fd;
+	uint8_t *map;
+	size_t map_size;
+	timeshift_header *hdr;
+	uint8_t *data;
+	uint64_t next_index;       /* realtime ns of next index entry */
+} timeshift;
+
+int timeshift_open(timeshift *ts, const char *path, uint64_t size);
+int timeshift_open_memfd(timeshift *ts, const char *name, uint64_t size);
+ssize_t timeshift_write(timeshift *ts, const uint8_t *data, size_t len);
+void timeshift_close(timeshift *ts);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <time.h>
+
+#include "trace.h"
+
+static const char *stage_names[TRACE_STAGES] = {
+	"capture",
+	"queue",
+	"decode",
+	"write",
+	"total",
+};
+
+static const struct {
+	int stage;
+	int from;
+	int to;
+} stage_stamps[TRACE_STAGES] = {
+	{ TRACE_CAPTURE, STAMP_READ,    STAMP_ENQUEUE },
+	{ TRACE_QUEUE,   STAMP_ENQUEUE, STAMP_DEQUEUE },
+	{ TRACE_DECODE,  STAMP_DEQUEUE, STAMP_DECODE },
+	{ TRACE_WRITE,   STAMP_DECODE,  STAMP_WRITE },
+	{ TRACE_TOTAL,   STAMP_READ,    STAMP_WRITE },
+};
+
+uint64_t trace_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void trace_init(trace *t)
+{
+	int i;
+
+	for (i = 0; i < TRACE_STAGES; i++) {
+		hist_reset(&t->hist[i]);
+	}
+}
+
+/* called by reader thread after the chunk is written */
+void trace_record(trace *t, const BUFSZ *buf)
+{
+	int i;
+
+	for (i = 0; i < TRACE_STAGES; i++) {
+		uint64_t from = buf->stamp[stage_stamps[i].from];
+		uint64_t to = buf->stamp[stage_stamps[i].to];
+
+		hist_record(&t->hist[stage_stamps[i].stage], to > from ? to - from : 0);
+	}
+}
+
+void trace_dump(const trace *t)
+{
+	int i;
+
+	for (i = 0; i < TRACE_STAGES; i++) {
+		const histogram *h = &t->hist[i];
+
+		fprintf(stderr, "%s %-7s p50=%luus p99=%luus p999=%luus max=%luus n=%lu\n",
+			i == 0 ? "Info: Latency" : "              ", stage_names[i],
+			hist_percentile(h, 50) / 1000,
+			hist_percentile(h, 99) / 1000,
+			hist_percentile(h, 99.9) / 1000,
+			__atomic_load_n(&h->max, __ATOMIC_RELAXED) / 1000,
+			__atomic_load_n(&h->count, __ATOMIC_RELAXED));
+	}
+}
+
+/* json object, microseconds */
+int trace_format(const trace *t, char *buf, size_t len)
+{
+	int i;
+	int n = 0;
+
+	n += snprintf(buf + n, len - n, "{");
+	for (i = 0; i < TRACE_STAGES && n < (int)len; i++) {
+		const histogram *h = &t->hist[i];
+
+		n += snprintf(buf + n, len - n, "%s\"%s\":{\"p50\":%lu,\"p99\":%lu,\"p999\":%lu,\"max\":%lu}",
+			i == 0 ? "" : ",", stage_names[i],
+			hist_percentile(h, 50) / 1000,
+			hist_percentile(h, 99) / 1000,
+			hist_percentile(h, 99.9) / 1000,
+			__atomic_load_n(&h->max, __ATOMIC_RELAXED) / 1000);
+	}
+	if (n < (int)len) {
+		n += snprintf(buf + n, len - n, "}");
+	}
+
+	return n < (int)len ? n : -1;
+}
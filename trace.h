@@ -0,0 +1,46 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TRACE_H
+#define RECDVB_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "histogram.h"
+#include "queue.h"
+
+/* latency between two stamps of a chunk */
+enum trace_stage {
+	TRACE_CAPTURE,  /* dvr read -> enqueue */
+	TRACE_QUEUE,    /* enqueue -> dequeue */
+	TRACE_DECODE,   /* dequeue -> decode done */
+	TRACE_WRITE,    /* decode done -> write done */
+	TRACE_TOTAL,    /* dvr read -> write done */
+	TRACE_STAGES,
+};
+
+typedef struct trace {
+	histogram hist[TRACE_STAGES];
+} trace;
+
+uint64_t trace_now(void);
+void trace_init(trace *t);
+void trace_record(trace *t, const BUFSZ *buf);
+void trace_dump(const trace *t);
+int trace_format(const trace *t, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,228 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include "ts.h"
+
+void ts_reader_init(ts_reader *r)
+{
+	r->carry_len = 0;
+}
+
+/* call cb for every packet in data. partial packet is kept for next call. */
+void ts_reader_feed(ts_reader *r, const uint8_t *data, size_t len, ts_packet_cb cb, void *arg)
+{
+	/* complete carried packet */
+	if (r->carry_len > 0) {
+		size_t need = TS_PACKET_SIZE - r->carry_len;
+
+		if (len < need) {
+			memcpy(r->carry + r->carry_len, data, len);
+			r->carry_len += len;
+			return;
+		}
+		memcpy(r->carry + r->carry_len, data, need);
+		data += need;
+		len -= need;
+		r->carry_len = 0;
+
+		if (r->carry[0] == TS_SYNC_BYTE) {
+			cb(arg, r->carry);
+		}
+	}
+
+	while (len >= TS_PACKET_SIZE) {
+		/* resync */
+		if (data[0] != TS_SYNC_BYTE) {
+			data++;
+			len--;
+			continue;
+		}
+		cb(arg, data);
+		data += TS_PACKET_SIZE;
+		len -= TS_PACKET_SIZE;
+	}
+
+	if (len > 0) {
+		memcpy(r->carry, data, len);
+		r->carry_len = len;
+	}
+}
+
+/* offset of payload, or -1 if packet has no payload */
+int ts_payload_offset(const uint8_t *pkt)
+{
+	int off = 4;
+
+	if (!TS_HAS_PAYLOAD(pkt)) {
+		return -1;
+	}
+	if (TS_HAS_AF(pkt)) {
+		off += 1 + pkt[4];
+	}
+	if (off >= TS_PACKET_SIZE) {
+		return -1;
+	}
+
+	return off;
+}
+
+/* returns 1 and set 27MHz PCR if packet carries PCR */
+int ts_get_pcr(const uint8_t *pkt, uint64_t *pcr)
+{
+	const uint8_t *af = pkt + 4;
+	uint64_t base;
+
+	if (!TS_HAS_AF(pkt) || af[0] < 7 || !(af[1] & 0x10)) {
+		return 0;
+	}
+
+	base = ((uint64_t)af[2] << 25) | ((uint64_t)af[3] << 17) |
+		((uint64_t)af[4] << 9) | ((uint64_t)af[5] << 1) | (af[6] >> 7);
+	*pcr = base * 300 + (uint64_t)(((af[6] & 0x01) << 8) | af[7]);
+
+	return 1;
+}
+
+void ts_section_init(ts_section *s, uint16_t pid)
+{
+	s->pid = pid;
+	s->active = 0;
+	s->cc = -1;
+	s->len = 0;
+}
+
+/* total length of section in buffer, or 0 if header is not complete yet */
+static size_t section_total(const ts_section *s)
+{
+	if (s->len < 3) {
+		return 0;
+	}
+	return 3 + (((size_t)(s->data[1] & 0x0f) << 8) | s->data[2]);
+}
+
+static void section_append(ts_section *s, const uint8_t *p, size_t n, ts_section_cb cb, void *arg)
+{
+	while (n > 0 && s->active) {
+		size_t total = section_total(s);
+		size_t want;
+
+		if (total == 0) {
+			want = 3 - s->len;
+		} else if (total > sizeof(s->data)) {
+			s->active = 0;
+			return;
+		} else {
+			want = total - s->len;
+		}
+		if (want > n) {
+			want = n;
+		}
+		memcpy(s->data + s->len, p, want);
+		s->len += want;
+		p += want;
+		n -= want;
+
+		total = section_total(s);
+		if (total > 0 && s->len == total) {
+			cb(arg, s->data, s->len);
+
+			/* next section follows unless stuffing */
+			s->len = 0;
+			if (n == 0 || p[0] == 0xff) {
+				s->active = 0;
+			}
+		}
+	}
+}
+
+void ts_section_feed(ts_section *s, const uint8_t *pkt, ts_section_cb cb, void *arg)
+{
+	int off;
+	int cc = TS_CC(pkt);
+
+	if (TS_PID(pkt) != s->pid || (pkt[1] & 0x80)) {
+		return;
+	}
+
+	off = ts_payload_offset(pkt);
+	if (off < 0) {
+		return;
+	}
+
+	/* drop partial section on discontinuity */
+	if (s->cc != -1 && cc != ((s->cc + 1) & 0x0f)) {
+		if (cc == s->cc) {
+			return; /* duplicate packet */
+		}
+		s->active = 0;
+	}
+	s->cc = cc;
+
+	if (TS_PUSI(pkt)) {
+		int pointer = pkt[off];
+		const uint8_t *p = pkt + off + 1;
+		size_t n = (size_t)(TS_PACKET_SIZE - off - 1);
+
+		if ((size_t)pointer > n) {
+			s->active = 0;
+			return;
+		}
+
+		/* rest of previous section */
+		section_append(s, p, (size_t)pointer, cb, arg);
+
+		/* new section */
+		s->active = 1;
+		s->len = 0;
+		if (p[pointer] == 0xff) {
+			s->active = 0;
+			return;
+		}
+		section_append(s, p + pointer, n - (size_t)pointer, cb, arg);
+	} else {
+		section_append(s, pkt + off, (size_t)(TS_PACKET_SIZE - off), cb, arg);
+	}
+}
+
+/* CRC-32/MPEG-2 */
+uint32_t ts_crc32(const uint8_t *data, size_t len)
+{
+	static uint32_t table[256];
+	static int table_ready = 0;
+	uint32_t crc = 0xffffffff;
+	size_t i;
+
+	if (!table_ready) {
+		uint32_t j, k, c;
+
+		for (j = 0; j < 256; j++) {
+			c = j << 24;
+			for (k = 0; k < 8; k++) {
+				c = (c & 0x80000000) ? (c << 1) ^ 0x04c11db7 : c << 1;
+			}
+			table[j] = c;
+		}
+		__atomic_store_n(&table_ready, 1, __ATOMIC_RELEASE);
+	}
+
+	for (i = 0; i < len; i++) {
+		crc = (crc << 8) ^ table[((crc >> 24) ^ data[i]) & 0xff];
+	}
+
+	return crc;
+}
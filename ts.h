@@ -0,0 +1,67 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TS_H
+#define RECDVB_TS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TS_PACKET_SIZE    188
+#define TS_SYNC_BYTE      0x47
+#define TS_SECTION_MAX    4096
+
+#define TS_PID_PAT        0x0000
+#define TS_PID_NULL       0x1fff
+
+/* packet header accessors */
+#define TS_PID(p)         ((uint16_t)((((p)[1] & 0x1f) << 8) | (p)[2]))
+#define TS_PUSI(p)        (((p)[1] & 0x40) != 0)
+#define TS_CC(p)          ((p)[3] & 0x0f)
+#define TS_HAS_AF(p)      (((p)[3] & 0x20) != 0)
+#define TS_HAS_PAYLOAD(p) (((p)[3] & 0x10) != 0)
+
+/* split arbitrary sized data into aligned 188 byte packets */
+typedef struct ts_reader {
+	uint8_t carry[TS_PACKET_SIZE];
+	size_t carry_len;
+} ts_reader;
+
+typedef void (*ts_packet_cb)(void *arg, const uint8_t *pkt);
+
+/* reassemble PSI sections of one pid */
+typedef struct ts_section {
+	uint16_t pid;
+	int active;
+	int cc;
+	size_t len;
+	uint8_t data[TS_SECTION_MAX + 3];
+} ts_section;
+
+typedef void (*ts_section_cb)(void *arg, const uint8_t *sec, size_t len);
+
+void ts_reader_init(ts_reader *r);
+void ts_reader_feed(ts_reader *r, const uint8_t *data, size_t len, ts_packet_cb cb, void *arg);
+
+int ts_payload_offset(const uint8_t *pkt);
+int ts_get_pcr(const uint8_t *pkt, uint64_t *pcr);
+
+void ts_section_init(ts_section *s, uint16_t pid);
+void ts_section_feed(ts_section *s, const uint8_t *pkt, ts_section_cb cb, void *arg);
+
+uint32_t ts_crc32(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,260 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tsfilter.h"
+
+#define KEEP_SET(f, pid) ((f)->keep[(pid) >> 3] |= (uint8_t)(1 << ((pid) & 7)))
+#define KEEP_HAS(f, pid) ((f)->keep[(pid) >> 3] & (1 << ((pid) & 7)))
+#define EMM_HAS(f, pid)  ((f)->emm[(pid) >> 3] & (1 << ((pid) & 7)))
+
+#define TAG_CA           0x09
+
+/* "ts", "nonull", "sid=N", comma separated */
+int tsfilter_parse(tsfilter *f, const char *spec, size_t len)
+{
+	const char *p = spec, *end = spec + len;
+
+	memset(f, 0, sizeof(*f));
+	while (p < end) {
+		const char *comma = memchr(p, ',', (size_t)(end - p));
+		size_t n = comma ? (size_t)(comma - p) : (size_t)(end - p);
+
+		if (n == 2 && !strncmp(p, "ts", 2)) {
+			/* everything */
+		} else if (n == 6 && !strncmp(p, "nonull", 6)) {
+			f->flags |= TSFILTER_NONULL;
+		} else if (n > 4 && !strncmp(p, "sid=", 4)) {
+			char num[16], *endptr;
+
+			if (n - 4 >= sizeof(num)) {
+				return -1;
+			}
+			memcpy(num, p + 4, n - 4);
+			num[n - 4] = '\0';
+			f->sid = (int)strtol(num, &endptr, 0);
+			if (*endptr != '\0' || f->sid <= 0 || f->sid > 0xffff) {
+				return -1;
+			}
+		} else {
+			return -1;
+		}
+		p += n + 1;
+	}
+	tsfilter_reset(f);
+
+	return 0;
+}
+
+/* forget program layout, e.g. after channel change */
+void tsfilter_reset(tsfilter *f)
+{
+	ts_section_init(&f->pat_sec, TS_PID_PAT);
+	ts_section_init(&f->pmt_sec, TS_PID_NULL);
+	ts_section_init(&f->cat_sec, TS_PID_CAT);
+	f->pmt_pid = TS_PID_NULL;
+	f->pat_valid = 0;
+	memset(f->keep, 0, sizeof(f->keep));
+	memset(f->emm, 0, sizeof(f->emm));
+}
+
+/* CA_PID of CA descriptors in loop, ECM in PMT and EMM in CAT */
+static void ca_pids(const uint8_t *d, size_t len, uint8_t *map)
+{
+	size_t i;
+
+	for (i = 0; i + 2 <= len && i + 2 + d[i + 1] <= len; i += 2 + d[i + 1]) {
+		if (d[i] == TAG_CA && d[i + 1] >= 4) {
+			uint16_t pid = (uint16_t)(((d[i + 4] & 0x1f) << 8) | d[i + 5]);
+
+			map[pid >> 3] |= (uint8_t)(1 << (pid & 7));
+		}
+	}
+}
+
+/* PAT listing only selected program */
+static void build_pat(tsfilter *f, const uint8_t *sec)
+{
+	uint8_t *p = f->pat;
+	uint8_t *s = p + 5;
+	uint32_t crc;
+
+	memset(p, 0xff, TS_PACKET_SIZE);
+	p[0] = TS_SYNC_BYTE;
+	p[1] = 0x40;
+	p[2] = 0x00;
+	p[3] = 0x10;
+	p[4] = 0; /* pointer_field */
+
+	s[0] = 0x00;
+	s[1] = 0xb0;
+	s[2] = 13;
+	s[3] = sec[3]; /* transport_stream_id */
+	s[4] = sec[4];
+	s[5] = sec[5]; /* version */
+	s[6] = 0;
+	s[7] = 0;
+	s[8] = (uint8_t)(f->sid >> 8);
+	s[9] = (uint8_t)(f->sid & 0xff);
+	s[10] = (uint8_t)(0xe0 | (f->pmt_pid >> 8));
+	s[11] = (uint8_t)(f->pmt_pid & 0xff);
+	crc = ts_crc32(s, 12);
+	s[12] = (uint8_t)(crc >> 24);
+	s[13] = (uint8_t)(crc >> 16);
+	s[14] = (uint8_t)(crc >> 8);
+	s[15] = (uint8_t)crc;
+	f->pat_valid = 1;
+}
+
+static void on_pat(void *arg, const uint8_t *sec, size_t len)
+{
+	tsfilter *f = arg;
+	size_t i;
+
+	if (sec[0] != 0x00 || len < 12 || ts_crc32(sec, len) != 0) {
+		return;
+	}
+	for (i = 8; i + 4 <= len - 4; i += 4) {
+		uint16_t program = (uint16_t)((sec[i] << 8) | sec[i + 1]);
+		uint16_t pid = (uint16_t)(((sec[i + 2] & 0x1f) << 8) | sec[i + 3]);
+
+		if (program != f->sid) {
+			continue;
+		}
+		/* program moved, wait for its PMT */
+		if (pid != f->pmt_pid) {
+			f->pmt_pid = pid;
+			ts_section_init(&f->pmt_sec, pid);
+			memset(f->keep, 0, sizeof(f->keep));
+			KEEP_SET(f, pid);
+		}
+		build_pat(f, sec);
+		return;
+	}
+}
+
+static void on_pmt(void *arg, const uint8_t *sec, size_t len)
+{
+	tsfilter *f = arg;
+	uint16_t pcr_pid;
+	size_t i;
+
+	if (sec[0] != 0x02 || len < 16 || ts_crc32(sec, len) != 0 || ((sec[3] << 8) | sec[4]) != f->sid) {
+		return;
+	}
+
+	memset(f->keep, 0, sizeof(f->keep));
+	KEEP_SET(f, f->pmt_pid);
+	KEEP_SET(f, TS_PID_EIT);
+	KEEP_SET(f, TS_PID_TOT);
+	pcr_pid = (uint16_t)(((sec[8] & 0x1f) << 8) | sec[9]);
+	KEEP_SET(f, pcr_pid);
+
+	/* ECM of program, so that output can still be descrambled */
+	i = 12 + (((size_t)(sec[10] & 0x0f) << 8) | sec[11]);
+	if (i <= len - 4) {
+		ca_pids(sec + 12, i - 12, f->keep);
+	}
+	while (i + 5 <= len - 4) {
+		uint16_t pid = (uint16_t)(((sec[i + 1] & 0x1f) << 8) | sec[i + 2]);
+		size_t es_len = ((size_t)(sec[i + 3] & 0x0f) << 8) | sec[i + 4];
+
+		KEEP_SET(f, pid);
+		if (i + 5 + es_len <= len - 4) {
+			ca_pids(sec + i + 5, es_len, f->keep);
+		}
+		i += 5 + es_len;
+	}
+}
+
+static void on_cat(void *arg, const uint8_t *sec, size_t len)
+{
+	tsfilter *f = arg;
+
+	if (sec[0] != 0x01 || len < 12 || ts_crc32(sec, len) != 0) {
+		return;
+	}
+	memset(f->emm, 0, sizeof(f->emm));
+	ca_pids(sec + 8, len - 12, f->emm);
+}
+
+/* selected packets of data as runs in iov, returns number of runs */
+int tsfilter_iov(tsfilter *f, const uint8_t *data, size_t len, struct iovec *iov)
+{
+	size_t off = 0;
+	int n = 0, npat = 0;
+
+	if (f->sid == 0 && f->flags == 0) {
+		iov[0].iov_base = (void *)data;
+		iov[0].iov_len = len;
+		return len > 0 ? 1 : 0;
+	}
+
+	while (off + TS_PACKET_SIZE <= len) {
+		const uint8_t *pkt = data + off;
+		const uint8_t *src = pkt;
+		uint16_t pid;
+		int keep;
+
+		/* resync */
+		if (pkt[0] != TS_SYNC_BYTE) {
+			off++;
+			continue;
+		}
+		off += TS_PACKET_SIZE;
+		pid = TS_PID(pkt);
+
+		if (pid == TS_PID_NULL) {
+			keep = !(f->flags & TSFILTER_NONULL);
+		} else if (f->sid == 0) {
+			keep = 1;
+		} else if (pid == TS_PID_PAT) {
+			/* replaced by single program PAT */
+			ts_section_feed(&f->pat_sec, pkt, on_pat, f);
+			keep = TS_PUSI(pkt) && f->pat_valid && npat < TSFILTER_MAX_PAT;
+			if (keep) {
+				memcpy(f->pat_out[npat], f->pat, TS_PACKET_SIZE);
+				f->pat_out[npat][3] = (uint8_t)(0x10 | (f->pat_cc++ & 0x0f));
+				src = f->pat_out[npat++];
+			}
+		} else if (pid == TS_PID_CAT) {
+			/* EMM pids, with CAT itself */
+			ts_section_feed(&f->cat_sec, pkt, on_cat, f);
+			keep = 1;
+		} else {
+			if (pid == f->pmt_pid) {
+				ts_section_feed(&f->pmt_sec, pkt, on_pmt, f);
+			}
+			keep = KEEP_HAS(f, pid) || EMM_HAS(f, pid);
+		}
+
+		if (!keep) {
+			continue;
+		}
+		if (n > 0 && src == pkt && (const uint8_t *)iov[n - 1].iov_base + iov[n - 1].iov_len == pkt) {
+			iov[n - 1].iov_len += TS_PACKET_SIZE;
+		} else {
+			iov[n].iov_base = (void *)src;
+			iov[n].iov_len = TS_PACKET_SIZE;
+			n++;
+		}
+	}
+
+	return n;
+}
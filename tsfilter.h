@@ -0,0 +1,60 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TSFILTER_H
+#define RECDVB_TSFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "ts.h"
+#include "queue.h"
+
+#define TSFILTER_NONULL   0x01     /* drop null packets */
+#define TSFILTER_MAX_PAT  4        /* rewritten PAT packets per chunk */
+#define TSFILTER_MAX_IOV  (2 * (MAX_READ_SIZE / TS_PACKET_SIZE) + 2)
+
+#define TS_PID_CAT        0x0001
+#define TS_PID_EIT        0x0012
+#define TS_PID_TOT        0x0014
+
+/*
+ * packet selection of one output. selected packets are handed out as
+ * runs pointing into the chunk, nothing is copied but rewritten PAT.
+ */
+typedef struct tsfilter {
+	int sid;                   /* program to keep, 0 for all */
+	int flags;
+
+	/* state of program selection */
+	ts_section pat_sec;
+	ts_section pmt_sec;
+	ts_section cat_sec;
+	uint16_t pmt_pid;          /* TS_PID_NULL until found in PAT */
+	uint8_t keep[8192 / 8];    /* bitmap of pids of program, with ECM */
+	uint8_t emm[8192 / 8];     /* bitmap of EMM pids listed in CAT */
+	uint8_t pat[TS_PACKET_SIZE]; /* single program PAT, cc not set */
+	int pat_valid;
+	int pat_cc;
+	uint8_t pat_out[TSFILTER_MAX_PAT][TS_PACKET_SIZE];
+} tsfilter;
+
+int tsfilter_parse(tsfilter *f, const char *spec, size_t len);
+void tsfilter_reset(tsfilter *f);
+int tsfilter_iov(tsfilter *f, const uint8_t *data, size_t len, struct iovec *iov);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdint.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include <linux/dvb/frontend.h>
+
+#include "tuner.h"
+#include "recdvbcore.h"
+#include "adapter.h"
+#include "trace.h"
+#include "probe.h"
+
+void tuner_init(tuner *t, int dev_num, int fe_num)
+{
+	t->dev_num = dev_num;
+	t->fe_num = fe_num;
+	t->lockfd = -1;
+	t->fefd = -1;
+	t->dmxfd = -1;
+	t->dvrfd = -1;
+	t->pollfd = -1;
+	t->isdbtype = -1;
+	t->channel = NULL;
+	t->tsid = 0;
+	t->lnb = 0;
+	t->state = TUNER_IDLE;
+	timeline_init(&t->tl);
+	t->recover = 0;
+	t->lost_ns = 0;
+	t->retune_ns = 0;
+	t->retuned = 0;
+	t->backoff_ms = TUNER_RETUNE_MIN_MSEC;
+	t->outages = 0;
+	t->outage_ns_total = 0;
+	t->zap_ns = 0;
+	t->zaps = 0;
+}
+
+static int set_lock_poll(tuner *t, int enable)
+{
+	struct itimerspec its = {{0, 0}, {0, 0}};
+
+	if (enable) {
+		its.it_interval.tv_nsec = TUNER_LOCK_POLL_MSEC * 1000000;
+		its.it_value.tv_nsec = TUNER_LOCK_POLL_MSEC * 1000000;
+	}
+
+	return timerfd_settime(t->pollfd, 0, &its, NULL);
+}
+
+/* open frontend and check delivery system, once */
+int tuner_open(tuner *t)
+{
+	/* claim device against other recdvb processes */
+	if (t->lockfd == -1) {
+		t->lockfd = adapter_lock(t->dev_num, t->fe_num);
+		if (t->lockfd == -1) {
+			fprintf(stderr, "Error: Device %d.%d is used by another recdvb.\n", t->dev_num, t->fe_num);
+			return -1;
+		}
+		if (t->lockfd < 0) {
+			/* no lock directory, go on without */
+			t->lockfd = -1;
+		}
+	}
+
+	/* open frontend */
+	if (t->fefd == -1) {
+		t->fefd = open_frontend(t->dev_num, t->fe_num);
+		if (t->fefd == -1) {
+			return -1;
+		}
+	}
+	timeline_mark(&t->tl, TL_FE_OPEN);
+
+	/* check delivery system once */
+	if (t->isdbtype == -1) {
+		t->isdbtype = frontend_probe(t->fefd);
+		if (t->isdbtype == -1) {
+			return -1;
+		}
+	}
+	timeline_mark(&t->tl, TL_DELSYS);
+
+	return 0;
+}
+
+/*
+ * fire the tune as early as possible, then do the remaining setup
+ * while the frontend is locking. demux filter is prepared but only
+ * started on lock.
+ */
+int tuner_start(tuner *t, char *channel, unsigned int tsid, int lnb)
+{
+	timeline_init(&t->tl);
+
+	t->channel = channel;
+	t->tsid = tsid;
+	t->lnb = lnb;
+
+	if (tuner_open(t) != 0) {
+		return -1;
+	}
+
+	/* tune */
+	PROBE3(tune_start, t->dev_num, channel, trace_now());
+	if (frontend_tune(t->fefd, t->isdbtype, channel, tsid, lnb) != 0) {
+		return -1;
+	}
+	timeline_mark(&t->tl, TL_TUNE);
+	t->state = TUNER_TUNING;
+
+	/* following setup overlaps with locking */
+	frontend_show_info(t->fefd);
+
+	/* open dvb demux */
+	if (t->dmxfd == -1) {
+		t->dmxfd = open_demux(t->dev_num, t->fe_num);
+		if (t->dmxfd == -1) {
+			return -1;
+		}
+		if (demux_set_filter(t->dmxfd) != 0) {
+			return -1;
+		}
+	}
+
+	/* open dvb dvr */
+	if (t->dvrfd == -1) {
+		t->dvrfd = open_dvr(t->dev_num, t->fe_num);
+		if (t->dvrfd == -1) {
+			return -1;
+		}
+	}
+
+	/* poll lock in addition to frontend events */
+	if (t->pollfd == -1) {
+		t->pollfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (t->pollfd == -1) {
+			fprintf(stderr, "Error: cannot create timerfd. (errno=%d)\n", errno);
+			return -1;
+		}
+	}
+	if (set_lock_poll(t, 1) == -1) {
+		fprintf(stderr, "Error: cannot set interval time. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* add frontend, lock poll timer and dvr to epoll */
+int tuner_watch(tuner *t, int epfd)
+{
+	struct epoll_event ev;
+
+	ev.data.fd = t->fefd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, t->fefd, &ev) == -1) {
+		fprintf(stderr, "Error: Cannot add source dvb frontend fd to epoll. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	ev.data.fd = t->pollfd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, t->pollfd, &ev) == -1) {
+		fprintf(stderr, "Error: Cannot add source lock poll fd to epoll. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	ev.data.fd = t->dvrfd;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, t->dvrfd, &ev) == -1) {
+		fprintf(stderr, "Error: Cannot add source dvb dvr fd to epoll. (errno=%d)\n", errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * switch channel of running tuner. demux is stopped so that no packet
+ * of the old channel follows the new one, and restarted on lock.
+ */
+int tuner_retune(tuner *t, char *channel, unsigned int tsid)
+{
+	int running = t->state == TUNER_LOCKED || t->state == TUNER_RECOVERING;
+
+	if (running && demux_stop(t->dmxfd) != 0) {
+		return -1;
+	}
+
+	PROBE3(tune_start, t->dev_num, channel, trace_now());
+	if (frontend_tune(t->fefd, t->isdbtype, channel, tsid, t->lnb) != 0) {
+		/* channel is rejected before frontend is touched, keep going */
+		if (running) {
+			demux_start(t->dmxfd);
+		}
+		return -1;
+	}
+
+	timeline_init(&t->tl);
+	t->zap_ns = t->tl.origin;
+	t->channel = channel;
+	t->tsid = tsid;
+	timeline_mark(&t->tl, TL_TUNE);
+	t->state = TUNER_TUNING;
+	t->zaps++;
+
+	return set_lock_poll(t, 1);
+}
+
+/*
+ * lock was lost, or no data came while locked. demux, dvr and everything
+ * behind them are kept open, only the frontend is retuned.
+ */
+int tuner_lost(tuner *t)
+{
+	if (t->state != TUNER_LOCKED) {
+		return 0;
+	}
+
+	t->state = TUNER_RECOVERING;
+	t->lost_ns = trace_now();
+	t->retune_ns = t->lost_ns;
+	t->retuned = 0;
+	t->backoff_ms = TUNER_RETUNE_MIN_MSEC;
+	t->outages++;
+	fprintf(stderr, "Info: Signal lost, retuning.\n");
+
+	return set_lock_poll(t, 1);
+}
+
+/* length of current outage */
+uint64_t tuner_outage_ms(const tuner *t)
+{
+	if (t->state != TUNER_RECOVERING) {
+		return 0;
+	}
+	return (trace_now() - t->lost_ns) / 1000000;
+}
+
+static int handle_tuning(tuner *t)
+{
+	if (frontend_locked(t->fefd) != 0) {
+		return TUNER_EV_NONE;
+	}
+
+	t->state = TUNER_LOCKED;
+	timeline_mark(&t->tl, TL_LOCK);
+	PROBE2(lock, t->dev_num, trace_now());
+	set_lock_poll(t, 0);
+
+	/* demux start */
+	if (demux_start(t->dmxfd) != 0) {
+		fprintf(stderr, "Error: Cannot start demux.\n");
+		return -1;
+	}
+	timeline_mark(&t->tl, TL_DEMUX_START);
+
+	/* show current frequency */
+	frontend_show_frequency(t->fefd, t->isdbtype);
+
+	return TUNER_EV_LOCKED;
+}
+
+/*
+ * data was read from dvr. recovery is declared here, not on FE_HAS_LOCK
+ * alone, since a stalled frontend keeps reporting lock.
+ */
+int tuner_data(tuner *t)
+{
+	uint64_t gap;
+
+	if (t->state != TUNER_RECOVERING || !t->retuned) {
+		return TUNER_EV_NONE;
+	}
+	if (frontend_locked(t->fefd) != 0) {
+		return TUNER_EV_NONE;
+	}
+
+	gap = trace_now() - t->lost_ns;
+	t->state = TUNER_LOCKED;
+	t->outage_ns_total += gap;
+	set_lock_poll(t, 0);
+	fprintf(stderr, "Info: Signal recovered after %.2lfsec.\n", gap / 1000000000.0);
+
+	return TUNER_EV_RECOVERED;
+}
+
+static int handle_recovering(tuner *t)
+{
+	uint64_t now = trace_now();
+
+	if (now < t->retune_ns) {
+		return TUNER_EV_NONE;
+	}
+
+	/* retune with exponential backoff until data flows again */
+	if (frontend_tune(t->fefd, t->isdbtype, t->channel, t->tsid, t->lnb) != 0) {
+		return -1;
+	}
+	t->retuned = 1;
+	t->retune_ns = now + (uint64_t)t->backoff_ms * 1000000;
+	t->backoff_ms *= 2;
+	if (t->backoff_ms > TUNER_RETUNE_MAX_MSEC) {
+		t->backoff_ms = TUNER_RETUNE_MAX_MSEC;
+	}
+
+	return TUNER_EV_NONE;
+}
+
+/*
+ * handle frontend or lock poll event.
+ * returns enum tuner_event, or -1 on error.
+ */
+int tuner_handle(tuner *t, int fd)
+{
+	unsigned int status;
+	int lost = 0;
+
+	if (fd == t->pollfd) {
+		uint64_t exp;
+		if (read(t->pollfd, &exp, sizeof(exp)) == -1 && errno != EAGAIN) {
+			return -1;
+		}
+	} else if (fd == t->fefd) {
+		while (frontend_get_event(t->fefd, &status) == 0) {
+			timeline_mark_status(&t->tl, status);
+			if (t->state == TUNER_LOCKED && !(status & FE_HAS_LOCK)) {
+				lost = 1;
+			}
+		}
+	} else {
+		return TUNER_EV_NONE;
+	}
+
+	switch (t->state) {
+	case TUNER_TUNING:
+		return handle_tuning(t);
+	case TUNER_RECOVERING:
+		return handle_recovering(t);
+	case TUNER_LOCKED:
+		if (lost && t->recover) {
+			/* confirm with current status, event may be stale */
+			if (frontend_locked(t->fefd) != 0) {
+				if (tuner_lost(t) != 0) {
+					return -1;
+				}
+				return TUNER_EV_LOST;
+			}
+		}
+		return TUNER_EV_NONE;
+	default:
+		return TUNER_EV_NONE;
+	}
+}
+
+/* stop streaming but keep devices open, so that next start is warm */
+void tuner_stop(tuner *t)
+{
+	if (t->state == TUNER_LOCKED || t->state == TUNER_RECOVERING) {
+		demux_stop(t->dmxfd);
+	}
+	if (t->pollfd != -1) {
+		set_lock_poll(t, 0);
+	}
+	t->state = TUNER_IDLE;
+}
+
+void tuner_close(tuner *t)
+{
+	/* close dvr/dmx/frontend anyway */
+	if (t->dvrfd != -1) {
+		close(t->dvrfd);
+		t->dvrfd = -1;
+	}
+
+	if (t->dmxfd != -1) {
+		close(t->dmxfd);
+		t->dmxfd = -1;
+	}
+
+	if (t->fefd != -1) {
+		close(t->fefd);
+		t->fefd = -1;
+	}
+
+	if (t->pollfd != -1) {
+		close(t->pollfd);
+		t->pollfd = -1;
+	}
+
+	if (t->lockfd != -1) {
+		close(t->lockfd);
+		t->lockfd = -1;
+	}
+
+	t->state = TUNER_IDLE;
+}
@@ -0,0 +1,89 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_TUNER_H
+#define RECDVB_TUNER_H
+
+#include "timeline.h"
+
+#include <stdint.h>
+
+/* interval to poll FE_READ_STATUS while waiting for lock */
+#define TUNER_LOCK_POLL_MSEC 10
+
+/* backoff between retunes while recovering lost lock */
+#define TUNER_RETUNE_MIN_MSEC 250
+#define TUNER_RETUNE_MAX_MSEC 4000
+
+enum tuner_state {
+	TUNER_IDLE,
+	TUNER_TUNING,
+	TUNER_LOCKED,
+	TUNER_RECOVERING,
+};
+
+/* result of tuner_handle() */
+enum tuner_event {
+	TUNER_EV_NONE,
+	TUNER_EV_LOCKED,
+	TUNER_EV_LOST,
+	TUNER_EV_RECOVERED,
+};
+
+typedef struct tuner {
+	int dev_num;
+	int fe_num;                /* frontendN/demuxN/dvrN of the adapter */
+	int lockfd;                /* claim of the frontend, see adapter.h */
+	int fefd;
+	int dmxfd;
+	int dvrfd;
+	int pollfd;                /* timerfd, armed while tuning */
+	int isdbtype;              /* cached delivery system, -1 until probed */
+
+	char *channel;
+	unsigned int tsid;
+	int lnb;
+
+	enum tuner_state state;
+	timeline tl;
+
+	/* lock loss recovery */
+	int recover;               /* retune on lock loss instead of giving up */
+	uint64_t lost_ns;          /* when current outage started */
+	uint64_t retune_ns;        /* when next retune is issued */
+	int retuned;               /* retune issued in current outage */
+	unsigned int backoff_ms;
+	uint64_t outages;
+	uint64_t outage_ns_total;
+
+	/* channel switching */
+	uint64_t zap_ns;           /* when retune was requested */
+	uint64_t zaps;
+} tuner;
+
+void tuner_init(tuner *t, int dev_num, int fe_num);
+int tuner_open(tuner *t);
+int tuner_start(tuner *t, char *channel, unsigned int tsid, int lnb);
+void tuner_stop(tuner *t);
+int tuner_watch(tuner *t, int epfd);
+int tuner_handle(tuner *t, int fd);
+int tuner_retune(tuner *t, char *channel, unsigned int tsid);
+int tuner_lost(tuner *t);
+int tuner_data(tuner *t);
+uint64_t tuner_outage_ms(const tuner *t);
+void tuner_close(tuner *t);
+
+#endif
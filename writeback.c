@@ -0,0 +1,100 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "writeback.h"
+#include "trace.h"
+
+void writeback_attach(writeback *wb, int fd, uint64_t window)
+{
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+
+	wb->fd = fd;
+	wb->window = window;
+	wb->pos = pos > 0 ? (uint64_t)pos : 0;
+	wb->started = wb->pos;
+	wb->done = wb->pos;
+}
+
+/* wait for queued range and drop it from page cache */
+static uint64_t complete(writeback *wb, uint64_t end)
+{
+	uint64_t t = trace_now();
+
+	sync_file_range(wb->fd, (off_t)wb->done, (off_t)(end - wb->done),
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(wb->fd, (off_t)wb->done, (off_t)(end - wb->done), POSIX_FADV_DONTNEED);
+	wb->done = end;
+
+	return trace_now() - t;
+}
+
+/*
+ * account len bytes appended to file. returns 1 and set time spent
+ * waiting when a window was completed.
+ */
+int writeback_wrote(writeback *wb, size_t len, uint64_t *wait_ns)
+{
+	uint64_t end;
+
+	wb->pos += len;
+	if (wb->window == 0 || wb->pos - wb->started < wb->window) {
+		return 0;
+	}
+
+	/* queue whole windows, asynchronous */
+	end = wb->pos - (wb->pos - wb->started) % wb->window;
+	sync_file_range(wb->fd, (off_t)wb->started, (off_t)(end - wb->started), SYNC_FILE_RANGE_WRITE);
+
+	/* previous window should be on disk by now */
+	if (wb->started - wb->done >= wb->window) {
+		*wait_ns = complete(wb, wb->started);
+		wb->started = end;
+		return 1;
+	}
+	wb->started = end;
+
+	return 0;
+}
+
+/*
+ * queue the rest. with wait, also wait for everything and drop it from
+ * page cache, so that following fsync has little to do.
+ */
+int writeback_finish(writeback *wb, int wait, uint64_t *wait_ns)
+{
+	if (wb->window == 0 || wb->pos == wb->done) {
+		return 0;
+	}
+	if (wb->pos > wb->started) {
+		sync_file_range(wb->fd, (off_t)wb->started, (off_t)(wb->pos - wb->started), SYNC_FILE_RANGE_WRITE);
+		wb->started = wb->pos;
+	}
+	if (!wait) {
+		return 0;
+	}
+	*wait_ns = complete(wb, wb->pos);
+
+	return 1;
+}
+
+/* bytes written but not yet known to be on disk */
+uint64_t writeback_dirty(const writeback *wb)
+{
+	return wb->pos - wb->done;
+}
@@ -0,0 +1,44 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_WRITEBACK_H
+#define RECDVB_WRITEBACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WRITEBACK_WINDOW_DEFAULT (8 * 1024 * 1024)
+
+/*
+ * rolling writeback of a file being appended. every window is queued
+ * for writeback when complete, and the window before it is waited for
+ * and dropped from page cache, so dirty data stays below two windows.
+ */
+typedef struct writeback {
+	int fd;
+	uint64_t window;
+	uint64_t pos;              /* end of data written */
+	uint64_t started;          /* writeback queued up to here */
+	uint64_t done;             /* written back and dropped up to here */
+} writeback;
+
+void writeback_attach(writeback *wb, int fd, uint64_t window);
+int writeback_wrote(writeback *wb, size_t len, uint64_t *wait_ns);
+int writeback_finish(writeback *wb, int wait, uint64_t *wait_ns);
+uint64_t writeback_dirty(const writeback *wb);
+
+#endif
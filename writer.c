@@ -0,0 +1,188 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "writer.h"
+
+#include "bufpool.h"
+
+/* one thread per tuner is enough, more than cores does not help decoding */
+int writer_default_threads(int nreaders)
+{
+	long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	int n = nreaders;
+
+	if (ncpu > 0 && n > ncpu) {
+		n = (int)ncpu;
+	}
+	if (n > WRITER_MAX_THREADS) {
+		n = WRITER_MAX_THREADS;
+	}
+	return n < 1 ? 1 : n;
+}
+
+/* called with mutex held */
+static void push_ready(writer_pool *w, thread_data *tdata)
+{
+	w->ready[(w->ready_head + w->ready_count) % w->ready_size] = tdata;
+	w->ready_count++;
+	pthread_cond_signal(&w->cond);
+}
+
+/* drain queue of reader which has already finished */
+static void discard(thread_data *tdata)
+{
+	BUFSZ *qbuf;
+
+	while (dequeue_nowait(tdata->queue, &qbuf) == 0) {
+		bufpool_put(qbuf);
+	}
+}
+
+static void *writer_func(void *p)
+{
+	writer_pool *w = (writer_pool *)p;
+	thread_data *tdata;
+	BUFSZ *qbuf;
+	int n;
+
+	while (1) {
+		pthread_mutex_lock(&w->mutex);
+		while (w->ready_count == 0 && !w->stop) {
+			pthread_cond_wait(&w->cond, &w->mutex);
+		}
+		if (w->ready_count == 0) {
+			pthread_mutex_unlock(&w->mutex);
+			break;
+		}
+		tdata = w->ready[w->ready_head];
+		w->ready_head = (w->ready_head + 1) % w->ready_size;
+		w->ready_count--;
+		pthread_mutex_unlock(&w->mutex);
+
+		if (tdata->alive == 0) {
+			discard(tdata);
+		}
+
+		for (n = 0; n < WRITER_BATCH && tdata->alive; n++) {
+			int rc = dequeue_nowait(tdata->queue, &qbuf);
+
+			/* end of recording */
+			if (rc == QUEUE_CLOSED) {
+				reader_close(tdata);
+				break;
+			}
+			if (rc != 0) {
+				break;
+			}
+
+			/* cannot write file */
+			if (reader_process(tdata, qbuf) != 0) {
+				reader_close(tdata);
+				discard(tdata);
+				break;
+			}
+		}
+
+		/* requeue under pool mutex, writer_notify() checks flag under it */
+		pthread_mutex_lock(&w->mutex);
+		if (tdata->alive && (queue_depth(tdata->queue) > 0 || queue_closed(tdata->queue))) {
+			push_ready(w, tdata);
+		} else {
+			tdata->scheduled = 0;
+		}
+		pthread_mutex_unlock(&w->mutex);
+	}
+
+	return NULL;
+}
+
+int writer_start(writer_pool *w, int nthreads, int nreaders)
+{
+	int i;
+
+	if (nthreads > WRITER_MAX_THREADS) {
+		nthreads = WRITER_MAX_THREADS;
+	}
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->ready_size = nreaders;
+	w->ready_head = 0;
+	w->ready_count = 0;
+	w->stop = 0;
+	w->nthreads = 0;
+	w->ready = calloc((size_t)nreaders, sizeof(thread_data *));
+	if (!w->ready) {
+		fprintf(stderr, "Error: Cannot allocate writer pool.\n");
+		return -1;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&w->threads[i], NULL, writer_func, w) != 0) {
+			fprintf(stderr, "Error: Cannot create writer thread.\n");
+			break;
+		}
+		w->nthreads++;
+	}
+	if (w->nthreads == 0) {
+		free(w->ready);
+		w->ready = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* call after enqueue, hands reader to a thread unless one has it */
+void writer_notify(writer_pool *w, thread_data *tdata)
+{
+	pthread_mutex_lock(&w->mutex);
+	if (!tdata->scheduled) {
+		tdata->scheduled = 1;
+		push_ready(w, tdata);
+	}
+	pthread_mutex_unlock(&w->mutex);
+}
+
+/* threads exit once every queued reader has been served */
+void writer_stop(writer_pool *w)
+{
+	int i;
+
+	if (!w->ready) {
+		return;
+	}
+
+	pthread_mutex_lock(&w->mutex);
+	w->stop = 1;
+	pthread_cond_broadcast(&w->cond);
+	pthread_mutex_unlock(&w->mutex);
+
+	for (i = 0; i < w->nthreads; i++) {
+		pthread_join(w->threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&w->mutex);
+	pthread_cond_destroy(&w->cond);
+	free(w->ready);
+	w->ready = NULL;
+}
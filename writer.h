@@ -0,0 +1,50 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_WRITER_H
+#define RECDVB_WRITER_H
+
+#include <pthread.h>
+
+#include "reader.h"
+
+/*
+ * pool of threads decoding and writing chunks of several tuners.
+ * a reader (one per tuner, see reader.h) is handed to at most one
+ * thread at a time, so its chunks stay in order and its decoder is
+ * never shared.
+ */
+#define WRITER_MAX_THREADS 16
+#define WRITER_BATCH 64            /* chunks written before yielding reader */
+
+typedef struct writer_pool {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	thread_data **ready;       /* ring of readers with queued chunks */
+	int ready_size;
+	int ready_head;
+	int ready_count;
+	int stop;
+	pthread_t threads[WRITER_MAX_THREADS];
+	int nthreads;
+} writer_pool;
+
+int writer_default_threads(int nreaders);
+int writer_start(writer_pool *w, int nthreads, int nreaders);
+void writer_notify(writer_pool *w, thread_data *tdata);
+void writer_stop(writer_pool *w);
+
+#endif
@@ -0,0 +1,163 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * XXH64 by Yann Collet, see https://github.com/Cyan4973/xxHash for the
+ * specification. written from it for this program.
+ */
+#include <string.h>
+
+#include "xxhash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/* little endian load, compiles to a plain load on x86 and arm */
+static inline uint64_t read64(const uint8_t *p)
+{
+	return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+		((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t merge64(uint64_t acc, uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+void xxh64_reset(xxh64_state *s, uint64_t seed)
+{
+	memset(s, 0, sizeof(*s));
+	s->seed = seed;
+	s->v[0] = seed + PRIME64_1 + PRIME64_2;
+	s->v[1] = seed + PRIME64_2;
+	s->v[2] = seed;
+	s->v[3] = seed - PRIME64_1;
+}
+
+/* 32 byte stripes, four independent lanes */
+static const uint8_t *consume(uint64_t v[4], const uint8_t *p, const uint8_t *limit)
+{
+	uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+
+	do {
+		v1 = round64(v1, read64(p));
+		v2 = round64(v2, read64(p + 8));
+		v3 = round64(v3, read64(p + 16));
+		v4 = round64(v4, read64(p + 24));
+		p += 32;
+	} while (p <= limit);
+
+	v[0] = v1;
+	v[1] = v2;
+	v[2] = v3;
+	v[3] = v4;
+
+	return p;
+}
+
+void xxh64_update(xxh64_state *s, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	const uint8_t *end = p + len;
+
+	s->total += len;
+
+	if (s->memsize + len < 32) {
+		memcpy(s->mem + s->memsize, p, len);
+		s->memsize += len;
+		return;
+	}
+
+	/* complete held stripe */
+	if (s->memsize > 0) {
+		memcpy(s->mem + s->memsize, p, 32 - s->memsize);
+		p += 32 - s->memsize;
+		consume(s->v, s->mem, s->mem);
+		s->memsize = 0;
+	}
+
+	if (p + 32 <= end) {
+		p = consume(s->v, p, end - 32);
+	}
+
+	if (p < end) {
+		memcpy(s->mem, p, (size_t)(end - p));
+		s->memsize = (size_t)(end - p);
+	}
+}
+
+uint64_t xxh64_digest(const xxh64_state *s)
+{
+	const uint8_t *p = s->mem;
+	const uint8_t *end = p + s->memsize;
+	uint64_t h;
+
+	if (s->total >= 32) {
+		h = rotl64(s->v[0], 1) + rotl64(s->v[1], 7) + rotl64(s->v[2], 12) + rotl64(s->v[3], 18);
+		h = merge64(h, s->v[0]);
+		h = merge64(h, s->v[1]);
+		h = merge64(h, s->v[2]);
+		h = merge64(h, s->v[3]);
+	} else {
+		h = s->seed + PRIME64_5;
+	}
+	h += s->total;
+
+	while (p + 8 <= end) {
+		h ^= round64(0, read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)read32(p) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+
+	return h;
+}
@@ -0,0 +1,36 @@
+/*
+ * recdvb - record tool for linux DVB driver.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RECDVB_XXHASH_H
+#define RECDVB_XXHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* streaming XXH64, same digest as xxhsum -H1 */
+typedef struct xxh64_state {
+	uint64_t total;
+	uint64_t v[4];
+	uint8_t mem[32];
+	size_t memsize;
+	uint64_t seed;
+} xxh64_state;
+
+void xxh64_reset(xxh64_state *s, uint64_t seed);
+void xxh64_update(xxh64_state *s, const void *data, size_t len);
+uint64_t xxh64_digest(const xxh64_state *s);
+
+#endif